@@ -0,0 +1,276 @@
+// SAST building throughput and peak memory of a large unit, with
+// nodes owned by the unit arena or individually shared (i.e. one
+// heap allocation plus a reference count per node). The `walk`
+// mode compares walks of the nodes, dispatched by `dynamic_cast`
+// or by `AST::Visitor`, and of the flat tree instead.
+//
+// ```sh
+// $ bench-ast [arena|shared|walk] [functions=100000]
+// ```
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../../src/cpp/header/compiler/ast.hpp"
+#include "../../src/cpp/header/compiler/tree.hpp"
+#include "../../src/cpp/header/compiler/visitor.hpp"
+#include "../../src/cpp/header/utils/arena.hpp"
+
+using namespace Onyx::Compiler;
+
+// Every allocation is counted to measure the peak memory. Blocks
+// are prefixed with their size, which keeps `max_align_t` alignment.
+static size_t allocated = 0;
+static size_t peak = 0;
+
+static const size_t PREFIX = alignof(max_align_t);
+static_assert(Arena::ALIGNMENT <= PREFIX);
+
+void *operator new(size_t size) {
+  auto block = (char *)malloc(PREFIX + size);
+
+  if (!block)
+    throw bad_alloc();
+
+  *(size_t *)block = size;
+  allocated += size;
+
+  if (allocated > peak)
+    peak = allocated;
+
+  return block + PREFIX;
+}
+
+void operator delete(void *block) noexcept {
+  if (!block)
+    return;
+
+  auto prefixed = (char *)block - PREFIX;
+  allocated -= *(size_t *)prefixed;
+  free(prefixed);
+}
+
+void operator delete(void *block, size_t) noexcept {
+  operator delete(block);
+}
+
+void *operator new(size_t size, align_val_t) {
+  return operator new(size);
+}
+
+void operator delete(void *block, align_val_t) noexcept {
+  operator delete(block);
+}
+
+void operator delete(void *block, size_t, align_val_t) noexcept {
+  operator delete(block);
+}
+
+// Nodes owned by an arena.
+struct ArenaOwner {
+  Arena arena;
+
+  template <class T> T *make() { return arena.make<T>(); }
+};
+
+// Nodes owned individually, as with `make_shared`.
+struct SharedOwner {
+  vector<shared_ptr<AST::Node>> nodes;
+
+  template <class T> T *make() {
+    auto node = make_shared<T>();
+    nodes.push_back(node);
+    return node.get();
+  }
+};
+
+static shared_ptr<Token::Value> token(string value) {
+  return make_shared<Token::Value>(
+      Location(nullptr), Token::Value::ID, value);
+}
+
+// Build a unit of *functions* similar to `def fN(a, b) ... end`,
+// with a few calls and operations in each body; tokens are shared
+// to only measure the tree. Returns the root, adding the number
+// of made nodes to *nodes*.
+template <class Owner>
+static AST::Root *
+build(Owner &owner, size_t functions, size_t &nodes) {
+  auto a = token("a"), b = token("b"), f = token("f");
+  auto op = token("+");
+
+  auto root = owner.template make<AST::Root>();
+  nodes++;
+
+  auto id = [&](shared_ptr<Token::Value> value) {
+    auto node = owner.template make<AST::ID>();
+    node->value = value;
+    nodes++;
+    return node;
+  };
+
+  for (size_t i = 0; i < functions; i++) {
+    auto prototype = owner.template make<AST::FunctionPrototype>();
+    prototype->name = f;
+
+    for (auto &name : {a, b}) {
+      auto arg =
+          owner.template make<AST::FunctionArgumentDeclaration>();
+      arg->name = name;
+      prototype->args.push_back(arg);
+    }
+
+    auto body = owner.template make<AST::Body>();
+
+    for (int j = 0; j < 8; j++) {
+      auto binop = owner.template make<AST::Binop>();
+      binop->lhx = id(a);
+      binop->op = op;
+      binop->rhx = id(b);
+
+      auto call = owner.template make<AST::Call>();
+      call->callee = f;
+      call->args.ordered_arguments.push_back(binop);
+      call->args.ordered_arguments.push_back(id(a));
+
+      body->expressions.push_back(call);
+      nodes += 2;
+    }
+
+    auto function = owner.template make<AST::FunctionDefinition>();
+    function->parent_namespace = root;
+    function->prototype = prototype;
+    function->body = body;
+    root->functions.push_back(function);
+
+    nodes += 5;
+  }
+
+  return root;
+}
+
+template <class Owner> static void run(size_t functions) {
+  using namespace chrono;
+
+  auto begin = steady_clock::now();
+  size_t nodes = 0;
+
+  {
+    Owner owner;
+    build(owner, functions, nodes);
+  }
+
+  auto elapsed = duration<double>(steady_clock::now() - begin).count();
+
+  cout << nodes << " nodes in " << elapsed * 1000 << " ms ("
+       << size_t(nodes / elapsed) << " nodes/s), "
+       << peak / 1024 << " KiB peak\n";
+}
+
+// Count the nodes by walking the pointers.
+static size_t walk(const AST::Node *node) {
+  if (!node)
+    return 0;
+
+  size_t count = 1;
+
+  if (auto ns = dynamic_cast<const AST::Namespace *>(node)) {
+    for (auto function : ns->functions)
+      count += walk(function);
+  } else if (auto function =
+                 dynamic_cast<const AST::FunctionDefinition *>(node)) {
+    count += walk(function->prototype) + walk(function->body);
+  } else if (auto proto =
+                 dynamic_cast<const AST::FunctionPrototype *>(node)) {
+    for (auto arg : proto->args)
+      count += walk(arg);
+  } else if (auto body = dynamic_cast<const AST::Body *>(node)) {
+    for (auto expr : body->expressions)
+      count += walk(expr);
+  } else if (auto binop = dynamic_cast<const AST::Binop *>(node))
+    count += walk(binop->lhx) + walk(binop->rhx);
+  else if (auto call = dynamic_cast<const AST::Call *>(node)) {
+    count += walk(call->caller);
+
+    for (auto arg : call->args.ordered_arguments)
+      count += walk(arg);
+  }
+
+  return count;
+}
+
+// Count the nodes by visiting them.
+struct Counter : AST::Visitor<Counter> {
+  size_t count = 0;
+
+  bool enter(AST::Node *node) {
+    if (node)
+      count++;
+
+    return Visitor::enter(node);
+  }
+};
+
+// Count the non-empty nodes by walking the handles.
+static size_t walk(AST::Tree::Handle node) {
+  size_t count = node.kind() != AST::Kind::Empty;
+
+  for (auto child : node)
+    count += walk(child);
+
+  return count;
+}
+
+static void run_walk(size_t functions) {
+  using namespace chrono;
+
+  ArenaOwner owner;
+  size_t nodes = 0;
+  auto root = build(owner, functions, nodes);
+
+  auto time = [](const char *name, auto walk) {
+    auto begin = steady_clock::now();
+    size_t nodes = walk();
+    auto elapsed =
+        duration<double>(steady_clock::now() - begin).count();
+
+    cout << name << ": " << nodes << " nodes in " << elapsed * 1000
+         << " ms (" << size_t(nodes / elapsed) << " nodes/s)\n";
+  };
+
+  time("dynamic_cast", [&]() { return walk(root); });
+
+  time("visitor", [&]() {
+    Counter counter;
+    counter.visit(root);
+    return counter.count;
+  });
+
+  auto begin = steady_clock::now();
+  AST::Tree tree(root);
+  auto elapsed = duration<double>(steady_clock::now() - begin).count();
+  cout << "flattened in " << elapsed * 1000 << " ms\n";
+
+  time("tree", [&]() { return walk(tree.root()); });
+}
+
+int main(int argc, char *argv[]) {
+  const string mode = argc > 1 ? argv[1] : "arena";
+  const size_t functions = argc > 2 ? stoul(argv[2]) : 100000;
+
+  if (mode == "arena")
+    run<ArenaOwner>(functions);
+  else if (mode == "shared")
+    run<SharedOwner>(functions);
+  else if (mode == "walk")
+    run_walk(functions);
+  else {
+    cerr << "Unknown mode " << mode << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,128 @@
+// Parsing throughput of a large unit's top-level declarations,
+// split into ranges and parsed by a number of threads, each into
+// its own arena, then merged in order as by `BC`. Function bodies
+// are skipped, as they are parsed lazily.
+//
+// ```sh
+// $ bench-declarations [functions=100000] [threads=4]
+// ```
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../src/cpp/header/utils/log.hpp"
+
+using namespace Onyx::Compiler;
+
+Verbosity verbosity = Warn;
+
+// Build tokens of *functions* similar to `def fN(a, b)`, with a
+// few lines of operations and calls in each body. Tokens are shared
+// to only measure parsing.
+static vector<shared_ptr<Token::Base>> build(size_t functions) {
+  auto value = [](Token::Value::Kind kind, string value) {
+    return make_shared<Token::Value>(Location(nullptr), kind, value);
+  };
+
+  auto control = [](Token::Control::Kind kind) {
+    return make_shared<Token::Control>(Location(nullptr), kind);
+  };
+
+  shared_ptr<Token::Base> def = value(Token::Value::ID, "def"),
+                          end = value(Token::Value::ID, "end"),
+                          a = value(Token::Value::ID, "a"),
+                          b = value(Token::Value::ID, "b"),
+                          f = value(Token::Value::ID, "f"),
+                          op = value(Token::Value::Op, "+"),
+                          space = control(Token::Control::Space),
+                          newline = control(Token::Control::Newline),
+                          comma = control(Token::Control::Comma),
+                          open = control(Token::Control::OpenParen),
+                          close = control(Token::Control::CloseParen);
+
+  vector<shared_ptr<Token::Base>> tokens;
+
+  for (size_t i = 0; i < functions; i++) {
+    tokens.insert(
+        tokens.end(),
+        {def, space, f, open, a, comma, space, b, close, newline});
+
+    for (int j = 0; j < 8; j++)
+      tokens.insert(
+          tokens.end(),
+          {space, f, open, a, space, op, space, b, comma, space, a,
+           close, newline});
+
+    tokens.insert(tokens.end(), {end, newline, newline});
+  }
+
+  return tokens;
+}
+
+int main(int argc, char *argv[]) {
+  using namespace chrono;
+
+  const size_t functions = argc > 1 ? stoul(argv[1]) : 100000;
+  const size_t threads = argc > 2 ? stoul(argv[2]) : 4;
+
+  auto unit = make_shared<Unit>(false, "bench.nx", nullptr);
+  unit->tokens = build(functions);
+
+  auto begin = steady_clock::now();
+  auto ranges = DeclarationParser::split(*unit);
+  auto elapsed = duration<double>(steady_clock::now() - begin).count();
+
+  cout << "split into " << ranges.size() << " declarations in "
+       << elapsed * 1000 << " ms\n";
+
+  struct Part {
+    Arena arena;
+    AST::Root *root = nullptr;
+  };
+
+  vector<Part> parts(threads);
+  vector<thread> workers;
+
+  begin = steady_clock::now();
+
+  for (size_t t = 0; t < threads; t++)
+    workers.push_back(thread([&, t]() {
+      auto &part = parts[t];
+      part.root = part.arena.make<AST::Root>();
+
+      auto parser = DeclarationParser(*unit, part.arena);
+
+      // Contiguous ranges, so that merging keeps the order
+      const auto from = ranges.size() * t / threads;
+      const auto to = ranges.size() * (t + 1) / threads;
+
+      for (auto i = from; i < to; i++)
+        parser.parse(ranges[i], part.root);
+    }));
+
+  for (auto &worker : workers)
+    worker.join();
+
+  auto root = unit->arena.make<AST::Root>();
+
+  for (auto &part : parts) {
+    for (auto function : part.root->functions) {
+      function->parent_namespace = root;
+      root->functions.push_back(function);
+    }
+
+    unit->arena.adopt(part.arena);
+  }
+
+  elapsed = duration<double>(steady_clock::now() - begin).count();
+
+  cout << "parsed " << root->functions.size() << " functions by "
+       << threads << " threads in " << elapsed * 1000 << " ms ("
+       << size_t(root->functions.size() / elapsed)
+       << " functions/s)\n";
+}
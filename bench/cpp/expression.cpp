@@ -0,0 +1,155 @@
+// Expression parsing throughput on adversarial inputs: a long left
+// associative chain (`a + a + ...`), a right associative one
+// (`a ** a ** ...`), deeply nested parentheses (`((...a...))`) and
+// a pipeline of calls (`a |> f(a) |> ...`). The parser must not
+// overflow the native stack on any of them.
+//
+// The `body` mode compares skipping a function body of that many
+// `a + a` lines, as lazy bodies are while parsing a unit, with
+// actually parsing it.
+//
+// ```sh
+// $ bench-expression [left|right|parens|pipe|body] [terms=100000]
+// ```
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../src/cpp/header/compiler/body_parser.hpp"
+#include "../../src/cpp/header/compiler/expression_parser.hpp"
+#include "../../src/cpp/header/utils/arena.hpp"
+#include "../../src/cpp/header/utils/log.hpp"
+
+using namespace Onyx::Compiler;
+
+Verbosity verbosity = Warn;
+
+using Tokens = vector<shared_ptr<Token::Base>>;
+
+static shared_ptr<Token::Base>
+value(Token::Value::Kind kind, string value) {
+  return make_shared<Token::Value>(Location(nullptr), kind, value);
+}
+
+static shared_ptr<Token::Base> control(Token::Control::Kind kind) {
+  return make_shared<Token::Control>(Location(nullptr), kind);
+}
+
+// Build tokens of an expression of *terms* operands. Tokens are
+// shared to only measure the parser.
+static Tokens build(const string &mode, size_t terms) {
+  auto a = value(Token::Value::ID, "a");
+  auto f = value(Token::Value::ID, "f");
+  auto space = control(Token::Control::Space);
+  auto open = control(Token::Control::OpenParen);
+  auto close = control(Token::Control::CloseParen);
+
+  Tokens tokens;
+
+  if (mode == "body") {
+    auto newline = control(Token::Control::Newline);
+    auto op = value(Token::Value::Op, "+");
+
+    for (size_t i = 0; i < terms; i++)
+      tokens.insert(tokens.end(), {a, space, op, space, a, newline});
+
+    tokens.push_back(value(Token::Value::ID, "end"));
+  } else if (mode == "parens") {
+    tokens.insert(tokens.end(), terms, open);
+    tokens.push_back(a);
+    tokens.insert(tokens.end(), terms, close);
+  } else if (mode == "pipe") {
+    auto pipe = control(Token::Control::PipeArrow);
+    tokens.push_back(a);
+
+    for (size_t i = 1; i < terms; i++)
+      tokens.insert(
+          tokens.end(), {space, pipe, space, f, open, a, close});
+  } else {
+    auto op = value(Token::Value::Op, mode == "left" ? "+" : "**");
+    tokens.push_back(a);
+
+    for (size_t i = 1; i < terms; i++)
+      tokens.insert(tokens.end(), {space, op, space, a});
+  }
+
+  return tokens;
+}
+
+static void run_body(size_t terms) {
+  using namespace chrono;
+
+  Unit unit(false, "bench.nx", nullptr);
+  unit.tokens = build("body", terms);
+
+  auto definition = unit.arena.make<AST::FunctionDefinition>();
+  definition->prototype = unit.arena.make<AST::FunctionPrototype>();
+  definition->prototype->name = static_pointer_cast<Token::Value>(
+      value(Token::Value::ID, "f"));
+
+  auto bodies = BodyParser(unit);
+  size_t cursor = 0;
+
+  auto begin = steady_clock::now();
+  bodies.skip(cursor, definition);
+  auto elapsed =
+      duration<double>(steady_clock::now() - begin).count();
+
+  cout << "skipped " << terms << " lines in " << elapsed * 1000
+       << " ms\n";
+
+  begin = steady_clock::now();
+  auto body = bodies.parse(definition);
+  elapsed = duration<double>(steady_clock::now() - begin).count();
+
+  cout << "parsed " << body->expressions.size() << " lines in "
+       << elapsed * 1000 << " ms\n";
+}
+
+int main(int argc, char *argv[]) {
+  using namespace chrono;
+
+  const string mode = argc > 1 ? argv[1] : "left";
+  const size_t terms = argc > 2 ? stoul(argv[2]) : 100000;
+
+  if (mode == "body") {
+    run_body(terms);
+    return 0;
+  }
+
+  if (mode != "left" && mode != "right" && mode != "parens" &&
+      mode != "pipe") {
+    cerr << "Unknown mode " << mode << "\n";
+    return 1;
+  }
+
+  auto tokens = build(mode, terms);
+
+  Arena arena;
+  size_t cursor = 0;
+  auto parser = ExpressionParser(arena, tokens, cursor);
+
+  auto begin = steady_clock::now();
+
+  try {
+    parser.parse();
+  } catch (ExpressionParser::Error error) {
+    cerr << "Error: " << error.reason << "\n";
+    return 1;
+  }
+
+  auto elapsed =
+      duration<double>(steady_clock::now() - begin).count();
+
+  if (cursor != tokens.size()) {
+    cerr << "Parsed " << cursor << " of " << tokens.size()
+         << " tokens\n";
+    return 1;
+  }
+
+  cout << terms << " terms in " << elapsed * 1000 << " ms ("
+       << size_t(terms / elapsed) << " terms/s)\n";
+}
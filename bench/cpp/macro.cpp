@@ -0,0 +1,67 @@
+// Macro-heavy unit throughput.
+//
+// ```sh
+// $ bench-macro [units=10000] [blocks=8] [workers=<cores>]
+// ```
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../src/cpp/header/compiler/macro.hpp"
+#include "../../src/cpp/header/utils/log.hpp"
+
+using namespace Onyx::Compiler;
+
+Verbosity verbosity = Warn;
+
+// The *n*-th unit instantiates a macro interpreter and evaluates
+// a number of macro *blocks*. Blocks are pure, thus each is unique
+// across the run, so that the interpreter is measured rather than
+// memoized expansions.
+static void unit(size_t n, size_t blocks) {
+  Macro macro;
+
+  for (size_t i = 0; i < blocks; i++) {
+    macro.input += "local t = {} "
+                   "for i = 1, 16 do t[i] = string.rep('x', i) .. " +
+                   to_string(n * blocks + i) + " end\n";
+
+    macro.eval();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  using namespace chrono;
+
+  const size_t units = argc > 1 ? stoul(argv[1]) : 10000;
+  const size_t blocks = argc > 2 ? stoul(argv[2]) : 8;
+  const size_t workers =
+      argc > 3 ? stoul(argv[3]) : thread::hardware_concurrency();
+
+  atomic<size_t> next = 0;
+  auto begin = steady_clock::now();
+
+  auto work = [&]() {
+    for (size_t n; (n = next.fetch_add(1)) < units;)
+      unit(n, blocks);
+  };
+
+  vector<thread> threads;
+
+  for (size_t i = 0; i < workers; i++)
+    threads.push_back(thread(work));
+
+  for (auto &thread : threads)
+    thread.join();
+
+  auto elapsed =
+      duration<double>(steady_clock::now() - begin).count();
+
+  cout << units << " units of " << blocks << " blocks with "
+       << workers << " workers in " << elapsed * 1000 << " ms ("
+       << size_t(units / elapsed) << " units/s)\n";
+}
@@ -0,0 +1,116 @@
+// Macro engine throughput on the macro specs. Build it with and
+// without `-DFNXC_MACRO_LUAJIT=ON` to compare the engines.
+//
+// ```sh
+// $ bench-macro_specs [dir=test/nx/macros] [iterations=10000]
+// ```
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../src/cpp/header/compiler/macro.hpp"
+#include "../../src/cpp/header/utils/log.hpp"
+
+using namespace Onyx::Compiler;
+
+Verbosity verbosity = Warn;
+
+// The `nx.utils` functions used by the specs.
+static const char *PRELUDE = R"LUA(
+  nx.utils = {
+    -- The number of octets (a power of two) to fit *n*
+    octfor = function(n)
+      local octets = 0
+
+      while n >= 2 ^ (8 * octets) do
+        octets = octets == 0 and 1 or octets * 2
+      end
+
+      return octets
+    end,
+
+    -- Round *x* to *digits* after the point
+    rand = function(x, digits)
+      local m = 10 ^ (digits or 0)
+      return math.floor(x * m + 0.5) / m
+    end,
+  }
+)LUA";
+
+// Extract the code of emitting macros, i.e. `{{ code }}`.
+static vector<string> extract(const filesystem::path &path) {
+  ifstream file(path);
+  stringstream ss;
+  ss << file.rdbuf();
+
+  const auto source = ss.str();
+  vector<string> blocks;
+
+  for (size_t begin = source.find("{{"); begin != string::npos;
+       begin = source.find("{{", begin)) {
+    auto end = source.find("}}", begin);
+
+    if (end == string::npos)
+      break;
+
+    blocks.push_back(source.substr(begin + 2, end - begin - 2));
+    begin = end + 2;
+  }
+
+  return blocks;
+}
+
+int main(int argc, char *argv[]) {
+  using namespace chrono;
+
+  const filesystem::path dir = argc > 1 ? argv[1] : "test/nx/macros";
+  const size_t iterations = argc > 2 ? stoul(argv[2]) : 10000;
+
+  vector<vector<string>> units;
+  size_t blocks = 0;
+
+  for (auto &entry : filesystem::recursive_directory_iterator(dir))
+    if (entry.path().extension() == ".nx") {
+      units.push_back(extract(entry.path()));
+      blocks += units.back().size();
+    }
+
+  auto begin = steady_clock::now();
+
+  for (size_t i = 0; i < iterations; i++) {
+    for (auto &unit : units) {
+      Macro macro;
+
+      // A distinct context prevents memoization across iterations
+      macro.input = PRELUDE;
+      macro.input += "nx.ctx.iteration = " + to_string(i);
+      macro.eval();
+
+      for (auto &block : unit) {
+        if (macro.error)
+          break;
+
+        macro.begin_explicit_emit();
+        macro.input += block;
+        macro.eval();
+      }
+
+      if (macro.error) {
+        cerr << "Error: " << macro.error.value() << "\n";
+        return 1;
+      }
+    }
+  }
+
+  auto elapsed = duration<double>(steady_clock::now() - begin).count();
+
+  cout << Macro::engine() << ": " << iterations << " iterations of "
+       << blocks << " blocks in " << units.size() << " units in "
+       << elapsed * 1000 << " ms ("
+       << size_t(iterations * blocks / elapsed) << " blocks/s)\n";
+}
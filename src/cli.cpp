@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <locale>
 #include <regex>
@@ -6,10 +7,13 @@
 #include <string>
 #include <thread>
 
+#include "SQLiteCpp/Exception.h"
+
 using namespace std;
 namespace fs = filesystem;
 
 // #include "./cpp/header/app/aot.hpp"
+#include "./cpp/header/app/shared/cache.hpp"
 #include "./cpp/header/utils/log.hpp"
 
 struct StandardError : std::exception {
@@ -23,6 +27,24 @@ struct StandardError : std::exception {
 
 Verbosity verbosity = Trace;
 
+// The default cache size budget, 1 GiB.
+const uintmax_t DEFAULT_CACHE_MAX_SIZE = uintmax_t(1) << 30;
+
+// Parse a size in bytes with an optional binary suffix, e.g. `512M`.
+uintmax_t parse_size(const string &str) {
+  smatch sm;
+
+  if (!regex_match(str, sm, regex("^(\\d+)([KMG]?)$")))
+    throw StandardError("Invalid size " + str);
+
+  uintmax_t size = stoull(sm[1].str());
+
+  if (sm[2].length())
+    size <<= 10 * (string("KMG").find(sm[2].str()[0]) + 1);
+
+  return size;
+}
+
 // Commands:
 //
 //   // * nxc               — run the REPL
@@ -30,6 +52,7 @@ Verbosity verbosity = Trace;
 //   // * nxc [file]        — run [file] in JIT mode
 //   // * nxc run [file]    — ditto
 //   * nxc build [file]  — build [file] in AOT mode
+//   * nxc cache gc      — evict old cache entries
 //   // * nxc api [file]    — generate API for [file]
 //   // * nxc format [file] — format an Onyx source file
 //
@@ -56,6 +79,22 @@ int main(int argc, char *argv[]) {
       fs::path input_path;
       fs::path output_path;
 
+      // The cache directory, relative to the working directory.
+      fs::path cache_dir = ".fnxccache";
+
+      // The cache is garbage-collected after a build
+      // to fit into this many bytes.
+      uintmax_t cache_max_size = DEFAULT_CACHE_MAX_SIZE;
+
+      // The codec to compress cache entries with.
+      auto cache_codec = Onyx::App::Shared::Compression::None;
+
+      // A shared remote cache URL or directory, if any.
+      optional<string> remote_cache;
+
+      // The path prefix of macro profile files, if profiling.
+      optional<string> macro_profile;
+
       // The number of threads to utilize.
       // Platform maximum by default.
       unsigned short jobs_count = thread::hardware_concurrency();
@@ -103,6 +142,48 @@ int main(int argc, char *argv[]) {
             if (output_path.empty())
               throw StandardError("Output path shall not be empty");
           }
+        } else if (regex_match(arg, sm, regex("^-C(.+)"))) {
+          cache_dir = fs::path(sm[1].str());
+          trace("Set `cache_dir` to \"" + cache_dir.string() + "\"");
+        } else if (regex_match(
+                       arg, sm, regex("^--cache-max-size=(.+)"))) {
+          cache_max_size = parse_size(sm[1].str());
+        } else if (regex_match(
+                       arg, sm, regex("^--cache-codec=(.+)"))) {
+          auto codec =
+              Onyx::App::Shared::Compression::parse(sm[1].str());
+
+          if (!codec)
+            throw StandardError("Unknown cache codec " + sm[1].str());
+
+          cache_codec = codec.value();
+        } else if (regex_match(
+                       arg, sm, regex("^--remote-cache=(.+)"))) {
+          remote_cache = sm[1].str();
+
+          trace(
+              "Set `remote_cache` to \"" + remote_cache.value() +
+              "\"");
+        } else if (regex_match(
+                       arg,
+                       sm,
+                       regex("^--macro-instructions=(\\d+)"))) {
+          Onyx::Compiler::Macro::limits.instructions =
+              stoull(sm[1].str());
+        } else if (regex_match(
+                       arg, sm, regex("^--macro-memory=(.+)"))) {
+          Onyx::Compiler::Macro::limits.memory =
+              parse_size(sm[1].str());
+        } else if (regex_match(
+                       arg, sm, regex("^--macro-timeout=(\\d+)"))) {
+          Onyx::Compiler::Macro::limits.duration =
+              chrono::milliseconds(stoull(sm[1].str()));
+        } else if (regex_match(
+                       arg,
+                       sm,
+                       regex("^--profile-macros(=(.+))?"))) {
+          macro_profile = sm[2].length() ? sm[2].str() : "macros";
+          Onyx::Compiler::Macro::enable_profiler();
         } else if (regex_match(arg, sm, regex("^-j(\\d+)"))) {
           jobs_count = std::stoi(sm[1]);
 
@@ -126,16 +207,73 @@ int main(int argc, char *argv[]) {
 
       // auto aot =
       //     Onyx::App::AOT(input_path, output_path, false,
-      //     jobs_count);
+      //     jobs_count, cache_dir, cache_codec, cache_max_size,
+      //     remote_cache);
 
       // debug("Building " + input_path.string() + "...");
       // aot.compile();
       // debug("Successfully built the program");
+
+      if (macro_profile) {
+        auto report_path = macro_profile.value() + ".profile";
+        auto folded_path = macro_profile.value() + ".folded";
+
+        ofstream report(report_path), folded(folded_path);
+        Onyx::Compiler::Macro::write_profile(report, folded);
+
+        debug(
+            "Wrote the macro profile to \"" + report_path +
+            "\" and \"" + folded_path + "\"");
+      }
+    }
+
+    // The `cache gc` command evicts least-recently-used
+    // cache entries until the cache fits into the size budget.
+    //
+    // ```sh
+    // $ onyxc cache gc --max-size=512M
+    // ```
+    else if (arg == "cache") {
+      if (argc < 3 || string(argv[2]) != "gc")
+        throw StandardError("Expected a cache subcommand (gc)");
+
+      fs::path cache_dir = ".fnxccache";
+      optional<uintmax_t> max_size;
+
+      for (int i = 3; i < argc; i++) {
+        arg = string(argv[i]);
+        smatch sm;
+
+        if (regex_match(arg, sm, regex("^-C(.+)")))
+          cache_dir = fs::path(sm[1].str());
+        else if (regex_match(arg, sm, regex("^--max-size=(.+)")))
+          max_size = parse_size(sm[1].str());
+        else
+          throw StandardError("Unknown option " + arg);
+      }
+
+      if (!max_size)
+        throw StandardError("Expected --max-size to be set");
+
+      if (!fs::exists(cache_dir / "index.db"))
+        throw StandardError(
+            "Cache directory " + cache_dir.string() + " is empty");
+
+      auto evicted = Onyx::App::Shared::Cache::collect(
+          cache_dir, max_size.value());
+
+      cout << "Evicted " << evicted << " bytes\n";
     } else
       throw StandardError("Unknown command " + arg);
   } catch (StandardError &e) {
     cerr << "Error: " << e.what();
     exit(EXIT_FAILURE);
+  } catch (SQLite::Exception &e) {
+    cerr << "Cache error: " << e.what();
+    exit(EXIT_FAILURE);
+  } catch (Onyx::App::Shared::Remote::Error &e) {
+    cerr << "Remote cache error: " << e.message;
+    exit(EXIT_FAILURE);
     // } catch (Onyx::Compiler::Panic &p) {
     //   cerr << "Panic! " << p.what() << "\n";
 
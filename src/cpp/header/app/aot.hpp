@@ -11,6 +11,7 @@ class AOT : Shared::BC {
   const filesystem::path _output;
   const unsigned short _workers;
   const bool _is_lib;
+  const optional<uintmax_t> _cache_max_size;
 
 public:
   AOT(
@@ -18,9 +19,15 @@ public:
       filesystem::path input,
       filesystem::path output,
       bool lib,
-      unsigned short workers);
+      unsigned short workers,
+      optional<filesystem::path> cache_dir = nullopt,
+      Shared::Compression::Codec cache_codec =
+          Shared::Compression::None,
+      optional<uintmax_t> cache_max_size = nullopt,
+      optional<string> remote_cache = nullopt);
 
-  // Compile a program.
+  // Compile a program. If the cache has a size budget, then
+  // it is garbage-collected after a successful compilation.
   void compile();
 };
 } // namespace App
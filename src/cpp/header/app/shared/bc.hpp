@@ -1,9 +1,14 @@
 #pragma once
 
+#include <functional>
+#include <map>
 #include <mutex>
 #include <optional>
 
+#include "../../compiler/macro.hpp"
 #include "../../compiler/panic.hpp"
+#include "../../utils/task_queue.hpp"
+#include "./cache.hpp"
 
 namespace Onyx {
 namespace App {
@@ -17,18 +22,43 @@ namespace Shared {
 // This BC compiler implementation relies heavily on caching the byte
 // code into `.nxbc` files.
 class BC {
+public:
+  // A unit of work run by any worker, e.g. a macro expansion.
+  using Task = TaskQueue::Task;
+
+  // A delayed macro expansion of an entity specialization.
+  struct Expansion {
+    // The `nx.ctx` handles, e.g. the generic arguments.
+    map<string, shared_ptr<Compiler::Macro::Handle>> context;
+
+    string output;
+    vector<shared_ptr<Compiler::Macro::Handle>> spliced;
+    optional<string> error;
+  };
+
+private:
   stack<shared_ptr<Compiler::Unit>> _queued;
   unsigned int _in_progress; // The number of units in progress
 
   mutex _mutex;
   condition_variable _condvar;
 
+  // Run by workers with priority over units;
+  // a push wakes the workers waiting for units.
+  TaskQueue _tasks{[this]() {
+    lock_guard<mutex> lock(_mutex);
+    _condvar.notify_all();
+  }};
+
 protected:
   //   // FIXME: Make it constant.
   //   filesystem::path _root;
 
   optional<Compiler::Panic> _panic;
 
+  // The build cache; it is null if caching is disabled.
+  shared_ptr<Cache> _cache;
+
   // Enqueue a file for BC compilation.
   void enqueue(shared_ptr<Compiler::Unit>);
 
@@ -37,8 +67,27 @@ protected:
   // before any thread began working.
   void work();
 
+  // Enqueue a task to be run by a worker.
+  shared_ptr<Task> async(function<void()>);
+
+  // Wait for the tasks to be done, running queued tasks meanwhile.
+  // Rethrows the exception of the first failed task, in order.
+  void join(const vector<shared_ptr<Task>> &);
+
+  // Expand a delayed macro *code* once per specialization. The
+  // expansions are independent, thus they are run in parallel,
+  // each in its own interpreter; results are stored in order.
+  //
+  // TODO: Call from `_compile` once entities are specialized;
+  // delayed macros are not evaluated yet.
+  void expand(const string &code, vector<Expansion> &expansions);
+
 private:
   void _compile(shared_ptr<Compiler::Unit>);
+
+  // Mark a unit compiled and notify waiting workers.
+  void _complete(shared_ptr<Compiler::Unit>);
+
   void _wait(const vector<shared_ptr<Compiler::Unit>>);
   // virtual filesystem::path
   // _relative_path(shared_ptr<Compiler::Unit>);
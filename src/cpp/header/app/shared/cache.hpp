@@ -0,0 +1,273 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../../compiler/macro.hpp"
+#include "../../compiler/usage.hpp"
+#include "./compression.hpp"
+#include "./remote.hpp"
+
+using namespace std;
+
+namespace SQLite {
+class Database;
+}
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+// The build cache, stored in a `.fnxccache` directory by default.
+//
+// A unit is considered fresh if its source file has not changed
+// since the previous build. The check is two-tier: a matching
+// stat tuple (size, modification time and inode) skips hashing
+// entirely; otherwise the file contents is hashed, and the unit
+// is only invalidated if the hash differs.
+//
+// The cache metadata is stored in an `index.db` SQLite database
+// in WAL mode, shared by all targets and concurrent processes.
+//
+// A fresh unit is invalidated nevertheless if it consumes
+// a declaration whose signature has changed in a recompiled unit.
+//
+// A unit with non-idempotent macros is only cacheable if it sets
+// an `nx.file.cache` function, which is re-run on validation.
+//
+// Compiled entries are stored as `<key>.nxbc` files in the target
+// directory and evicted in least-recently-used order by `gc`.
+// A key is derived from everything a compiled unit depends on:
+// the target, the compiler version, the macro engine, the unit
+// contents, signatures of the declarations it consumes and its
+// `nx.file.cache` value.
+// If a remote is set, then missing entries are fetched from it,
+// and stored entries are put into it in the background.
+//
+// Entries are compressed with the cache codec, which is recorded
+// in every entry header, so that entries compressed with different
+// codecs may coexist.
+//
+// Memoized macro expansions are persisted in the index as well.
+class Cache {
+public:
+  // A source file fingerprint stored in the cache index.
+  struct Fingerprint {
+    uintmax_t size;
+    int64_t mtime_ns;
+    uint64_t inode; // Always zero on Windows
+    uint64_t hash;  // FNV-1a hash of the contents
+
+    // Return `true` if stat tuples are equal (the hash is ignored).
+    bool is_stat_equal(const Fingerprint &) const;
+  };
+
+  // A require (or import) edge of a unit.
+  struct Require {
+    filesystem::path path;
+    bool is_import;
+  };
+
+  // An indexed unit.
+  struct Entry {
+    Fingerprint fingerprint;
+    vector<Require> requirements;
+    Compiler::Usage usage;
+
+    // Whether the unit's macros are idempotent,
+    // i.e. the unit is cacheable.
+    bool is_idempotent;
+
+    // Set for a non-idempotent, but still cacheable unit.
+    optional<Compiler::Macro::CacheFunction> cache_function;
+  };
+
+  // The cache root directory.
+  const filesystem::path root;
+
+  // The target hash, distinguishing caches for
+  // different target parameters.
+  const string target;
+
+  // The target cache directory, i.e. `root / target`.
+  const filesystem::path dir;
+
+  // The codec to compress stored entries with.
+  const Compression::Codec codec;
+
+  // Return a hex-encoded hash of a target *description*.
+  static string target_hash(string description);
+
+  // Open (or create) a cache at *root* for *target*,
+  // loading its index. Validation uses up to *workers* threads.
+  Cache(
+      filesystem::path root,
+      string target,
+      unsigned short workers,
+      Compression::Codec codec = Compression::None,
+      unique_ptr<Remote> remote = nullptr);
+  ~Cache();
+
+  // Stat a file without hashing it.
+  // Returns `nullopt` if the file does not exist.
+  static optional<Fingerprint> stat(filesystem::path);
+
+  // Hash a file contents in chunks, without reading
+  // the whole file into memory.
+  static uint64_t hash(filesystem::path);
+
+  // Validate every indexed unit in parallel.
+  // It should be called once before a build begins,
+  // so that `is_fresh` becomes a lookup.
+  void validate();
+
+  // Fetch entries of fresh units missing locally from the remote
+  // in parallel. It should be called after `validate`.
+  void prefetch();
+
+  // Return `true` if a unit at *path* has been validated as fresh.
+  bool is_fresh(filesystem::path);
+
+  // Return the indexed requirements of a fresh unit at *path*.
+  vector<Require> requirements(filesystem::path);
+
+  // Fingerprint a successfully compiled unit and store it.
+  // The change is written to the database on `flush`.
+  //
+  // Units consuming a declaration whose signature differs
+  // from the previously indexed *usage* are invalidated.
+  void update(
+      filesystem::path,
+      vector<Require> requirements,
+      Compiler::Usage usage,
+      bool is_idempotent = true,
+      optional<Compiler::Macro::CacheFunction> cache_function =
+          nullopt);
+
+  // Store compiled *data* as an entry of an indexed unit.
+  // The data is written into a temporary file, which is then
+  // atomically renamed, so a reader never sees a partial entry.
+  void store(filesystem::path, const string &data);
+
+  // Load an entry of an indexed unit, if it exists. The entry is
+  // leased while being read, so that `gc` would not evict it.
+  // A local miss falls back to the remote.
+  optional<string> load(filesystem::path);
+
+  // Write pending changes to the database in a single transaction.
+  // It is also called automatically once enough changes pile up.
+  void flush();
+
+  // Train a Zstd dictionary from entries stored during this build,
+  // unless the target already has one. Subsequent entries are
+  // compressed with the dictionary.
+  void train();
+
+  // Evict least-recently-used entries of all targets until their
+  // total size fits into *max_size* bytes. Leased entries are
+  // skipped. Returns the number of bytes evicted.
+  uintmax_t gc(uintmax_t max_size);
+
+  // Same as `gc`, but without opening a target, e.g. for
+  // `fnxc cache gc`. Throws if the index at *root* is of another
+  // schema version, rather than migrating (i.e. dropping) it.
+  static uintmax_t
+  collect(filesystem::path root, uintmax_t max_size);
+
+private:
+  const unsigned short _workers;
+  unique_ptr<SQLite::Database> _db;
+
+  // A random token distinguishing temporary files of this instance.
+  const string _token;
+
+  unique_ptr<Remote> _remote;
+
+  // Destroyed before the remote, waiting for pending uploads.
+  unique_ptr<Remote::Uploader> _uploader;
+
+  // Indexed by the unit's absolute path.
+  unordered_map<string, Entry> _index;
+
+  // Paths validated as fresh.
+  unordered_set<string> _fresh;
+
+  // Consumed declaration names mapped to consuming unit paths.
+  unordered_map<string, unordered_set<string>> _consumers;
+
+  // Exported declaration names mapped to exporting unit paths.
+  unordered_map<string, unordered_set<string>> _exporters;
+
+  // Paths changed since the last flush.
+  unordered_set<string> _dirty;
+
+  // Fresh paths to update access time of.
+  unordered_set<string> _accessed;
+
+  // Stored entry keys mapped to their sizes.
+  unordered_map<string, uintmax_t> _stored;
+
+  // The dictionary to compress entries with, if any.
+  shared_ptr<Compression::Dictionary> _dictionary;
+
+  // Loaded dictionaries by their IDs, including older ones.
+  unordered_map<uint32_t, shared_ptr<Compression::Dictionary>>
+      _dictionaries;
+
+  // Raw entries to train a dictionary from.
+  vector<string> _samples;
+  size_t _samples_size = 0;
+
+  mutex _mutex;
+
+  // Validate a single *entry*, updating its stat tuple if
+  // the stat has changed, but the contents has not.
+  bool _validate(const string &path, Entry &entry);
+
+  // Same as `flush`, but expects the mutex to be already locked.
+  void _flush();
+
+  // Invalidate units consuming declarations of *path*
+  // which have changed from *old* to *current* usage.
+  // Consumers and exporters of *path* are re-indexed as well.
+  void _invalidate_consumers(
+      const string &path,
+      const Compiler::Usage *old,
+      const Compiler::Usage &current);
+
+  // Return the entry key of an indexed unit, if any.
+  optional<string> _key(const string &path);
+
+  // Write an encoded entry file, returning `false` on failure.
+  bool _store(const string &key, const string &entry);
+
+  // Read and decode an entry file.
+  optional<string> _read(const string &key);
+
+  // Decode an *entry* read in whole.
+  optional<string> _decode(const string &entry);
+
+  // Fetch an entry from the remote, storing it locally.
+  optional<string> _fetch(const string &key);
+
+  // Return a dictionary by its ID, looking it up
+  // in the target directory, then in the remote.
+  shared_ptr<Compression::Dictionary> _find_dictionary(uint32_t id);
+
+  // Write a file atomically, returning `false` on failure.
+  bool _write(const filesystem::path &, const string &data);
+
+  // Lease an existing entry, returning the lease ID.
+  optional<int64_t> _lease(const string &key);
+  void _release(int64_t lease);
+
+  void _migrate();
+  void _load();
+};
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+// Cache entry compression.
+namespace Compression {
+enum Codec : uint8_t {
+  None = 0,
+  LZ4 = 1,  // Fast
+  Zstd = 2, // Compact, especially with a trained dictionary
+};
+
+// Parse a codec *name*, i.e. `none`, `lz4` or `zstd`.
+optional<Codec> parse(const string &name);
+
+// The maximum raw and stored size of a payload. An entry of a unit
+// never gets near that, thus a header with a larger size is corrupt.
+const uint64_t MAX_SIZE = uint64_t(1) << 30;
+
+// The header prepended to every cache entry. It is 32 bytes long,
+// so that an uncompressed payload is aligned in a mapped file.
+// Fields are stored in the native (little-endian) byte order.
+struct Header {
+  char magic[4]; // "NXBC"
+  uint8_t version;
+  Codec codec;
+  uint16_t reserved;
+  uint32_t dictionary; // A Zstd dictionary ID, zero if none
+  uint32_t checksum;   // An FNV-1a hash of the stored payload
+  uint64_t raw_size;
+  uint64_t stored_size;
+};
+
+static_assert(sizeof(Header) == 32);
+
+// A trained Zstd dictionary.
+class Dictionary {
+public:
+  const string data;
+  const uint32_t id;
+
+  // Train a dictionary of up to *capacity* bytes from *samples*.
+  // Returns null if the samples are not enough to train.
+  static shared_ptr<Dictionary>
+  train(const vector<string> &samples, size_t capacity);
+
+  Dictionary(string data);
+  ~Dictionary();
+
+  Dictionary(const Dictionary &) = delete;
+  Dictionary &operator=(const Dictionary &) = delete;
+
+private:
+  ZSTD_CDict_s *_cdict;
+  ZSTD_DDict_s *_ddict;
+
+  friend string encode(const string &, Codec, const Dictionary *);
+
+  friend bool
+  decode(const Header &, const char *, char *, const Dictionary *);
+};
+
+// Encode *data* of up to `MAX_SIZE` bytes with *codec*, prepending
+// a header. The Zstd codec uses the *dictionary*, if any.
+string encode(
+    const string &data,
+    Codec codec,
+    const Dictionary *dictionary = nullptr);
+
+// Read and check a header at the beginning of *data*. The sizes
+// are checked to be within `MAX_SIZE`, so that a buffer of the raw
+// size may be allocated before the payload is verified.
+optional<Header> read_header(const char *data, size_t size);
+
+// Return `true` if a *payload* of `header.stored_size` bytes
+// matches the header checksum.
+bool verify(const Header &header, const char *payload);
+
+// Verify and decode a *payload* of `header.stored_size` bytes
+// straight into *out*, which must be `header.raw_size` bytes long.
+// Returns `false` if the payload is corrupt. A Zstd payload
+// compressed with a dictionary requires the same *dictionary*.
+bool decode(
+    const Header &header,
+    const char *payload,
+    char *out,
+    const Dictionary *dictionary = nullptr);
+} // namespace Compression
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
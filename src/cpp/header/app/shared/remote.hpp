@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+// A remote cache store shared by a team, e.g. a network directory
+// or an HTTP server. Entries are content-addressed by a target hash
+// and an entry key, thus an entry never changes once put.
+class Remote {
+public:
+  // A transport failure.
+  struct Error {
+    const string message;
+  };
+
+  // Puts entries in the background, so that uploading
+  // never blocks the build. Pending entries are put
+  // before the uploader is destroyed.
+  class Uploader {
+  public:
+    Uploader(Remote &);
+    ~Uploader();
+
+    // Enqueue an entry to be put.
+    void enqueue(string target, string key, string data);
+
+  private:
+    struct Upload {
+      string target;
+      string key;
+      string data;
+    };
+
+    Remote &_remote;
+    deque<Upload> _queue;
+    bool _is_stopped;
+    mutex _mutex;
+    condition_variable _cv;
+    thread _thread;
+
+    void _work();
+  };
+
+  // Open a remote at *url*, which is either an `http://` URL,
+  // a `file://` URL or a plain directory path.
+  static unique_ptr<Remote> open(const string &url);
+
+  virtual ~Remote() = default;
+
+  // Fetch an entry, returning `nullopt` on a miss.
+  virtual optional<string>
+  get(const string &target, const string &key) = 0;
+
+  // Put an entry. Putting an existing entry is a no-op.
+  virtual void
+  put(const string &target, const string &key, const string &data) = 0;
+
+  // Fetch multiple entries using up to *workers* threads, returning
+  // them in the order of *keys*. A failed fetch is a miss.
+  virtual vector<optional<string>> get_many(
+      const string &target,
+      const vector<string> &keys,
+      unsigned short workers);
+};
+
+// A remote stored in a (network) directory,
+// e.g. `<root>/<target>/ab/cdef...`.
+class FilesystemRemote : public Remote {
+public:
+  const filesystem::path root;
+
+  FilesystemRemote(filesystem::path root);
+
+  optional<string> get(const string &target, const string &key);
+
+  void
+  put(const string &target, const string &key, const string &data);
+
+private:
+  filesystem::path _path(const string &target, const string &key);
+};
+
+// A remote accessed with plain HTTP/1.1 `GET` and `PUT` requests
+// at `<prefix>/<target>/<key>`, where 404 means a miss.
+class HTTPRemote : public Remote {
+public:
+  const string host;
+  const string port;
+  const string prefix;
+
+  HTTPRemote(string host, string port, string prefix);
+
+  optional<string> get(const string &target, const string &key);
+
+  void
+  put(const string &target, const string &key, const string &data);
+
+  // Requests are pipelined over a connection per worker.
+  vector<optional<string>> get_many(
+      const string &target,
+      const vector<string> &keys,
+      unsigned short workers);
+
+private:
+  string _request(
+      const string &method,
+      const string &target,
+      const string &key,
+      const string *body = nullptr);
+};
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
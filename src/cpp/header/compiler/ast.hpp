@@ -1,73 +1,176 @@
 #pragma once
 
+#include "../utils/fnv1a.hpp"
+#include "../utils/interner.hpp"
+#include "../utils/small_vector.hpp"
 #include "./token.hpp"
-#include <map>
+#include <algorithm>
 #include <set>
+#include <vector>
 #include <variant>
 
 using namespace std;
 
 namespace Onyx {
 namespace Compiler {
+// Nodes of a unit are owned by its arena (see `Unit::arena`)
+// and refer to each other by plain pointers; they are destroyed
+// all at once along with the unit. Children are kept in source
+// order, mostly inline as there are few of them.
 namespace AST {
+// The kind of a node, which allows to dispatch on it
+// without RTTI (see `Visitor`) and to flatten it (see `Tree`).
+enum class Kind : uint8_t {
+  Empty, // A missing optional child in a `Tree`
+  Root,
+  Namespace,
+  Module, // Including objects
+  Enum,
+  Annotation,
+  FunctionDefinition,
+  FunctionDeclaration,
+  FunctionPrototype,
+  FunctionArgumentDeclaration,
+  AnnotationApplication,
+  Body,
+  NamedArgument, // Only in a `Tree`
+  ID,
+  Splat,
+  Binop,
+  Unop,
+  Ternary,
+  Call,
+  Literal,
+};
+
+// Return the name of a node *kind*, e.g. `"Binop"`.
+const char *kind_name(Kind);
+
 struct Node {
+  const Kind kind;
+
+  Node(Kind kind) : kind(kind) {}
   virtual ~Node() {}
-  virtual void dump(ostream *, unsigned short = 0);
-};
 
-struct Root : Node {};
+  // Dump the subtree, a node per line, in the same format
+  // as `Tree::Handle::dump`, so that both may be compared.
+  virtual void dump(ostream *, unsigned short tab = 0);
+};
 
 // Something declared in a namespace, which includes
 // functions, variables and other namespaces.
 struct Declaration : Node {
-  void dump(ostream *, unsigned short tab = 0);
+  // A structural hash, which ignores whitespace, comments and
+  // locations (see `AST::rehash`). Unless it changes, the
+  // declaration has not changed.
+  FNV1a::Hash128 hash = {};
+
+  Declaration(Kind kind) : Node(kind) {}
 };
 
 struct FunctionDefinition;
 
 struct Namespace : Declaration {
-  wstring name;
-  shared_ptr<Namespace> parent_namespace;
+  string name;
+  Namespace *parent_namespace = nullptr;
 
-  set<shared_ptr<FunctionDefinition>> functions;
-  set<shared_ptr<Namespace>> namespaces;
+  SmallVector<FunctionDefinition *> functions;
+  SmallVector<Namespace *> namespaces;
   // set<shared_ptr<VariableDeclaration>> variables;
   // set<shared_ptr<ConstantDeclaration>> constants;
 
-  void dump(ostream *, unsigned short tab = 0);
+  Namespace(Kind kind = Kind::Namespace) : Declaration(kind) {}
+};
+
+// The unit's top-level namespace.
+struct Root : Namespace {
+  Root() : Namespace(Kind::Root) {}
 };
 
-struct Expression : Node {};
+struct Expression : Node {
+  Expression(Kind kind) : Node(kind) {}
+};
 
 struct ID : Expression {
   shared_ptr<Token::Value> value;
+  ID() : Expression(Kind::ID) {}
 };
 
-struct Literal : Expression {};
+struct Literal : Expression {
+  Literal() : Expression(Kind::Literal) {}
+};
 
 // String literal is a continuation of strings
 // mixed with interpolation expressions.
 struct StringLiteral : Literal {
-  vector<variant<shared_ptr<Token::Value>, shared_ptr<Expression>>>
+  vector<variant<shared_ptr<Token::Value>, Expression *>>
       values;
 };
 
 struct NumericLiteral : Literal {};
 
 struct Body : Node {
-  set<shared_ptr<Expression>> expressions;
-  void dump(ostream *, unsigned short tab = 0);
+  SmallVector<Expression *> expressions;
+
+  Body() : Node(Kind::Body) {}
+};
+
+struct NamedArgument {
+  Interner::Id name; // See `Interner::global()`
+  Expression *value;
 };
 
 struct Arguments {
-  set<shared_ptr<Expression>> ordered_arguments;
-  map<string, shared_ptr<Expression>> named_arguments;
+  SmallVector<Expression *> ordered_arguments;
+
+  // Sorted by name ids for lookup, not in source order.
+  SmallVector<NamedArgument> named_arguments;
+
+  // Return a named argument value, or `nullptr`.
+  Expression *named(Interner::Id name) const {
+    auto it = _find(name);
+
+    if (it != named_arguments.end() && it->name == name)
+      return it->value;
+
+    return nullptr;
+  }
+
+  // Return named arguments sorted by name. Unlike the id order,
+  // it does not depend on the interning order, which may differ
+  // between runs, thus it is used for encoding and dumping.
+  vector<const NamedArgument *> sorted_named() const;
+
+  // Add a named argument, unless it is already set.
+  // Returns `false` on a duplicate.
+  bool add_named(Interner::Id name, Expression *value) {
+    auto it = _find(name);
+
+    if (it != named_arguments.end() && it->name == name)
+      return false;
+
+    named_arguments.insert(it, {name, value});
+    return true;
+  }
+
+private:
+  const NamedArgument *_find(Interner::Id name) const {
+    return lower_bound(
+        named_arguments.begin(),
+        named_arguments.end(),
+        name,
+        [](const NamedArgument &arg, Interner::Id name) {
+          return arg.name < name;
+        });
+  }
 };
 
 // Annotation "usage".
 struct AnnotationApplication : Node {
   shared_ptr<Token::Value> id;
   Arguments args;
+
+  AnnotationApplication() : Node(Kind::AnnotationApplication) {}
 };
 
 // `..foo` is an example of a regular splat, while `**foo` is a named
@@ -75,31 +178,49 @@ struct AnnotationApplication : Node {
 struct Splat : Expression {
   bool is_named;
   shared_ptr<Token::Value> id;
+
+  Splat() : Expression(Kind::Splat) {}
 };
 
 // Binary operations involve left and right hand
 // expressions and the operator between them.
 struct Binop : Expression {
-  shared_ptr<Expression> lhx;
+  Expression *lhx = nullptr;
   shared_ptr<Token::Value> op;
-  shared_ptr<Expression> rhx;
+  Expression *rhx = nullptr;
+
+  Binop() : Expression(Kind::Binop) {}
 };
 
 // Unary operation has the operator and the expression.
 struct Unop : Expression {
   shared_ptr<Token::Value> op;
-  shared_ptr<Expression> expr;
+  Expression *expr = nullptr;
+
+  Unop() : Expression(Kind::Unop) {}
+};
+
+// `cond ? then : else`, or `cond ?: else` (the Elvis operator),
+// which has no `then`, evaluating to `cond` unless it is falsey.
+struct Ternary : Expression {
+  Expression *cond = nullptr;
+  Expression *then = nullptr;
+  Expression *else_ = nullptr;
+
+  Ternary() : Expression(Kind::Ternary) {}
 };
 
 struct Call : Expression {
   shared_ptr<Token::Value> modifiers;
-  shared_ptr<Expression> caller;
+  Expression *caller = nullptr;
   shared_ptr<Token::Value> callee;
   Arguments args;
+
+  Call() : Expression(Kind::Call) {}
 };
 
 struct FunctionArgumentDeclaration : Node {
-  set<shared_ptr<AnnotationApplication>> annotations;
+  SmallVector<AnnotationApplication *> annotations;
   bool is_const;
 
   enum { Common, Vargs, Kwargs } type;
@@ -107,37 +228,57 @@ struct FunctionArgumentDeclaration : Node {
   shared_ptr<Token::Value> alias;
   shared_ptr<Token::Value> name;
 
-  shared_ptr<Expression> restriction;
-  shared_ptr<Expression> default_value;
+  Expression *restriction = nullptr;
+  Expression *default_value = nullptr;
 
-  void dump(ostream *, unsigned short tab = 0);
+  FunctionArgumentDeclaration() :
+      Node(Kind::FunctionArgumentDeclaration) {}
 };
 
 struct FunctionPrototype : Node {
-  set<shared_ptr<AnnotationApplication>> annotations;
-  set<shared_ptr<Token::Value>> modifiers;
+  SmallVector<AnnotationApplication *> annotations;
+  vector<shared_ptr<Token::Value>> modifiers; // In source order
   shared_ptr<Token::Value> name;
-  set<shared_ptr<FunctionArgumentDeclaration>> args;
+  SmallVector<FunctionArgumentDeclaration *> args;
 
-  void dump(ostream *, unsigned short tab = 0);
+  FunctionPrototype() : Node(Kind::FunctionPrototype) {}
 };
 
 // It's only applicable to abstract functions.
 struct FunctionDeclaration : Declaration {
-  shared_ptr<FunctionPrototype> prototype;
+  FunctionPrototype *prototype = nullptr;
+
+  FunctionDeclaration() : Declaration(Kind::FunctionDeclaration) {}
 };
 
 struct FunctionDefinition : Declaration {
-  shared_ptr<Namespace> parent_namespace;
-  shared_ptr<FunctionPrototype> prototype;
-  shared_ptr<Body> body;
+  Namespace *parent_namespace = nullptr;
+  FunctionPrototype *prototype = nullptr;
 
-  void dump(ostream *, unsigned short tab = 0) override;
+  // The body, unless it is yet to be parsed on demand,
+  // see `BodyParser::parse`.
+  Body *body = nullptr;
+
+  // Indices of the first token of a lazy body and of its closing
+  // `end` in `Unit::tokens`, or zeros.
+  size_t body_begin = 0;
+  size_t body_end = 0;
+
+  // Structural hashes of the prototype and the body; `hash`
+  // combines both.
+  FNV1a::Hash128 prototype_hash = {};
+  FNV1a::Hash128 body_hash = {};
+
+  FunctionDefinition() : Declaration(Kind::FunctionDefinition) {}
+
+  bool is_lazy() const { return !body && body_end; }
 };
 
 // Module is a namespace with instance and abstract methods.
 struct Module : Namespace {
-  set<shared_ptr<FunctionDeclaration>> function_declarations;
+  SmallVector<FunctionDeclaration *> function_declarations;
+
+  Module() : Namespace(Kind::Module) {}
 };
 
 // Object is an instantiate-able module.
@@ -149,19 +290,13 @@ struct Struct : Object {};
 
 struct Class : Object {};
 
-struct Enum : Declaration {};
-
-struct Annotation : Declaration {};
-
-static wstring tabs(unsigned short tab) {
-  wstring buffer;
-
-  for (unsigned short i = 0; i < tab; i++) {
-    buffer.append(L"  ");
-  }
+struct Enum : Declaration {
+  Enum() : Declaration(Kind::Enum) {}
+};
 
-  return buffer;
-}
+struct Annotation : Declaration {
+  Annotation() : Declaration(Kind::Annotation) {}
+};
 }; // namespace AST
 } // namespace Compiler
 } // namespace Onyx
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "./ast.hpp"
+#include "./unit.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+// Parses function bodies lazily. While parsing a unit, a body is
+// only skipped by matching block nesting at the token level, and
+// its token range is recorded in the definition. The body is then
+// parsed on demand, i.e. when the function is first referenced or
+// type-checked; declarations-only consumers (imports, docs, outline)
+// never parse bodies at all.
+//
+// ```
+// auto bodies = BodyParser(*unit);
+//
+// // Right after `def foo()`, stopping after the `end`
+// bodies.skip(cursor, definition);
+//
+// // Later, e.g. from another thread
+// auto body = bodies.parse(definition);
+// ```
+class BodyParser {
+  Unit &_unit;
+
+public:
+  struct Error {
+    shared_ptr<Token::Base> token;
+    const string reason;
+  };
+
+  explicit BodyParser(Unit &unit) : _unit(unit) {}
+
+  // Skip a *definition* body from *cursor* in the unit tokens,
+  // i.e. from right after the prototype, up to and including the
+  // closing `end`. Throws `Error` if it is missing.
+  void skip(size_t &cursor, AST::FunctionDefinition *definition);
+
+  // Return the index of the `end` closing a block which contents
+  // begin at *begin*, matching nested blocks. Throws `Error` if it
+  // is missing.
+  size_t end_of(size_t begin) const;
+
+  // Return the index of the newline or semicolon ending a statement
+  // from *begin*, out of brackets and nested blocks, or the number
+  // of tokens.
+  size_t statement_end(size_t begin) const;
+
+  // Return the body of a *definition*, parsing it on the first
+  // call. It is thread-safe. Throws `Error` on a syntax error.
+  AST::Body *parse(AST::FunctionDefinition *definition);
+
+  // Parse every lazy body in a namespace, recursively.
+  void parse_all(AST::Namespace *);
+
+private:
+  // Return the previous non-space token index on the same line
+  // before *index*, if any.
+  optional<size_t> _previous(size_t index, size_t begin) const;
+
+  // Return `true` if an ID token at *index* opens a block ending
+  // with `end`, e.g. `if` in `if x`, but not in `y if x`.
+  bool _is_opening(size_t index, size_t begin) const;
+};
+} // namespace Compiler
+} // namespace Onyx
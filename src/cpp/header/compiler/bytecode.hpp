@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "./ast.hpp"
+#include "./unit.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+// The byte code of a unit SAST, which is stored in the build cache,
+// so that a fresh unit is not lexed nor parsed again.
+//
+// Nodes are written depth-first, each as its kind, fields and child
+// counts, followed by its children. Both encoding and decoding keep
+// pending nodes on an explicit stack, thus a tree of any depth
+// (e.g. of a long operator chain) may be stored.
+// Tokens keep their kinds, values and locations; names are written
+// as strings, as interned ids depend on the interning order.
+// Declaration hashes are written too, thus a decoded SAST may be
+// compared with `Reload::classify`. Literal values are not
+// represented yet, similar to `AST::Tree`.
+//
+// A lazy body is not parsed for encoding; its tokens are written
+// instead, and appended to the decoding unit tokens, so that the
+// body is parsed (and its syntax errors are reported) on demand.
+//
+// ```
+// auto data = Bytecode::encode(*unit);
+//
+// // Later, in another process
+// unit->sast = Bytecode::decode(data, unit);
+// auto body = BodyParser(*unit).parse(unit->sast->functions[0]);
+// ```
+namespace Bytecode {
+// Encode the SAST of a *unit*, along with tokens of lazy bodies.
+string encode(const Unit &unit);
+
+// Decode *data* into a SAST allocated in the *unit* arena, with
+// tokens located in the *unit*; tokens of lazy bodies are appended
+// to `Unit::tokens`. Returns `nullptr` if the data is malformed or
+// of another version; nodes decoded so far are freed along with
+// the arena, and appended tokens are dropped.
+AST::Root *decode(string_view data, shared_ptr<Unit> unit);
+} // namespace Bytecode
+} // namespace Compiler
+} // namespace Onyx
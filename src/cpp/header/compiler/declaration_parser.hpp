@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utils/arena.hpp"
+#include "../utils/task_queue.hpp"
+#include "./ast.hpp"
+#include "./body_parser.hpp"
+#include "./unit.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+// Parses top-level declarations of a unit from its tokens.
+//
+// With function bodies skipped (see `BodyParser`), top-level
+// declarations are independent token ranges. They are split by
+// matching block nesting only, and then may be parsed in parallel,
+// each into its own arena and namespace, to be merged in source
+// order afterwards. Parsers never share nodes, thus they do not
+// synchronize.
+//
+// ```
+// auto ranges = DeclarationParser::split(*unit, cursor);
+//
+// // In a task
+// auto parser = DeclarationParser(*unit, arena);
+// parser.parse(ranges[i], partial_root);
+//
+// // Or all of the above
+// DeclarationParser::parse_unit(*unit, queue);
+// ```
+//
+// Functions (`def`) and namespaces are parsed, the latter along
+// with their declarations; other declarations are not supported yet.
+// Their structural hashes are computed on the way (see
+// `AST::rehash`), except for the namespace passed to `parse`.
+class DeclarationParser {
+public:
+  // A token range `[begin, end)` in `Unit::tokens`.
+  struct Range {
+    size_t begin;
+    size_t end;
+  };
+
+  struct Error {
+    shared_ptr<Token::Base> token;
+    const string reason;
+  };
+
+  // A parsing task covers consecutive declarations
+  // of at least that many tokens in total.
+  static const size_t PART_TOKENS = 4096;
+
+  // Parse the top-level declarations of a lexed *unit* into its
+  // SAST. Parts of about *part_tokens* are parsed in tasks of the
+  // *queue*, each into its own arena and root, which are merged in
+  // source order. Rethrows the first `Error` in source order.
+  static void parse_unit(
+      Unit &unit,
+      TaskQueue &queue,
+      size_t part_tokens = PART_TOKENS);
+
+  // Split the *unit* tokens from *begin* into ranges of top-level
+  // declarations, skipping blank lines. Throws `Error` on
+  // unbalanced blocks.
+  static vector<Range> split(Unit &unit, size_t begin = 0);
+
+  // Nodes are made in the *arena*, which may be other than
+  // the unit's one; it is then to be adopted by the latter.
+  DeclarationParser(Unit &unit, Arena &arena);
+
+  // Parse a declaration *range* into a namespace.
+  // Throws `Error` on failure.
+  void parse(Range range, AST::Namespace *ns);
+
+private:
+  Unit &_unit;
+  Arena &_arena;
+  BodyParser _bodies;
+
+  size_t _cursor;
+  size_t _end; // The end of the current range
+
+  // Split a block contents from *begin* into *ranges* of
+  // statements. Returns the index of the closing `end`, or of
+  // the last token if not *is_block*.
+  static size_t _split(
+      Unit &unit,
+      const BodyParser &bodies,
+      size_t begin,
+      vector<Range> &ranges,
+      bool is_block);
+
+  // Return the current token skipping spaces and comments (and
+  // newlines, if *skip_newlines*), or `nullptr` on the range end.
+  shared_ptr<Token::Base> _peek(bool skip_newlines = false);
+
+  AST::Expression *_expression();
+
+  // Parse a function after its keyword; the declaration, including
+  // *modifiers*, begins at *begin*.
+  void _function(
+      AST::Namespace *ns,
+      const vector<shared_ptr<Token::Value>> &modifiers,
+      size_t begin);
+
+  void _namespace(AST::Namespace *ns);
+
+  [[noreturn]] void _err(shared_ptr<Token::Base>, string reason);
+};
+} // namespace Compiler
+} // namespace Onyx
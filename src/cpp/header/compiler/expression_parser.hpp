@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../utils/arena.hpp"
+#include "./ast.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+// Parses an expression from lexed tokens into SAST nodes made in
+// a unit arena. It is a Pratt (precedence climbing) parser driven
+// by a table of operator binding powers, and it is iterative: the
+// pending operators and brackets are kept on an explicit stack of
+// bounded depth, so that no input may overflow the native stack.
+//
+// It covers prefix and infix `Op` tokens, calls (`f(a, b: c)` and
+// `x.f`), splats (`..a` and `**a`), the ternary (`c ? a : b`),
+// Elvis (`a ?: b`) and pipe (`a |> f(b)`, i.e. `f(a, b)`) operators.
+//
+// ```
+// size_t cursor = 0;
+// auto parser = ExpressionParser(unit->arena, tokens, cursor);
+// auto expr = parser.parse(); // `cursor` is after the expression
+// ```
+//
+// The parser never reads past *tokens*, which may be a subspan of
+// a unit's tokens, e.g. of a function body.
+class ExpressionParser {
+public:
+  // Pending brackets and operators, e.g. of a right associative
+  // chain, are limited to that many. A left associative chain never
+  // grows the stack, thus it is not limited; later passes walk the
+  // tree iteratively as well (see `Visitor`).
+  static const size_t MAX_DEPTH = 1 << 20;
+
+  struct Error {
+    shared_ptr<Token::Base> token;
+    const string reason;
+  };
+
+  ExpressionParser(
+      Arena &arena,
+      span<const shared_ptr<Token::Base>> tokens,
+      size_t &cursor,
+      size_t max_depth = MAX_DEPTH);
+
+  // Parse an expression, stopping at a token which can not continue
+  // it (e.g. a newline or an unbalanced bracket), which is left
+  // unconsumed. Throws `Error` on failure.
+  AST::Expression *parse();
+
+private:
+  // Something waiting on the stack for the next operand.
+  struct Frame {
+    enum Kind {
+      Prefix,      // `op` applies to the operand
+      Infix,       // `lhx op` waits for the right operand
+      Elvis,       // `lhx ?:` waits for the right operand
+      Pipe,        // `lhx |>` waits for a call
+      TernaryThen, // `lhx ?` waits for `then` and a colon
+      TernaryElse, // `lhx ? then :` waits for `else`
+      Paren,       // `(` waits for the closing parenthesis
+      Arguments,   // `f(` waits for arguments or the closing one
+    };
+
+    Kind kind;
+    unsigned char power = 0; // The binding power of an operator
+
+    shared_ptr<Token::Base> token;
+    AST::Expression *lhx = nullptr;
+    AST::Expression *then = nullptr;
+    AST::Call *call = nullptr;
+
+    // A named argument name, see `Interner::global()`
+    optional<Interner::Id> name = nullopt;
+  };
+
+  Arena &_arena;
+  span<const shared_ptr<Token::Base>> _tokens;
+  size_t &_cursor;
+  size_t _max_depth;
+
+  vector<Frame> _stack;
+
+  // Return the current token skipping spaces and comments (and
+  // newlines, if *skip_newlines*), or `nullptr` on the end.
+  // Sets `_is_spaced` if there was a space before.
+  shared_ptr<Token::Base> _peek(bool skip_newlines = false);
+  bool _is_spaced;
+
+  // The number of open brackets, within which newlines are spaces.
+  size_t _brackets;
+
+  void _push(Frame);
+
+  // Reduce operators binding tighter than *power* into *value*,
+  // or all of them by default, up to a bracket.
+  void _reduce(AST::Expression *&value, unsigned power = 0);
+
+  // Apply a popped operator *frame* to its right operand *rhx*.
+  AST::Expression *_apply(Frame &frame, AST::Expression *rhx);
+
+  // Add an argument to the call of the top `Arguments` frame.
+  void _argument(AST::Expression *value);
+
+  [[noreturn]] void _err(shared_ptr<Token::Base>, string reason);
+};
+} // namespace Compiler
+} // namespace Onyx
@@ -15,8 +15,15 @@ class Lexer {
   // The compilation unit.
   shared_ptr<Unit> _unit;
 
-  // A file stream to read input from.
-  unique_ptr<ifstream> _input;
+  // A contiguous input buffer.
+  struct Input {
+    string data;
+    size_t offset = 0; // Exceeds the size once EOF is read
+  };
+
+  // The input stack. The unit file contents is at the bottom;
+  // macro outputs are pushed atop, and read first until exhausted.
+  vector<Input> _inputs;
 
   // A lazily instantiated `Macro` class
   // instance for macro evaluation.
@@ -38,10 +45,6 @@ class Lexer {
   // Location of the next token to be yielded.
   Location _location;
 
-  // Set to `true` when currently reading from code
-  // emitted by a macro, i.e. after macro evaluation.
-  bool _is_reading_from_macro;
-
 public:
   struct Error {
     enum Kind {
@@ -102,6 +105,10 @@ public:
   // Lex the tokens.
   co::generator<shared_ptr<Token::Base>> lex();
 
+  // Return the macro instance, or `nullptr`
+  // if no macro has been met in the unit.
+  Macro *macro();
+
 private:
   // Read the next code point from the input
   // and return the previous one.
@@ -110,6 +117,17 @@ private:
   // updates `_prev_cursor`.
   char _read(bool raise_on_eof = true);
 
+  // Push the macro output onto the input stack, without copying,
+  // and read its first code unit (if any).
+  void _read_macro_output();
+
+  // Read a handle spliced into the macro output,
+  // e.g. `\x1A0\x1A`, and return the handle.
+  shared_ptr<Macro::Handle> _read_splice();
+
+  // Return `true` if EOF of the unit file has been read.
+  bool _is_eof();
+
   // Raise a lexing `Error` with current cursor location.
   void _err(Error::Kind = Error::Unexpected);
 
@@ -142,7 +160,11 @@ private:
   co::generator<shared_ptr<Token::Base>> _lex_numeric_literal();
 
   // Create or return a `_macro` instance.
-  unique_ptr<Macro> _ensure_macro();
+  Macro *_ensure_macro();
+
+  // Set the macro site to a *position* in the unit, unless
+  // continuing an incomplete macro statement.
+  void _set_macro_site(Position position);
 
   // Set the `_location.end` position to
   // `_prev_cursor`; a copy of this object
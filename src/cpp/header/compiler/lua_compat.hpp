@@ -0,0 +1,99 @@
+#pragma once
+
+// The Lua API used by the macro engine, either of Lua 5.3+ or of
+// LuaJIT 2.1 (which implements Lua 5.1 with some 5.2 extensions),
+// selected by the `FNXC_MACRO_LUAJIT` build option. The 5.3 API
+// missing in LuaJIT is shimmed here.
+
+#include <cmath>
+#include <limits>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#ifdef FNXC_MACRO_LUAJIT
+#include <luajit.h>
+#endif
+}
+
+#ifdef FNXC_MACRO_LUAJIT
+#define MACRO_ENGINE LUAJIT_VERSION
+#else
+#define MACRO_ENGINE LUA_RELEASE
+#endif
+
+#if LUA_VERSION_NUM < 502
+#define LUA_OK 0
+#define LUA_LOADED_TABLE "_LOADED"
+
+#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+
+// There is no mode argument in 5.1.
+#define lua_load(L, reader, data, name, mode)                       \
+  lua_loadx(L, reader, data, name, mode)
+
+// There is no strip argument in 5.1.
+#define lua_dump(L, writer, data, strip) lua_dump(L, writer, data)
+
+static inline int lua_absindex(lua_State *L, int index) {
+  return index > 0 || index <= LUA_REGISTRYINDEX
+             ? index
+             : lua_gettop(L) + index + 1;
+}
+
+// Numbers are always floats in 5.1, thus a number with
+// no fraction within the integer range is considered integer.
+static inline int lua_isinteger(lua_State *L, int index) {
+  if (lua_type(L, index) != LUA_TNUMBER)
+    return 0;
+
+  // Casting a non-finite or an out-of-range number is undefined;
+  // the bounds are powers of two, thus exactly representable
+  const auto min =
+      (lua_Number)std::numeric_limits<lua_Integer>::min();
+  auto number = lua_tonumber(L, index);
+
+  return std::isfinite(number) && number >= min && number < -min &&
+         number == (lua_Number)(lua_Integer)number;
+}
+
+// A `pairs` honouring the `__pairs` metamethod, which 5.1 ignores,
+// with the original `pairs` as the upvalue.
+static inline int lua_pairs(lua_State *L) {
+  if (luaL_getmetafield(L, 1, "__pairs")) {
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 3);
+  } else {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, 3);
+  }
+
+  return 3;
+}
+#endif
+
+// Align the standard library of a state with 5.3+, which shall
+// be called after `luaL_openlibs`.
+static inline void lua_opencompat(lua_State *L) {
+#if LUA_VERSION_NUM < 502
+  lua_getglobal(L, "pairs");
+  lua_pushcclosure(L, lua_pairs, 1);
+  lua_setglobal(L, "pairs");
+#else
+  (void)L;
+#endif
+}
+
+// Set the environment of a loaded chunk at *index* to the value
+// on the top of the stack, which is popped. That is the `_ENV`
+// upvalue since 5.2, and the function environment in 5.1.
+static inline void lua_setchunkenv(lua_State *L, int index) {
+#if LUA_VERSION_NUM < 502
+  lua_setfenv(L, index);
+#else
+  lua_setupvalue(L, index, 1);
+#endif
+}
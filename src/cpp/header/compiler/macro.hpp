@@ -1,7 +1,14 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./ast.hpp"
 
 using namespace std;
 
@@ -15,6 +22,9 @@ namespace Compiler {
 //
 // This header file does not define the actual engine
 // used for macro evaluation.
+//
+// Interpreter states are pooled per thread: a destroyed macro
+// resets its state to a pristine snapshot for the next one.
 class Macro {
   // Some sort of interpreter state, e.g. a Lua instance.
   void *_state;
@@ -42,12 +52,132 @@ class Macro {
 
   bool _is_incomplete;
 
+  // Set to true if currently within an explicit emission,
+  // i.e. `{{ }}`, which has not been closed yet.
+  bool _is_explicit_emit;
+
+  // Set to false once a non-idempotent function is called.
+  bool _is_idempotent;
+
+  // Set to false once the evaluated chunk depends on or affects
+  // more than its source and `nx.ctx`, e.g. reads a global set
+  // by a previous chunk or writes `nx.file`. It is reset per chunk.
+  bool _is_pure;
+
+  // Set to false once a chunk changes a global or a library table.
+  // Memoized expansions are then bypassed, as they were evaluated
+  // in a pristine state, thus may read stale values.
+  bool _is_pristine;
+
 public:
-  // The buffered macro code to evaluate.
-  iostream input = iostream(NULL);
+  // A custom `nx.file.cache` macro function, which makes a unit
+  // with non-idempotent macros cacheable. For example:
+  //
+  // ```nx
+  // {%
+  //   nx.file.cache = function (old)
+  //     return os.getenv("BTSIZE")
+  //   end
+  // %}
+  // ```
+  //
+  // On subsequent builds, the function is called with the cached
+  // value prior to parsing the unit; the unit is only invalidated
+  // if the returned value differs.
+  struct CacheFunction {
+    // The dumped function bytecode. Note that upvalues
+    // (other than the global environment) are not preserved.
+    string bytecode;
+
+    // The serialized returned value.
+    string value;
+  };
+
+  // Limits of a single evaluation, guarding a build against
+  // a runaway macro. A zero value means no limit.
+  //
+  // The instruction and duration limits are checked from a count
+  // hook, which LuaJIT does not call from compiled code; thus with
+  // LuaJIT, an evaluation with either limit (or profiled) runs in
+  // the interpreter only. Zero them to keep the JIT compiler on.
+  // The `debug` library is hidden from the macro code (except
+  // for `debug.traceback`), so that the hook can not be removed.
+  struct Limits {
+    // The number of interpreter instructions.
+    uint64_t instructions = 0;
+
+    // The number of bytes the interpreter may
+    // allocate in excess of its usage before evaluation.
+    size_t memory = 256 * 1024 * 1024;
+
+    // The wall-clock duration.
+    chrono::milliseconds duration = chrono::seconds(10);
+  };
+
+  // Cumulative evaluation statistics of an instance.
+  struct Stats {
+    unsigned evaluations = 0;
+    chrono::nanoseconds duration = {};
+
+    // The number of chunks compiled from source,
+    // i.e. not found in the bytecode cache.
+    unsigned compilations = 0;
+
+    // Counted in steps, thus approximate.
+    uint64_t instructions = 0;
+
+    // The maximum number of bytes used by the interpreter.
+    size_t peak_memory = 0;
+  };
+
+  // The limits of every evaluation, e.g. set from the command line.
+  // A limit hit is reported as an evaluation `error`.
+  static Limits limits;
 
-  // The evaluated Onyx code stream.
-  iostream output = iostream(NULL);
+  Stats stats;
+
+  // The location of the macro code being evaluated, e.g.
+  // `/path/to/unit.nx:12:3`, which the profile is attributed to.
+  string site;
+
+  // Return the engine name and version, e.g. `Lua 5.4.6`.
+  static const char *engine();
+
+  // Enable the sampling profiler of macro evaluations.
+  // It shall be called before any evaluation.
+  static void enable_profiler();
+
+  // Write the profile: a *report* of macro sites and Lua functions
+  // sorted by time, and *folded* stacks for flamegraph tools,
+  // weighted by microseconds.
+  static void write_profile(ostream &report, ostream &folded);
+
+  // Onyx code passed to macros by reference rather than as text,
+  // e.g. an argument of a delayed macro call. In Lua, it is
+  // a userdata: `tostring(h)` returns its source, `#h` the number
+  // of tokens and `h[i]` the source of the i-th token. It may be
+  // forwarded as is; emitting it splices its tokens, which are
+  // then yielded by the lexer as is instead of being re-lexed.
+  struct Handle {
+    vector<shared_ptr<Token::Base>> tokens;
+    AST::Node *node = nullptr; // The parsed node, if any
+  };
+
+  // Marks a handle spliced into the `output`, followed by its
+  // index in `spliced` and another marker, e.g. `\x1A0\x1A`.
+  static const char SPLICE = '\x1A';
+
+  // Handles spliced into the `output`.
+  vector<shared_ptr<Handle>> spliced;
+
+  // The buffered macro code to evaluate, kept contiguous
+  // to be compiled at once. It is cleared on evaluation,
+  // unless the code is incomplete.
+  string input;
+
+  // The emitted Onyx code. The `emit` function appends to it
+  // directly; a lexer takes it over without copying.
+  string output;
 
   // Whether the macro statement is not complete.
   // If it's not, an Onyx code within such a statement
@@ -81,6 +211,31 @@ public:
   // For example, quotes (`"`).
   static bool needs_escape(char);
 
+  // Return `true` if no non-idempotent function (e.g. `os.clock`,
+  // `io.read` or `require` of a new module) has been called by
+  // the macro code so far.
+  bool is_idempotent();
+
+  // Set `nx.ctx[name]` to a *handle*, e.g. a macro argument.
+  void set_context(const string &name, shared_ptr<Handle> handle);
+
+  // Call the `nx.file.cache` function, if it is set. Returns
+  // `nullopt` if there is no such function, or if it returns
+  // a value which can not be serialized (e.g. a table).
+  optional<CacheFunction> cache_function();
+
+  // Call a cached *function* with its cached value in a new
+  // interpreter instance. Returns `true` if the returned value
+  // is the same as the cached one, i.e. the unit is still fresh.
+  static bool revalidate(const CacheFunction &function);
+
+  // Memoize an expansion output by its *key*, e.g. loaded from
+  // a build cache. Expansions are shared by all macro instances.
+  static void import_expansion(uint64_t key, string output);
+
+  // Return the expansions memoized since the last export.
+  static vector<pair<uint64_t, string>> export_expansions();
+
   Macro();
   ~Macro();
 
@@ -111,6 +266,28 @@ public:
 
 private:
   void _init();
+
+  // Load the input as a function onto the stack, returning `false`
+  // on a syntax error, with the error message pushed, unless the
+  // input is incomplete. Compiled chunks are cached by the source
+  // *hash*.
+  bool _load(uint64_t hash);
+
+  // Return the memoization key of evaluating the input by the
+  // engine, its source *hash* and the `nx.ctx` contents, or
+  // `nullopt` if the contents are not serializable (e.g.
+  // a function).
+  optional<uint64_t> _expansion_key(uint64_t hash);
+
+  // Return `true` if no global nor library table of the state
+  // has changed since its snapshot.
+  bool _check_pristine();
+
+  // Call a function with *nargs* arguments within the `limits`,
+  // updating `stats`. An error message of a hit limit replaces
+  // the original one.
+  int _pcall(int nargs, int nresults);
+
   void _end_onyx_code();
 };
 } // namespace Compiler
@@ -22,7 +22,7 @@ class Parser {
   shared_ptr<Token::Base> _token;
 
   // This file's AST root.
-  shared_ptr<AST::Node> _AST_root;
+  AST::Node *_AST_root;
 
 public:
   struct Error {
@@ -45,7 +45,7 @@ public:
         const fs::path);
   };
 
-  Parser(Lexer *, shared_ptr<AST::Node> root);
+  Parser(Lexer *, AST::Node *root);
 
   // Parse the file's requires (including imports).
   // By the language standards, requires can only
@@ -53,9 +53,15 @@ public:
   stack<Require> requirements();
 
   // Continue parsing the file.
-  shared_ptr<AST::Node> next();
+  AST::Node *next();
 
-  // shared_ptr<AST::Expression> parse_expression();
+  // Lex the rest of the file into *tokens*, including the latest
+  // lexed token, e.g. to split them into top-level declarations
+  // (see `DeclarationParser`).
+  void tokenize(vector<shared_ptr<Token::Base>> &tokens);
+
+  // Expressions are parsed by `ExpressionParser`, from a buffer of
+  // the tokens lexed up to the expression terminator.
 
 private:
   void _lex();
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "./ast.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+// Classifies changes of a unit between two parses, e.g. to decide
+// between a body-only and a full reload in JIT hot reloading.
+//
+// Declarations are compared by their structural hashes (see
+// `AST::rehash`). A namespace is only descended into if its hash
+// differs, thus unchanged subtrees cost a single comparison.
+//
+// ```
+// auto reload = Reload::classify(previous->sast, unit->sast);
+//
+// if (reload.kind == Reload::Bodies)
+//   for (auto function : reload.changed)
+//     recompile(function);
+// ```
+struct Reload {
+  enum Kind {
+    None,   // No declaration has changed
+    Bodies, // Only function bodies have changed, or functions added
+    Full,   // A prototype has changed, or a declaration removed
+  };
+
+  Kind kind = None;
+
+  // Functions of the current tree which bodies have changed.
+  // Only meaningful unless the kind is `Full`.
+  vector<AST::FunctionDefinition *> changed;
+
+  // Functions of the current tree absent from the previous one,
+  // including those of new namespaces.
+  // Only meaningful unless the kind is `Full`.
+  vector<AST::FunctionDefinition *> added;
+
+  // Classify changes from a *previous* namespace (usually the root)
+  // to the *current* one. Hashes must have been computed.
+  static Reload
+  classify(const AST::Namespace *previous, AST::Namespace *current);
+
+private:
+  void
+  _compare(const AST::Namespace *previous, AST::Namespace *current);
+  void _add(AST::Namespace *);
+};
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <span>
+
+#include "../utils/fnv1a.hpp"
+#include "./ast.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+namespace AST {
+// Structural hashes of declarations are computed bottom-up while
+// parsing: a function's from its prototype and body tokens, and a
+// namespace's from the hashes of its declarations. Comparing the
+// hashes then tells which declarations have changed without
+// diffing trees, e.g. to reload only a changed function body.
+//
+// Prototypes and bodies are hashed as tokens, rather than nodes,
+// as lazy bodies have no nodes, and return restrictions are not
+// represented yet.
+
+// Return a structural hash of *tokens*, ignoring spaces, comments
+// and locations. Consecutive newlines and semicolons are hashed as
+// a single separator, and leading or trailing ones are ignored.
+FNV1a::Hash128 hash(span<const shared_ptr<Token::Base>> tokens);
+
+// Compute the hashes of a function *definition* from the tokens of
+// its *prototype* (including modifiers) and of its *body*.
+void rehash(
+    FunctionDefinition *definition,
+    span<const shared_ptr<Token::Base>> prototype,
+    span<const shared_ptr<Token::Base>> body);
+
+// Compute the hash of a namespace from the already computed hashes
+// of its functions and child namespaces, in order.
+void rehash(Namespace *);
+} // namespace AST
+} // namespace Compiler
+} // namespace Onyx
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <set>
+#include <span>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -17,7 +19,8 @@ struct Base {
   Base(Location loc) : location(loc) {}
   virtual ~Base() {}
 
-  // Return the token as it was in the source file.
+  // Return the token as it was in the source file, or an empty
+  // string if the token does not keep its source.
   virtual string source();
 
   // Return a distinct identifer, e.g. `Control`.
@@ -71,6 +74,9 @@ struct Control : Base {
 
   Control(Location loc, Kind kind) : Base(loc), kind(kind) {}
 
+  string source() override;
+  string type_id() override;
+
   // Used for outputting special symbols, e.g. `"<newline>"`.
   char *debug_source();
 };
@@ -157,6 +163,9 @@ struct Value : Base {
   Value(Location loc, Kind kind, string value) :
       Base(loc), kind(kind), value(value) {}
 
+  string source() override;
+  string type_id() override;
+
   string debug_kind();
   static char *pretty_kind(Kind kind);
 
@@ -193,6 +202,9 @@ struct CharLiteral : Base {
   const Codepoint codepoint;
   CharLiteral(Location, Codepoint);
   string debug_source();
+
+  string source() override;
+  string type_id() override;
 };
 
 // A string literal enabling up to four byte
@@ -206,6 +218,9 @@ struct StringLiteral : Base {
       Base(loc), codepoints(codepoints) {}
 
   string debug_source();
+
+  string source() override;
+  string type_id() override;
 };
 
 struct NumericLiteral : Base {
@@ -255,6 +270,9 @@ struct NumericLiteral : Base {
       exponent(exponent),
       type(type),
       bitsize(bitsize) {}
+
+  string source() override;
+  string type_id() override;
 };
 
 struct PercentLiteral : Base {
@@ -321,6 +339,11 @@ struct PercentLiteral : Base {
       numeric_type(numeric_type),
       numeric_bitsize(numeric_bitsize) {}
 };
+
+// Return `true` if a token at *index* is a part of a comment, i.e.
+// the `Comment` control, or a text or an intrinsic following it.
+// Note that a text is also found in macros.
+bool is_comment(span<const shared_ptr<Base>> tokens, size_t index);
 } // namespace Token
 } // namespace Compiler
 } // namespace Onyx
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "./ast.hpp"
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+namespace AST {
+// A flat, read-only representation of a SAST, with nodes stored as
+// parallel arrays indexed by 32-bit node indices. Nodes are in
+// depth-first order, thus walking the tree mostly reads memory
+// linearly, unlike chasing node pointers.
+//
+// The tree is built from the node-based SAST, and is accessed via
+// lightweight `Handle` wrappers.
+//
+// ```
+// auto tree = AST::Tree(unit->sast);
+//
+// for (auto function : tree.root())
+//   if (function.kind() == AST::Kind::FunctionDefinition)
+//     function.dump(&cout);
+// ```
+//
+// The children and the per-kind data of a node are:
+//
+// * `Root`, `Namespace`, `Module`: functions, namespaces, then
+//   function declarations (`Module` only); the data is the
+//   interned name of a namespace;
+// * `FunctionDefinition`: the prototype and the body (or `Empty`);
+// * `FunctionDeclaration`: the prototype;
+// * `FunctionPrototype`: annotations, then arguments;
+//   the token is the name (modifiers are not represented yet);
+// * `FunctionArgumentDeclaration`: annotations, the restriction
+//   and the default value (or `Empty`); the token is the name, and
+//   the data is `type << 1 | is_const`;
+// * `AnnotationApplication`, `Call`: the caller (`Call` only, or
+//   `Empty`), ordered arguments, then named arguments sorted by
+//   name; the token is the ID or the callee, the data is the
+//   ordered arguments count;
+// * `NamedArgument`: the value; the data is the interned name;
+// * `Body`: expressions;
+// * `Binop`: both operands; `Unop`: the operand; the token is the
+//   operator; `Ternary`: the condition, `then` (`Empty` for Elvis)
+//   and `else`;
+// * `ID`: the token is the value; `Splat`: the token is the ID,
+//   the data is `is_named`.
+class Tree {
+public:
+  using Index = uint32_t;
+
+  // A node of a tree. It is as cheap to copy as an index.
+  class Handle {
+    const Tree *_tree;
+    Index _index;
+
+  public:
+    Handle(const Tree *tree, Index index) :
+        _tree(tree), _index(index) {}
+
+    Index index() const { return _index; }
+    Kind kind() const { return _tree->kinds[_index]; }
+    uint32_t data() const { return _tree->data[_index]; }
+
+    // Return the node token, or `nullptr`.
+    const shared_ptr<Token::Value> &token() const;
+
+    // Return the number of children.
+    size_t size() const { return _tree->child_counts[_index]; }
+
+    // Return the *i*-th child.
+    Handle operator[](size_t i) const {
+      return Handle(
+          _tree, _tree->children[_tree->first_children[_index] + i]);
+    }
+
+    // Iterates the children in order.
+    class Iterator {
+      const Tree *_tree;
+      const Index *_child;
+
+    public:
+      Iterator(const Tree *tree, const Index *child) :
+          _tree(tree), _child(child) {}
+
+      Handle operator*() const { return Handle(_tree, *_child); }
+
+      Iterator &operator++() {
+        _child++;
+        return *this;
+      }
+
+      bool operator!=(const Iterator &other) const {
+        return _child != other._child;
+      }
+    };
+
+    Iterator begin() const {
+      return Iterator(
+          _tree,
+          _tree->children.data() + _tree->first_children[_index]);
+    }
+
+    Iterator end() const {
+      return Iterator(
+          _tree,
+          _tree->children.data() + _tree->first_children[_index] +
+              _tree->child_counts[_index]);
+    }
+
+    // Dump the subtree, a node per line.
+    void dump(ostream *, unsigned short tab = 0) const;
+  };
+
+  // Node arrays, all of the same size.
+  vector<Kind> kinds;
+  vector<Index> tokens; // Indices in `token_table`, if any
+  vector<uint32_t> data;
+  vector<Index> first_children; // Indices in `children`
+  vector<uint32_t> child_counts;
+
+  // Child indices, contiguous per node.
+  vector<Index> children;
+
+  // Tokens referred by nodes. The first one is null.
+  vector<shared_ptr<Token::Value>> token_table;
+
+  // Flatten the SAST from the *root* node.
+  explicit Tree(const Node *root);
+
+  Handle root() const { return Handle(this, 0); }
+
+  // Return the number of nodes.
+  size_t size() const { return kinds.size(); }
+
+private:
+  // Append the nodes of a subtree from *root*, depth-first.
+  void _flatten(const Node *root);
+
+  Index _push(Kind, const shared_ptr<Token::Value> &, uint32_t);
+};
+} // namespace AST
+} // namespace Compiler
+} // namespace Onyx
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <stack>
+#include <vector>
+
+#include "../utils/arena.hpp"
 
 using namespace std;
 
@@ -12,24 +17,28 @@ namespace AST {
 struct Root;
 }
 
-// namespace Token {
-// struct Base;
-// }
+namespace Token {
+struct Base;
+}
 
 // A compilation unit.
 struct Unit {
   enum State { Queued, BeingCompiled, Compiled };
   State state;
 
-  // The SAST root for the unit. It may be empty
-  // if the unit is skipped due to caching etc.
-  shared_ptr<AST::Root> sast;
+  // Owns the unit's SAST nodes, which are freed at once.
+  Arena arena;
+
+  // The SAST root for the unit, set once it is compiled.
+  AST::Root *sast = nullptr;
+
+  // The unit's tokens, including those evaluated from macros.
+  // Lazy function bodies are parsed from them on demand.
+  vector<shared_ptr<Token::Base>> tokens;
 
-  // // The container to store the unit's tokens.
-  // // This includes both tokens from source files and evaluated
-  // from
-  // // macros. Token preservation is needed to properly output them.
-  // stack<shared_ptr<Token::Base>> tokens;
+  // Guards `arena` once the unit is parsed, as lazy bodies
+  // may be parsed by multiple threads.
+  mutex bodies_mutex;
 
   // An absolute file path.
   const filesystem::path path;
@@ -37,8 +46,11 @@ struct Unit {
   const bool is_import;
   const shared_ptr<Unit> parent;
 
-  Unit(bool is_import, filesystem::path, shared_ptr<Unit> parent) :
-      is_import(is_import), parent(parent) {}
+  Unit(
+      bool is_import,
+      filesystem::path path,
+      shared_ptr<Unit> parent) :
+      path(path), is_import(is_import), parent(parent) {}
 
   // filesystem::path relative_path(filesystem::path root);
 };
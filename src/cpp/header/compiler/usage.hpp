@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace Onyx {
+namespace Compiler {
+struct Unit;
+
+// Declarations a compilation unit exports and consumes.
+//
+// It allows to invalidate only those requiring units which
+// consume a declaration whose signature has actually changed,
+// instead of every transitive requirer. For example, changing
+// a function body does not change its signature, thus does not
+// invalidate its callers.
+struct Usage {
+  // Exported declaration names mapped to their signature hashes.
+  // Overloads of the same name share a single entry.
+  unordered_map<string, uint64_t> exports;
+
+  // Names of consumed declarations.
+  unordered_set<string> consumptions;
+
+  // Collect the usage from a *unit* SAST. Lazy function bodies
+  // are not parsed: every ID of their tokens is deemed consumed,
+  // which may only invalidate more units than necessary.
+  static Usage collect(const Unit &unit);
+};
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "./ast.hpp"
+
+namespace Onyx {
+namespace Compiler {
+namespace AST {
+// A SAST walker dispatching on node kinds, without RTTI casts or
+// virtual calls. A pass derives from it (CRTP), overriding handlers
+// of the kinds it is interested in. A handler is called upon
+// entering a node, and returns whether to visit its children, which
+// are then visited in source order, followed by `leave`.
+//
+// The walk is iterative: pending nodes are kept on an explicit
+// stack, so that a deep tree (e.g. of a long operator chain) may
+// not overflow the native stack.
+//
+// ```
+// struct Counter : AST::Visitor<Counter> {
+//   size_t calls = 0;
+//
+//   bool visit_call(AST::Call *) {
+//     calls++;
+//     return true; // Nested calls
+//   }
+// };
+//
+// Counter counter;
+// counter.visit(unit->sast);
+// ```
+template <class Derived> class Visitor {
+  Derived &self() { return *static_cast<Derived *>(this); }
+
+  // A pending step of a walk.
+  struct Step {
+    enum { Enter, Leave, EnterNamed, LeaveNamed } kind;
+    Node *node;
+    const NamedArgument *named = nullptr;
+  };
+
+public:
+  // Visit a *node*, if any, and its descendants.
+  void visit(Node *node) {
+    vector<Step> steps = {{Step::Enter, node}};
+
+    while (!steps.empty()) {
+      auto step = steps.back();
+      steps.pop_back();
+
+      switch (step.kind) {
+      case Step::Enter:
+        if (self().enter(step.node)) {
+          steps.push_back({Step::Leave, step.node});
+
+          // Children are popped in source order
+          auto first = steps.size();
+          _children(step.node, steps);
+          reverse(steps.begin() + first, steps.end());
+        }
+
+        break;
+
+      case Step::Leave:
+        self().leave(step.node);
+        break;
+
+      case Step::EnterNamed:
+        if (self().enter_named(*step.named)) {
+          steps.push_back({Step::LeaveNamed, nullptr, step.named});
+          steps.push_back({Step::Enter, step.named->value});
+        }
+
+        break;
+
+      case Step::LeaveNamed:
+        self().leave_named(*step.named);
+        break;
+      }
+    }
+  }
+
+  // Called upon entering a *node*, which is `nullptr` for a missing
+  // optional child. Returns whether to visit its children; by
+  // default, the handler of the node kind decides.
+  bool enter(Node *node) {
+    if (!node)
+      return false;
+
+    switch (node->kind) {
+    case Kind::Root:
+      return self().visit_root(static_cast<Root *>(node));
+    case Kind::Namespace:
+      return self().visit_namespace(static_cast<Namespace *>(node));
+    case Kind::Module:
+      return self().visit_module(static_cast<Module *>(node));
+    case Kind::Enum:
+      return self().visit_enum(static_cast<Enum *>(node));
+    case Kind::Annotation:
+      return self().visit_annotation(
+          static_cast<Annotation *>(node));
+    case Kind::FunctionDefinition:
+      return self().visit_function_definition(
+          static_cast<FunctionDefinition *>(node));
+    case Kind::FunctionDeclaration:
+      return self().visit_function_declaration(
+          static_cast<FunctionDeclaration *>(node));
+    case Kind::FunctionPrototype:
+      return self().visit_function_prototype(
+          static_cast<FunctionPrototype *>(node));
+    case Kind::FunctionArgumentDeclaration:
+      return self().visit_function_argument_declaration(
+          static_cast<FunctionArgumentDeclaration *>(node));
+    case Kind::AnnotationApplication:
+      return self().visit_annotation_application(
+          static_cast<AnnotationApplication *>(node));
+    case Kind::Body:
+      return self().visit_body(static_cast<Body *>(node));
+    case Kind::ID:
+      return self().visit_id(static_cast<ID *>(node));
+    case Kind::Splat:
+      return self().visit_splat(static_cast<Splat *>(node));
+    case Kind::Binop:
+      return self().visit_binop(static_cast<Binop *>(node));
+    case Kind::Unop:
+      return self().visit_unop(static_cast<Unop *>(node));
+    case Kind::Ternary:
+      return self().visit_ternary(static_cast<Ternary *>(node));
+    case Kind::Call:
+      return self().visit_call(static_cast<Call *>(node));
+    case Kind::Literal:
+      return self().visit_literal(static_cast<Literal *>(node));
+    default:
+      throw "BUG! Unexpected SAST node kind to visit";
+    }
+  }
+
+  // Called after the children of an entered *node* are visited.
+  void leave(Node *) {}
+
+  // Same as `enter` and `leave`, but around the value
+  // of a named argument. Named arguments are sorted by name.
+  bool enter_named(const NamedArgument &) { return true; }
+  void leave_named(const NamedArgument &) {}
+
+  bool visit_root(Root *) { return true; }
+  bool visit_namespace(Namespace *) { return true; }
+  bool visit_module(Module *) { return true; }
+  bool visit_enum(Enum *) { return true; }
+  bool visit_annotation(Annotation *) { return true; }
+
+  bool visit_function_definition(FunctionDefinition *) {
+    return true;
+  }
+
+  bool visit_function_declaration(FunctionDeclaration *) {
+    return true;
+  }
+
+  bool visit_function_prototype(FunctionPrototype *) { return true; }
+
+  bool visit_function_argument_declaration(
+      FunctionArgumentDeclaration *) {
+    return true;
+  }
+
+  bool visit_annotation_application(AnnotationApplication *) {
+    return true;
+  }
+
+  bool visit_body(Body *) { return true; }
+  bool visit_id(ID *) { return true; }
+  bool visit_splat(Splat *) { return true; }
+  bool visit_binop(Binop *) { return true; }
+  bool visit_unop(Unop *) { return true; }
+  bool visit_ternary(Ternary *) { return true; }
+  bool visit_call(Call *) { return true; }
+  bool visit_literal(Literal *) { return true; }
+
+private:
+  // Push steps entering the children of a *node*, in source order.
+  static void _children(Node *node, vector<Step> &steps) {
+    auto enter = [&](Node *child) {
+      steps.push_back({Step::Enter, child});
+    };
+
+    auto arguments = [&](Arguments &args) {
+      for (auto arg : args.ordered_arguments)
+        enter(arg);
+
+      for (auto arg : args.sorted_named())
+        steps.push_back({Step::EnterNamed, nullptr, arg});
+    };
+
+    switch (node->kind) {
+    case Kind::Root:
+    case Kind::Namespace:
+    case Kind::Module: {
+      auto ns = static_cast<Namespace *>(node);
+
+      for (auto function : ns->functions)
+        enter(function);
+
+      for (auto child : ns->namespaces)
+        enter(child);
+
+      if (node->kind == Kind::Module)
+        for (auto declaration :
+             static_cast<Module *>(node)->function_declarations)
+          enter(declaration);
+
+      break;
+    }
+
+    case Kind::FunctionDefinition: {
+      auto function = static_cast<FunctionDefinition *>(node);
+      enter(function->prototype);
+      enter(function->body);
+      break;
+    }
+
+    case Kind::FunctionDeclaration:
+      enter(static_cast<FunctionDeclaration *>(node)->prototype);
+      break;
+
+    case Kind::FunctionPrototype: {
+      auto proto = static_cast<FunctionPrototype *>(node);
+
+      for (auto annotation : proto->annotations)
+        enter(annotation);
+
+      for (auto arg : proto->args)
+        enter(arg);
+
+      break;
+    }
+
+    case Kind::FunctionArgumentDeclaration: {
+      auto arg = static_cast<FunctionArgumentDeclaration *>(node);
+
+      for (auto annotation : arg->annotations)
+        enter(annotation);
+
+      enter(arg->restriction);
+      enter(arg->default_value);
+
+      break;
+    }
+
+    case Kind::AnnotationApplication:
+      arguments(static_cast<AnnotationApplication *>(node)->args);
+      break;
+
+    case Kind::Body:
+      for (auto expr : static_cast<Body *>(node)->expressions)
+        enter(expr);
+
+      break;
+
+    case Kind::Binop: {
+      auto binop = static_cast<Binop *>(node);
+      enter(binop->lhx);
+      enter(binop->rhx);
+      break;
+    }
+
+    case Kind::Unop:
+      enter(static_cast<Unop *>(node)->expr);
+      break;
+
+    case Kind::Ternary: {
+      auto ternary = static_cast<Ternary *>(node);
+      enter(ternary->cond);
+      enter(ternary->then);
+      enter(ternary->else_);
+      break;
+    }
+
+    case Kind::Call: {
+      auto call = static_cast<Call *>(node);
+      enter(call->caller);
+      arguments(call->args);
+      break;
+    }
+
+    default: // Leaves
+      break;
+    }
+  }
+};
+} // namespace AST
+} // namespace Compiler
+} // namespace Onyx
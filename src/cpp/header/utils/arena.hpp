@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A size-class arena allocator. Small blocks are carved from
+// large chunks and recycled through per-class free lists; larger
+// blocks are allocated individually. All blocks are freed at once
+// by `reset` or on destruction, without freeing each of them.
+//
+// Unlike `malloc`, an arena never contends with other threads,
+// as it is not thread-safe: it is meant to be owned by a thread.
+//
+// ```
+// Arena arena;
+// auto a = arena.allocate(24);
+// a = arena.reallocate(a, 24, 1000);
+// arena.free(a, 1000);
+// arena.reset(); // Would free `a` anyway
+//
+// auto node = arena.make<Node>(); // Destroyed on reset
+// ```
+class Arena {
+public:
+  // Blocks are aligned to that many bytes.
+  static const size_t ALIGNMENT = 16;
+
+  // Larger blocks are allocated individually.
+  static const size_t MAX_SMALL_SIZE = 512;
+
+  // Small blocks are carved from chunks of that size.
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+  Arena();
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Allocate a block of *size* bytes.
+  // Returns `nullptr` on failure.
+  void *allocate(size_t size);
+
+  // Resize a block, which must have been allocated (or resized) with
+  // *old_size*. Returns `nullptr` on failure, keeping the block.
+  void *reallocate(void *block, size_t old_size, size_t new_size);
+
+  // Free a block of *size* bytes to be reused by the arena.
+  void free(void *block, size_t size);
+
+  // Construct a *T* in the arena. Unless trivially destructible,
+  // it is destroyed by `reset` or on destruction, in reverse order
+  // of construction. Throws `std::bad_alloc` on failure.
+  template <class T, class... Args> T *make(Args &&...args) {
+    static_assert(alignof(T) <= ALIGNMENT);
+
+    auto block = allocate(sizeof(T));
+
+    if (!block)
+      throw std::bad_alloc();
+
+    auto object = new (block) T(std::forward<Args>(args)...);
+
+    if constexpr (!std::is_trivially_destructible_v<T>)
+      _destructors.push_back(
+          {object, [](void *object) { ((T *)object)->~T(); }});
+
+    return object;
+  }
+
+  // Destroy the made objects and free all blocks at once.
+  // A few chunks are retained for reuse.
+  void reset();
+
+  // Take over the blocks and made objects of *other*, leaving it
+  // empty. It allows to fill arenas by multiple threads, owning
+  // the results by a single one then.
+  void adopt(Arena &other);
+
+  // Return the number of bytes allocated from the system.
+  size_t reserved() const;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  // Prepended to a large block, linking all of them.
+  struct alignas(ALIGNMENT) LargeHeader {
+    LargeHeader *prev;
+    LargeHeader *next;
+    size_t size;
+  };
+
+  static const size_t CLASS_COUNT = MAX_SMALL_SIZE / ALIGNMENT;
+
+  // Objects made by `make` to destroy, in order of construction.
+  std::vector<std::pair<void *, void (*)(void *)>> _destructors;
+
+  FreeBlock *_free[CLASS_COUNT];
+  LargeHeader *_large;
+  size_t _large_size;
+
+  std::vector<char *> _chunks;
+  size_t _chunk; // The index of the current chunk
+  char *_cursor;
+  char *_end;
+
+  // Advance to the next chunk, allocating it if needed.
+  bool _next_chunk();
+
+  void *_allocate_large(size_t size);
+  void _free_large(void *block);
+};
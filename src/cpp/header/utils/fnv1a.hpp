@@ -1,9 +1,32 @@
+#pragma once
+
 #include <cstdint>
 #include <string>
 
 namespace FNV1a {
+// A 128-bit hash, e.g. to identify a structure
+// with negligible probability of collisions.
+struct Hash128 {
+  uint64_t high;
+  uint64_t low;
+
+  bool operator==(const Hash128 &) const = default;
+};
+
 uint32_t hash32(const void *, const uint32_t length);
 uint64_t hash64(const void *, const uint64_t length);
 uint32_t hash32(const std::string);
 uint64_t hash64(const std::string);
+
+// Continue hashing from a previously returned *hash*,
+// so that an input may be hashed in chunks.
+//
+// ```
+// auto hash = FNV1a::hash64("hel", 3);
+// CHECK(FNV1a::hash64("lo", 2, hash) == FNV1a::hash64("hello", 5));
+// ```
+uint64_t hash64(const void *, const uint64_t length, uint64_t hash);
+
+Hash128 hash128(const void *, const uint64_t length);
+Hash128 hash128(const void *, const uint64_t length, Hash128 hash);
 } // namespace FNV1a
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Maps strings to dense 32-bit ids, so that they are stored and
+// compared as integers. A string is stored once, and its id is
+// stable for the interner lifetime. It is thread-safe.
+//
+// Ids depend on the order of interning; they shall not be used
+// where a deterministic order is required, e.g. in hashes.
+//
+// ```
+// auto id = Interner::global().intern("foo");
+// assert(Interner::global().lookup(id) == "foo");
+// ```
+class Interner {
+public:
+  using Id = uint32_t;
+
+  // Return the id of a *string*, interning it if needed.
+  Id intern(std::string_view string);
+
+  // Return the string of an interned *id*, which stays valid
+  // for the interner lifetime.
+  std::string_view lookup(Id id) const;
+
+  // Return the number of interned strings.
+  size_t size() const;
+
+  // The interner shared by the whole process,
+  // e.g. for names in the SAST of all units.
+  static Interner &global();
+
+private:
+  // A deque never moves its elements, thus views stay valid.
+  std::deque<std::string> _strings;
+  std::unordered_map<std::string_view, Id> _ids;
+
+  mutable std::shared_mutex _mutex;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+
+// A contiguous sequence with inline storage for the first *N*
+// elements, which only allocates on the heap once outgrown. Elements
+// must be trivially copyable (e.g. pointers or ids), thus they are
+// moved around with `memcpy`.
+//
+// ```
+// SmallVector<Node *> children; // No allocation
+// children.push_back(node);
+// ```
+template <class T, size_t N = 4> class SmallVector {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  T *_data;
+  size_t _size;
+  size_t _capacity;
+  alignas(T) unsigned char _inline[N * sizeof(T)];
+
+public:
+  using value_type = T;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() : _data((T *)_inline), _size(0), _capacity(N) {}
+
+  SmallVector(std::initializer_list<T> list) : SmallVector() {
+    for (auto &value : list)
+      push_back(value);
+  }
+
+  SmallVector(const SmallVector &other) : SmallVector() {
+    *this = other;
+  }
+
+  SmallVector(SmallVector &&other) noexcept : SmallVector() {
+    *this = static_cast<SmallVector &&>(other);
+  }
+
+  ~SmallVector() {
+    if (!is_inline())
+      ::operator delete(_data);
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other) {
+      _size = 0;
+      reserve(other._size);
+      std::memcpy(_data, other._data, other._size * sizeof(T));
+      _size = other._size;
+    }
+
+    return *this;
+  }
+
+  // A heap buffer is taken over, inline elements are copied.
+  SmallVector &operator=(SmallVector &&other) noexcept {
+    if (this == &other)
+      return *this;
+
+    if (!is_inline())
+      ::operator delete(_data);
+
+    if (other.is_inline()) {
+      _data = (T *)_inline;
+      _capacity = N;
+      std::memcpy(_data, other._data, other._size * sizeof(T));
+    } else {
+      _data = other._data;
+      _capacity = other._capacity;
+
+      other._data = (T *)other._inline;
+      other._capacity = N;
+    }
+
+    _size = other._size;
+    other._size = 0;
+
+    return *this;
+  }
+
+  // Return `true` if the elements are stored inline.
+  bool is_inline() const { return _data == (T *)_inline; }
+
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return !_size; }
+
+  T *data() { return _data; }
+  const T *data() const { return _data; }
+
+  iterator begin() { return _data; }
+  iterator end() { return _data + _size; }
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+
+  T &operator[](size_t index) { return _data[index]; }
+  const T &operator[](size_t index) const { return _data[index]; }
+
+  T &back() { return _data[_size - 1]; }
+  const T &back() const { return _data[_size - 1]; }
+
+  // Ensure the capacity for *capacity* elements.
+  // Throws `std::bad_alloc` on failure.
+  void reserve(size_t capacity) {
+    if (capacity <= _capacity)
+      return;
+
+    auto data = (T *)::operator new(capacity * sizeof(T));
+    std::memcpy(data, _data, _size * sizeof(T));
+
+    if (!is_inline())
+      ::operator delete(_data);
+
+    _data = data;
+    _capacity = capacity;
+  }
+
+  void push_back(const T &value) {
+    if (_size == _capacity) {
+      // The value may be an element of this vector
+      T copy = value;
+      reserve(_capacity * 2);
+      _data[_size++] = copy;
+    } else
+      _data[_size++] = value;
+  }
+
+  // Insert a *value* before *position*, shifting the rest.
+  iterator insert(const_iterator position, const T &value) {
+    const size_t index = position - _data;
+    T copy = value;
+
+    if (_size == _capacity)
+      reserve(_capacity * 2);
+
+    std::memmove(
+        _data + index + 1,
+        _data + index,
+        (_size - index) * sizeof(T));
+
+    _data[index] = copy;
+    _size++;
+
+    return _data + index;
+  }
+
+  void pop_back() { _size--; }
+
+  // Remove the elements, keeping the capacity.
+  void clear() { _size = 0; }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+// A queue of tasks, each run by any of the threads working on the
+// queue. A thread joining tasks runs queued ones meanwhile rather
+// than blocking, thus tasks may push and join tasks themselves.
+// It is thread-safe.
+//
+// ```
+// TaskQueue queue;
+// vector<int> results(2);
+//
+// auto a = queue.push([&]() { results[0] = 1; });
+// auto b = queue.push([&]() { results[1] = 2; });
+//
+// // Possibly run by other threads calling `pop` and `run`
+// queue.join({a, b});
+// ```
+class TaskQueue {
+public:
+  struct Task {
+    std::function<void()> run;
+    bool is_done = false;
+    std::exception_ptr exception; // Thrown by `run`, if any
+  };
+
+  // The *notify* function is called on every push, after the queue
+  // is unlocked, e.g. to wake threads waiting for other work.
+  TaskQueue(std::function<void()> notify = nullptr);
+
+  // Enqueue a task.
+  std::shared_ptr<Task> push(std::function<void()> run);
+
+  // Dequeue a task in order of pushing; `nullptr` if empty.
+  std::shared_ptr<Task> pop();
+
+  // Run a popped *task*, storing its exception, if any.
+  void run(std::shared_ptr<Task> task);
+
+  // Wait for the *tasks* to be done, running queued tasks meanwhile.
+  // Rethrows the exception of the first failed task, in order.
+  void join(const std::vector<std::shared_ptr<Task>> &tasks);
+
+private:
+  std::queue<std::shared_ptr<Task>> _tasks;
+  std::function<void()> _notify;
+
+  std::mutex _mutex;
+  std::condition_variable _condvar;
+};
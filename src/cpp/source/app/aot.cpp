@@ -5,21 +5,104 @@
 
 namespace Onyx {
 namespace App {
+// Return a description of the host, which is the only target yet,
+// e.g. `x86_64-linux-gnu-lp64-le`: the ISA, the operating system,
+// the C environment, the data model and the byte order.
+static string host_target() {
+  string isa =
+#if defined(__x86_64__) || defined(_M_X64)
+      "x86_64";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+      "aarch64";
+#elif defined(__arm__) || defined(_M_ARM)
+      "arm";
+#elif defined(__i386__) || defined(_M_IX86)
+      "i386";
+#elif defined(__riscv)
+      "riscv" + to_string(__riscv_xlen);
+#else
+      "unknown";
+#endif
+
+  string os =
+#if defined(_WIN32)
+      "windows";
+#elif defined(__APPLE__)
+      "darwin";
+#elif defined(__linux__)
+      "linux";
+#elif defined(__FreeBSD__)
+      "freebsd";
+#else
+      "unknown";
+#endif
+
+  string environment =
+#if defined(_MSC_VER)
+      "msvc";
+#elif defined(__MINGW32__)
+      "mingw";
+#elif defined(__ANDROID__)
+      "android";
+#elif defined(__GLIBC__)
+      "gnu";
+#else
+      "none";
+#endif
+
+  string model = sizeof(void *) == 8
+                     ? (sizeof(long) == 8 ? "lp64" : "llp64")
+                     : "ilp32";
+
+  string order =
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      "be";
+#else
+      "le";
+#endif
+
+  return isa + "-" + os + "-" + environment + "-" + model + "-" +
+         order;
+}
+
 AOT::AOT(
     // filesystem::path root,
     filesystem::path input,
     filesystem::path output,
     bool lib,
-    unsigned short workers) :
+    unsigned short workers,
+    optional<filesystem::path> cache_dir,
+    Shared::Compression::Codec cache_codec,
+    optional<uintmax_t> cache_max_size,
+    optional<string> remote_cache) :
     _entry(make_shared<Compiler::Unit>(
         Compiler::Unit(false, input, nullptr))),
     _output(output),
     _is_lib(lib),
-    _workers(workers) {
+    _workers(workers),
+    _cache_max_size(cache_max_size) {
   // _root = root;
+
+  if (cache_dir) {
+    const auto target = host_target();
+    ldebug() << "[AOT] Caching for target " << target;
+
+    _cache = make_shared<Shared::Cache>(
+        cache_dir.value(),
+        Shared::Cache::target_hash(target),
+        workers,
+        cache_codec,
+        remote_cache ? Shared::Remote::open(remote_cache.value())
+                     : nullptr);
+  }
 }
 
 void AOT::compile() {
+  if (_cache) {
+    _cache->validate();
+    _cache->prefetch();
+  }
+
   enqueue(_entry);
 
   vector<thread> workers;
@@ -47,6 +130,15 @@ void AOT::compile() {
     throw _panic.value();
   } else
     ltrace() << "The BC compiler did not panic";
+
+  if (_cache) {
+    _cache->flush();
+
+    _cache->train();
+
+    if (_cache_max_size)
+      _cache->gc(_cache_max_size.value());
+  }
 }
 } // namespace App
 } // namespace Onyx
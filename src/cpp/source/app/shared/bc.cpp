@@ -1,6 +1,11 @@
 #include "../../../header/app/shared/bc.hpp"
+#include "../../../header/compiler/bytecode.hpp"
+#include "../../../header/compiler/declaration_parser.hpp"
 #include "../../../header/compiler/parser.hpp"
+#include "../../../header/compiler/structural_hash.hpp"
+#include "../../../header/compiler/usage.hpp"
 #include "../../../header/utils/log.hpp"
+#include <chrono>
 #include <fstream>
 #include <sstream>
 
@@ -29,7 +34,10 @@ void BC::work() {
       break;
     }
 
-    if (_queued.size() > 0) {
+    if (const auto task = _tasks.pop()) {
+      lock.unlock();
+      _tasks.run(task);
+    } else if (_queued.size() > 0) {
       ltrace() << "[BC::work] Popping an enqueued unit";
       const auto unit = _queued.top();
       _queued.pop();
@@ -75,13 +83,83 @@ void BC::work() {
   ldebug() << "[BC::work] The work is done";
 }
 
+shared_ptr<BC::Task> BC::async(function<void()> run) {
+  return _tasks.push(move(run));
+}
+
+void BC::join(const vector<shared_ptr<Task>> &tasks) {
+  ltrace() << "[BC::join] Waiting for " << tasks.size()
+           << " tasks";
+
+  // Helps the workers rather than block
+  _tasks.join(tasks);
+}
+
+void BC::expand(const string &code, vector<Expansion> &expansions) {
+  vector<shared_ptr<Task>> tasks;
+
+  for (auto &expansion : expansions)
+    tasks.push_back(async([&code, &expansion]() {
+      // Constructed by the running thread,
+      // thus taking a state from its pool
+      Compiler::Macro macro;
+
+      for (auto &[name, handle] : expansion.context)
+        macro.set_context(name, handle);
+
+      macro.input = code;
+      macro.eval();
+
+      expansion.output = move(macro.output);
+      expansion.spliced = move(macro.spliced);
+      expansion.error = macro.error;
+    }));
+
+  join(tasks);
+}
+
 void BC::_compile(shared_ptr<Compiler::Unit> unit) {
+  // A fresh unit is not read at all: its requirements are
+  // taken from the cache index, and its SAST from the entry
+  if (_cache && _cache->is_fresh(unit->path)) {
+    ldebug() << "[BC] " << unit->path << " is fresh, skipping";
+    vector<shared_ptr<Compiler::Unit>> to_compile;
+
+    for (auto req : _cache->requirements(unit->path))
+      to_compile.push_back(make_shared<Compiler::Unit>(
+          req.is_import, req.path, unit));
+
+    if (!to_compile.empty())
+      _wait(to_compile);
+
+    // A recompiled requirement may have changed
+    // a declaration consumed by this unit
+    if (!_cache->is_fresh(unit->path))
+      ldebug() << "[BC] " << unit->path
+               << " consumes a changed declaration, recompiling";
+    else if (auto data = _cache->load(unit->path)) {
+      unit->sast = Compiler::Bytecode::decode(data.value(), unit);
+
+      if (unit->sast) {
+        _complete(unit);
+        return;
+      }
+
+      lwarn() << "[BC] " << unit->path
+              << " cache entry is malformed, recompiling";
+    } else
+      ldebug() << "[BC] " << unit->path
+               << " cache entry is missing, recompiling";
+  }
+
+  unit->sast = unit->arena.make<Compiler::AST::Root>();
   auto lexer = Compiler::Lexer(unit);
-  auto parser = Compiler::Parser(&lexer);
+  auto parser = Compiler::Parser(&lexer, unit->sast);
 
   try {
     ltrace() << "[BC] Parsing the unit requirements";
     auto reqs = parser.requirements();
+    vector<Cache::Require> requirements;
 
     if (!reqs.empty()) {
       ltrace() << "[BC] Have " << reqs.size() << " requirements";
@@ -102,6 +180,8 @@ void BC::_compile(shared_ptr<Compiler::Unit> unit) {
 
         to_compile.push_back(make_shared<Compiler::Unit>(
             req.is_import, absolute_path, unit));
+
+        requirements.push_back({absolute_path, req.is_import});
       }
 
       if (!to_compile.empty())
@@ -110,28 +190,57 @@ void BC::_compile(shared_ptr<Compiler::Unit> unit) {
         ltrace() << "[BC] No units to wait for compilation";
     }
 
-    while (true) {
-      ltrace() << "[BC] Parsing next node";
+    parser.tokenize(unit->tokens);
+    Compiler::DeclarationParser::parse_unit(*unit, _tasks);
 
-      if (!parser.next()) {
-        ltrace()
-            << "[BC] Parser returned nullptr, breaking the loop";
-        break;
-      }
+    if (auto macro = lexer.macro()) {
+      auto &stats = macro->stats;
+
+      ldebug() << "[BC] Evaluated " << stats.evaluations
+               << " macros of " << unit->path << " in "
+               << chrono::duration_cast<chrono::milliseconds>(
+                      stats.duration)
+                      .count()
+               << "ms, ~" << stats.instructions << " instructions, "
+               << stats.peak_memory << " bytes peak";
     }
 
-    ltrace() << "[BC] Acquiring an after-compilation lock... ";
-    lock_guard<mutex> lock(_mutex);
-    ltrace() << "[BC] Acquired an after-compilation lock";
+    if (_cache) {
+      bool is_idempotent = true;
+      optional<Compiler::Macro::CacheFunction> cache_function;
+
+      // A unit calling non-idempotent macro functions
+      // is only cacheable with `nx.file.cache` set
+      if (auto macro = lexer.macro()) {
+        is_idempotent = macro->is_idempotent();
 
-    ldebug() << "[BC] Successfully compiled " << unit->path;
-    unit->state = Compiler::Unit::Compiled;
+        if (!is_idempotent)
+          cache_function = macro->cache_function();
+      }
+
+      _cache->update(
+          unit->path,
+          requirements,
+          Compiler::Usage::collect(*unit),
+          is_idempotent,
+          cache_function);
+
+      if (is_idempotent || cache_function)
+        _cache->store(
+            unit->path, Compiler::Bytecode::encode(*unit));
+    }
 
-    _condvar.notify_all();
+    _complete(unit);
   } catch (Compiler::Lexer::Error err) {
     throw Error(Location(path, err.location), err.message);
+  } catch (Compiler::Lexer::MacroError err) {
+    throw Error(Location(path, err.position), err.message);
   } catch (Compiler::Parser::Error err) {
     throw Error(Location(path, err.token->location), err.reason);
+  } catch (Compiler::DeclarationParser::Error err) {
+    throw Error(Location(path, err.token->location), err.reason);
+  } catch (Compiler::BodyParser::Error err) {
+    throw Error(Location(path, err.token->location), err.reason);
   } catch (Error err) {
     // TODO: Exact position of the require path in current file
     const auto back =
@@ -141,6 +250,17 @@ void BC::_compile(shared_ptr<Compiler::Unit> unit) {
   }
 }
 
+void BC::_complete(shared_ptr<Compiler::Unit> unit) {
+  ltrace() << "[BC] Acquiring an after-compilation lock... ";
+  lock_guard<mutex> lock(_mutex);
+  ltrace() << "[BC] Acquired an after-compilation lock";
+
+  ldebug() << "[BC] Successfully compiled " << unit->path;
+  unit->state = Compiler::Unit::Compiled;
+
+  _condvar.notify_all();
+}
+
 void BC::_wait(const vector<shared_ptr<Compiler::Unit>> units) {
   auto size = units.size();
 
@@ -172,7 +292,10 @@ void BC::_wait(const vector<shared_ptr<Compiler::Unit>> units) {
         ltrace() << "[BC] Done waiting for " << unit->path;
         break;
       } else {
-        if (_queued.size() > 0) {
+        if (const auto task = _tasks.pop()) {
+          lock.unlock();
+          _tasks.run(task);
+        } else if (_queued.size() > 0) {
           ltrace() << "[BC] Popping an enqueued unit while waiting";
           const auto next_unit = _queued.top();
           _queued.pop();
@@ -0,0 +1,1434 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+
+#include "SQLiteCpp/Database.h"
+#include "SQLiteCpp/Statement.h"
+#include "SQLiteCpp/Transaction.h"
+
+#include "../../../header/app/shared/cache.hpp"
+#include "../../../header/utils/fnv1a.hpp"
+#include "../../../header/utils/log.hpp"
+
+// Set by the build to the project version.
+#ifndef FNXC_VERSION
+#define FNXC_VERSION "unknown"
+#endif
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+// The chunk size to read a file with when hashing.
+static const size_t HASH_CHUNK_SIZE = 64 * 1024;
+
+// Bump it on every schema change. An index with
+// a different version is dropped and recreated.
+static const int SCHEMA_VERSION = 6;
+
+// The number of pending changes triggering a flush.
+static const size_t FLUSH_THRESHOLD = 256;
+
+// How long to wait for another process to release the database.
+static const int BUSY_TIMEOUT_MS = 10000;
+
+// How long a reader lease lasts. A lease of a crashed
+// reader thus does not block eviction forever.
+static const int64_t LEASE_DURATION_S = 600;
+
+// Temporary files older than that are considered abandoned.
+static const auto ABANDONED_AGE = chrono::hours(1);
+
+static const char *ENTRY_EXTENSION = ".nxbc";
+static const char *DICTIONARY_EXTENSION = ".zdict";
+
+// Zstd recommends a dictionary of about 100 KiB,
+// trained from about a hundred times more samples.
+static const size_t DICTIONARY_CAPACITY = 112 * 1024;
+static const size_t SAMPLES_MAX_SIZE = 100 * DICTIONARY_CAPACITY;
+static const size_t SAMPLES_MIN_COUNT = 32;
+
+// The number of most recent macro expansions kept by `gc`.
+static const int64_t EXPANSIONS_MAX_COUNT = 65536;
+
+// Return current UNIX time in seconds.
+static int64_t now() {
+  using namespace chrono;
+  return duration_cast<seconds>(system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Return a hex-encoded 64-bit *value*.
+static string to_hex(uint64_t value) {
+  stringstream ss;
+  ss << hex << setfill('0') << setw(16) << value;
+  return ss.str();
+}
+
+// The remote key of a dictionary.
+static string dictionary_key(uint32_t id) {
+  return "zdict-" + to_hex(id);
+}
+
+static string random_token() {
+  random_device device;
+  return to_hex((uint64_t(device()) << 32) | device());
+}
+
+// Remove leftover temporary files of all targets at *root*.
+static void
+sweep(SQLite::Database &db, const filesystem::path &root) {
+  const auto threshold =
+      filesystem::file_time_type::clock::now() - ABANDONED_AGE;
+
+  // Entries of all targets, by their file paths
+  unordered_set<string> indexed;
+
+  SQLite::Statement entries(db, "SELECT target, key FROM entries");
+
+  while (entries.executeStep())
+    indexed.insert(
+        (root / entries.getColumn(0).getString() /
+         (entries.getColumn(1).getString() + ENTRY_EXTENSION))
+            .string());
+
+  error_code ec;
+
+  for (auto &target : filesystem::directory_iterator(root, ec)) {
+    if (!target.is_directory())
+      continue;
+
+    for (auto &file : filesystem::directory_iterator(target, ec)) {
+      auto ext = file.path().extension();
+
+      // A trash file is only left by a crashed `gc`, while
+      // a temporary file may be being written right now,
+      // and an unindexed entry may be flushed soon
+      if (ext == ".trash" ||
+          ((ext == ".tmp" ||
+            (ext == ENTRY_EXTENSION &&
+             !indexed.count(file.path().string()))) &&
+           file.last_write_time(ec) < threshold)) {
+        ltrace() << "[Cache::gc] Removing " << file.path();
+        filesystem::remove(file.path(), ec);
+      }
+    }
+  }
+}
+
+// Evict least-recently-used entries of all targets at *root* until
+// their total size fits into *max_size* bytes, returning the number
+// of bytes evicted. The *token* distinguishes trash files.
+static uintmax_t evict(
+    SQLite::Database &db,
+    const filesystem::path &root,
+    const string &token,
+    uintmax_t max_size) {
+  vector<filesystem::path> trash;
+  uintmax_t total = 0, evicted = 0;
+
+  // The write lock prevents readers from leasing
+  // entries while the victims are being chosen
+  db.exec("BEGIN IMMEDIATE");
+
+  try {
+    const auto timestamp = now();
+
+    SQLite::Statement release_expired(
+        db, "DELETE FROM leases WHERE expires_at <= ?");
+
+    release_expired.bind(1, timestamp);
+    release_expired.exec();
+
+    // Expansions are tiny compared to entries,
+    // thus only the most recent ones are kept
+    SQLite::Statement trim_expansions(
+        db,
+        "DELETE FROM expansions WHERE created_at < ("
+        "SELECT created_at FROM expansions "
+        "ORDER BY created_at DESC LIMIT 1 OFFSET ?)");
+
+    trim_expansions.bind(1, EXPANSIONS_MAX_COUNT);
+    trim_expansions.exec();
+
+    total = db.execAndGet("SELECT COALESCE(SUM(size), 0) "
+                          "FROM entries")
+                .getInt64();
+
+    if (total > max_size) {
+      struct Victim {
+        string target;
+        string key;
+        uintmax_t size;
+      };
+
+      vector<Victim> victims;
+
+      SQLite::Statement select(
+          db,
+          "SELECT target, key, size FROM entries "
+          "WHERE NOT EXISTS (SELECT 1 FROM leases "
+          "WHERE leases.target = entries.target "
+          "AND leases.key = entries.key) "
+          "ORDER BY accessed_at");
+
+      for (auto remaining = total;
+           remaining > max_size && select.executeStep();) {
+        auto size = uintmax_t(select.getColumn(2).getInt64());
+
+        victims.push_back(Victim{
+            select.getColumn(0).getString(),
+            select.getColumn(1).getString(),
+            size});
+
+        remaining -= min(size, remaining);
+      }
+
+      SQLite::Statement remove(
+          db, "DELETE FROM entries WHERE target = ? AND key = ?");
+
+      for (auto &victim : victims) {
+        auto entry =
+            root / victim.target / (victim.key + ENTRY_EXTENSION);
+
+        auto renamed = entry;
+        renamed += "." + token + ".trash";
+
+        // A reader which has opened the entry before the rename
+        // keeps reading it, while new readers miss. On Windows,
+        // an open file can not be renamed, so it is kept.
+        error_code ec;
+        filesystem::rename(entry, renamed, ec);
+
+        if (ec) {
+          if (filesystem::exists(entry)) {
+            ltrace() << "[Cache::gc] Failed to rename " << entry
+                     << ": " << ec.message();
+            continue;
+          }
+        } else
+          trash.push_back(renamed);
+
+        remove.bind(1, victim.target);
+        remove.bind(2, victim.key);
+        remove.exec();
+        remove.reset();
+
+        evicted += victim.size;
+      }
+    }
+
+    db.exec("COMMIT");
+  } catch (SQLite::Exception &e) {
+    db.exec("ROLLBACK");
+    throw;
+  }
+
+  for (auto &path : trash) {
+    error_code ec;
+    filesystem::remove(path, ec);
+  }
+
+  ldebug() << "[Cache::gc] Evicted " << evicted << " of " << total
+           << " bytes";
+
+  return evicted;
+}
+
+bool Cache::Fingerprint::is_stat_equal(const Fingerprint &other) const {
+  return size == other.size && mtime_ns == other.mtime_ns &&
+         inode == other.inode;
+}
+
+string Cache::target_hash(string description) {
+  return to_hex(FNV1a::hash64(description));
+}
+
+Cache::Cache(
+    filesystem::path root,
+    string target,
+    unsigned short workers,
+    Compression::Codec codec,
+    unique_ptr<Remote> remote) :
+    root(root),
+    target(target),
+    dir(root / target),
+    codec(codec),
+    _workers(workers > 0 ? workers : 1),
+    _token(random_token()),
+    _remote(move(remote)) {
+  ldebug() << "[Cache()] Opening cache at " << dir;
+  filesystem::create_directories(dir);
+
+  _db = make_unique<SQLite::Database>(
+      (root / "index.db").string(),
+      SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+  // Concurrent `fnxc` processes share the database;
+  // WAL lets readers proceed while a writer commits
+  _db->setBusyTimeout(BUSY_TIMEOUT_MS);
+  _db->exec("PRAGMA journal_mode = WAL");
+  _db->exec("PRAGMA synchronous = NORMAL");
+
+  _migrate();
+  _load();
+
+  if (_remote)
+    _uploader = make_unique<Remote::Uploader>(*_remote);
+}
+
+Cache::~Cache() {
+  try {
+    flush();
+  } catch (SQLite::Exception &e) {
+    lerror() << "[~Cache] Failed to flush: " << e.what();
+  }
+}
+
+optional<Cache::Fingerprint> Cache::stat(filesystem::path path) {
+  Fingerprint fp = {};
+
+#ifdef _WIN32
+  struct _stat64 st;
+
+  if (_wstat64(path.c_str(), &st))
+    return nullopt;
+
+  fp.size = st.st_size;
+  fp.mtime_ns = int64_t(st.st_mtime) * 1000000000;
+  fp.inode = 0; // Not meaningful on Windows
+#else
+  struct stat st;
+
+  if (::stat(path.c_str(), &st))
+    return nullopt;
+
+  fp.size = st.st_size;
+  fp.inode = st.st_ino;
+
+#ifdef __APPLE__
+  fp.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+                st.st_mtimespec.tv_nsec;
+#else
+  fp.mtime_ns =
+      int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+
+  return fp;
+}
+
+uint64_t Cache::hash(filesystem::path path) {
+  ifstream file(path, ios::binary);
+  vector<char> buffer(HASH_CHUNK_SIZE);
+
+  // Hashing an empty input returns the FNV-1a offset basis
+  uint64_t hash = FNV1a::hash64(nullptr, 0);
+
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    hash = FNV1a::hash64(buffer.data(), file.gcount(), hash);
+  }
+
+  return hash;
+}
+
+void Cache::validate() {
+  vector<pair<const string, Entry> *> entries;
+  entries.reserve(_index.size());
+
+  for (auto &entry : _index)
+    entries.push_back(&entry);
+
+  ldebug() << "[Cache::validate] Validating " << entries.size()
+           << " entries";
+
+  atomic<size_t> next = 0;
+
+  auto work = [&]() {
+    vector<string> fresh;
+    vector<string> touched;
+
+    while (true) {
+      auto i = next.fetch_add(1);
+
+      if (i >= entries.size())
+        break;
+
+      auto &[path, entry] = *entries[i];
+      auto stat = entry.fingerprint;
+
+      if (_validate(path, entry)) {
+        fresh.push_back(path);
+
+        if (!stat.is_stat_equal(entry.fingerprint))
+          touched.push_back(path);
+      }
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    _fresh.insert(fresh.begin(), fresh.end());
+    _dirty.insert(touched.begin(), touched.end());
+  };
+
+  auto count = min<size_t>(_workers, entries.size());
+  vector<thread> threads;
+
+  // The calling thread is a worker too
+  for (size_t i = 1; i < count; i++)
+    threads.push_back(thread(work));
+
+  work();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  ldebug() << "[Cache::validate] " << _fresh.size() << " of "
+           << entries.size() << " entries are fresh";
+}
+
+void Cache::prefetch() {
+  if (!_remote)
+    return;
+
+  vector<string> keys;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    unordered_set<string> unique;
+
+    for (auto &path : _fresh) {
+      auto key = _key(path).value();
+
+      if (unique.insert(key).second &&
+          !filesystem::exists(dir / (key + ENTRY_EXTENSION)))
+        keys.push_back(key);
+    }
+  }
+
+  if (keys.empty())
+    return;
+
+  auto entries = _remote->get_many(target, keys, _workers);
+  size_t fetched = 0;
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (entries[i] && _store(keys[i], entries[i].value()))
+      fetched++;
+  }
+
+  ldebug() << "[Cache::prefetch] Fetched " << fetched << " of "
+           << keys.size() << " missing entries";
+}
+
+bool Cache::is_fresh(filesystem::path path) {
+  lock_guard<mutex> lock(_mutex);
+  return _fresh.count(path.string()) > 0;
+}
+
+vector<Cache::Require> Cache::requirements(filesystem::path path) {
+  lock_guard<mutex> lock(_mutex);
+  auto key = path.string();
+
+  _accessed.insert(key);
+  return _index.at(key).requirements;
+}
+
+void Cache::update(
+    filesystem::path path,
+    vector<Require> requirements,
+    Compiler::Usage usage,
+    bool is_idempotent,
+    optional<Compiler::Macro::CacheFunction> cache_function) {
+  auto fp = stat(path);
+
+  if (!fp) {
+    lwarn() << "[Cache::update] Can not stat " << path;
+    return;
+  }
+
+  fp->hash = hash(path);
+
+  lock_guard<mutex> lock(_mutex);
+  auto key = path.string();
+  auto old = _index.find(key);
+
+  _invalidate_consumers(
+      key, old != _index.end() ? &old->second.usage : nullptr, usage);
+
+  _index.insert_or_assign(
+      key,
+      Entry{
+          fp.value(),
+          requirements,
+          usage,
+          is_idempotent,
+          cache_function});
+
+  // A non-idempotent unit without
+  // a cache function is never fresh
+  if (is_idempotent || cache_function)
+    _fresh.insert(key);
+  else
+    _fresh.erase(key);
+
+  _dirty.insert(key);
+
+  if (_dirty.size() >= FLUSH_THRESHOLD)
+    _flush();
+}
+
+void Cache::_invalidate_consumers(
+    const string &path,
+    const Compiler::Usage *old,
+    const Compiler::Usage &current) {
+  unordered_set<string> changed;
+
+  for (auto &[name, signature] : current.exports) {
+    if (!old)
+      changed.insert(name);
+    else {
+      auto prev = old->exports.find(name);
+
+      if (prev == old->exports.end() || prev->second != signature)
+        changed.insert(name);
+    }
+  }
+
+  if (old) {
+    // A removed declaration is a change too
+    for (auto &[name, _] : old->exports)
+      if (!current.exports.count(name))
+        changed.insert(name);
+
+    for (auto &[name, _] : old->exports)
+      _exporters[name].erase(path);
+
+    for (auto &name : old->consumptions)
+      _consumers[name].erase(path);
+  }
+
+  for (auto &[name, _] : current.exports)
+    _exporters[name].insert(path);
+
+  for (auto &name : current.consumptions)
+    _consumers[name].insert(path);
+
+  for (auto &name : changed) {
+    auto consumers = _consumers.find(name);
+
+    if (consumers == _consumers.end())
+      continue;
+
+    for (auto &consumer : consumers->second) {
+      if (consumer != path && _fresh.erase(consumer))
+        ltrace() << "[Cache] Invalidated " << consumer
+                 << " because `" << name << "` has changed in "
+                 << path;
+    }
+  }
+}
+
+void Cache::flush() {
+  lock_guard<mutex> lock(_mutex);
+  _flush();
+}
+
+void Cache::_flush() {
+  auto expansions = Compiler::Macro::export_expansions();
+
+  if (_dirty.empty() && _accessed.empty() && _stored.empty() &&
+      expansions.empty())
+    return;
+
+  ltrace() << "[Cache::flush] Flushing " << _dirty.size()
+           << " changed, " << _accessed.size() << " accessed and "
+           << _stored.size() << " stored entries and "
+           << expansions.size() << " macro expansions";
+
+  const auto timestamp = now();
+  SQLite::Transaction transaction(*_db);
+
+  SQLite::Statement upsert_unit(
+      *_db,
+      "INSERT INTO units (target, path, size, mtime_ns, inode, hash, "
+      "is_idempotent, cache_function, cache_value, accessed_at) "
+      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+      "ON CONFLICT (target, path) DO UPDATE SET "
+      "size = excluded.size, mtime_ns = excluded.mtime_ns, "
+      "inode = excluded.inode, hash = excluded.hash, "
+      "is_idempotent = excluded.is_idempotent, "
+      "cache_function = excluded.cache_function, "
+      "cache_value = excluded.cache_value, "
+      "accessed_at = excluded.accessed_at");
+
+  SQLite::Statement delete_requirements(
+      *_db, "DELETE FROM requirements WHERE target = ? AND unit = ?");
+
+  SQLite::Statement insert_requirement(
+      *_db,
+      "INSERT INTO requirements (target, unit, position, path, "
+      "is_import) VALUES (?, ?, ?, ?, ?)");
+
+  SQLite::Statement delete_exports(
+      *_db, "DELETE FROM exports WHERE target = ? AND unit = ?");
+
+  SQLite::Statement insert_export(
+      *_db,
+      "INSERT INTO exports (target, unit, name, signature) "
+      "VALUES (?, ?, ?, ?)");
+
+  SQLite::Statement delete_consumptions(
+      *_db, "DELETE FROM consumptions WHERE target = ? AND unit = ?");
+
+  SQLite::Statement insert_consumption(
+      *_db,
+      "INSERT INTO consumptions (target, unit, name) "
+      "VALUES (?, ?, ?)");
+
+  SQLite::Statement touch_unit(
+      *_db,
+      "UPDATE units SET accessed_at = ? "
+      "WHERE target = ? AND path = ?");
+
+  for (auto &path : _dirty) {
+    auto &entry = _index.at(path);
+    auto &fp = entry.fingerprint;
+
+    upsert_unit.bind(1, target);
+    upsert_unit.bind(2, path);
+    upsert_unit.bind(3, int64_t(fp.size));
+    upsert_unit.bind(4, fp.mtime_ns);
+    upsert_unit.bind(5, int64_t(fp.inode));
+    upsert_unit.bind(6, int64_t(fp.hash));
+    upsert_unit.bind(7, entry.is_idempotent);
+
+    if (auto &fn = entry.cache_function) {
+      upsert_unit.bind(8, fn->bytecode.data(), fn->bytecode.size());
+      upsert_unit.bind(9, fn->value.data(), fn->value.size());
+    } else {
+      upsert_unit.bind(8);
+      upsert_unit.bind(9);
+    }
+
+    upsert_unit.bind(10, timestamp);
+    upsert_unit.exec();
+    upsert_unit.reset();
+
+    delete_requirements.bind(1, target);
+    delete_requirements.bind(2, path);
+    delete_requirements.exec();
+    delete_requirements.reset();
+
+    for (size_t i = 0; i < entry.requirements.size(); i++) {
+      auto &req = entry.requirements[i];
+
+      insert_requirement.bind(1, target);
+      insert_requirement.bind(2, path);
+      insert_requirement.bind(3, int64_t(i));
+      insert_requirement.bind(4, req.path.string());
+      insert_requirement.bind(5, req.is_import);
+      insert_requirement.exec();
+      insert_requirement.reset();
+    }
+
+    delete_exports.bind(1, target);
+    delete_exports.bind(2, path);
+    delete_exports.exec();
+    delete_exports.reset();
+
+    for (auto &[name, signature] : entry.usage.exports) {
+      insert_export.bind(1, target);
+      insert_export.bind(2, path);
+      insert_export.bind(3, name);
+      insert_export.bind(4, int64_t(signature));
+      insert_export.exec();
+      insert_export.reset();
+    }
+
+    delete_consumptions.bind(1, target);
+    delete_consumptions.bind(2, path);
+    delete_consumptions.exec();
+    delete_consumptions.reset();
+
+    for (auto &name : entry.usage.consumptions) {
+      insert_consumption.bind(1, target);
+      insert_consumption.bind(2, path);
+      insert_consumption.bind(3, name);
+      insert_consumption.exec();
+      insert_consumption.reset();
+    }
+  }
+
+  for (auto &path : _accessed) {
+    if (_dirty.count(path))
+      continue;
+
+    touch_unit.bind(1, timestamp);
+    touch_unit.bind(2, target);
+    touch_unit.bind(3, path);
+    touch_unit.exec();
+    touch_unit.reset();
+  }
+
+  SQLite::Statement upsert_entry(
+      *_db,
+      "INSERT INTO entries (target, key, size, accessed_at) "
+      "VALUES (?, ?, ?, ?) "
+      "ON CONFLICT (target, key) DO UPDATE SET "
+      "size = excluded.size, accessed_at = excluded.accessed_at");
+
+  for (auto &[key, size] : _stored) {
+    upsert_entry.bind(1, target);
+    upsert_entry.bind(2, key);
+    upsert_entry.bind(3, int64_t(size));
+    upsert_entry.bind(4, timestamp);
+    upsert_entry.exec();
+    upsert_entry.reset();
+  }
+
+  SQLite::Statement insert_expansion(
+      *_db,
+      "INSERT OR IGNORE INTO expansions (target, key, output, "
+      "created_at) VALUES (?, ?, ?, ?)");
+
+  for (auto &[key, output] : expansions) {
+    insert_expansion.bind(1, target);
+    insert_expansion.bind(2, int64_t(key));
+    insert_expansion.bind(3, output.data(), output.size());
+    insert_expansion.bind(4, timestamp);
+    insert_expansion.exec();
+    insert_expansion.reset();
+  }
+
+  SQLite::Statement touch_target(
+      *_db,
+      "INSERT INTO targets (hash, accessed_at) VALUES (?, ?) "
+      "ON CONFLICT (hash) DO UPDATE SET "
+      "accessed_at = excluded.accessed_at");
+
+  touch_target.bind(1, target);
+  touch_target.bind(2, timestamp);
+  touch_target.exec();
+
+  transaction.commit();
+
+  _dirty.clear();
+  _accessed.clear();
+  _stored.clear();
+}
+
+void Cache::store(filesystem::path path, const string &data) {
+  string key;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    auto maybe_key = _key(path.string());
+
+    if (!maybe_key) {
+      lwarn() << "[Cache::store] " << path << " is not indexed";
+      return;
+    }
+
+    key = maybe_key.value();
+  }
+
+  shared_ptr<Compression::Dictionary> dictionary;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    dictionary = _dictionary;
+
+    if (codec == Compression::Zstd && !dictionary &&
+        _samples_size < SAMPLES_MAX_SIZE) {
+      _samples.push_back(data);
+      _samples_size += data.size();
+    }
+  }
+
+  if (data.size() > Compression::MAX_SIZE) {
+    lwarn() << "[Cache::store] " << path << " entry is too large";
+    return;
+  }
+
+  auto entry = Compression::encode(data, codec, dictionary.get());
+
+  if (_store(key, entry) && _uploader)
+    _uploader->enqueue(target, key, move(entry));
+}
+
+optional<string> Cache::load(filesystem::path path) {
+  optional<int64_t> lease;
+  string key;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    auto maybe_key = _key(path.string());
+
+    if (!maybe_key)
+      return nullopt;
+
+    key = maybe_key.value();
+
+    // The entry must be in the database to be leased
+    if (_stored.count(key))
+      _flush();
+
+    lease = _lease(key);
+  }
+
+  if (!lease)
+    return _fetch(key);
+
+  auto data = _read(key);
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    _release(lease.value());
+  }
+
+  return data ? data : _fetch(key);
+}
+
+void Cache::train() {
+  vector<string> samples;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+
+    if (codec != Compression::Zstd || _dictionary ||
+        _samples.size() < SAMPLES_MIN_COUNT)
+      return;
+
+    samples = move(_samples);
+    _samples.clear();
+    _samples_size = 0;
+  }
+
+  auto dictionary =
+      Compression::Dictionary::train(samples, DICTIONARY_CAPACITY);
+
+  if (!dictionary) {
+    ldebug() << "[Cache::train] Failed to train a dictionary from "
+             << samples.size() << " samples";
+    return;
+  }
+
+  if (!_write(
+          dir / (to_hex(dictionary->id) + DICTIONARY_EXTENSION),
+          dictionary->data))
+    return;
+
+  lock_guard<mutex> lock(_mutex);
+  _dictionary = dictionary;
+  _dictionaries.insert_or_assign(dictionary->id, dictionary);
+
+  SQLite::Statement update(
+      *_db,
+      "INSERT INTO targets (hash, accessed_at, dictionary) "
+      "VALUES (?, ?, ?) "
+      "ON CONFLICT (hash) DO UPDATE SET "
+      "dictionary = excluded.dictionary");
+
+  update.bind(1, target);
+  update.bind(2, now());
+  update.bind(3, int64_t(dictionary->id));
+  update.exec();
+
+  // Remote entries compressed with the dictionary
+  // are undecodable without it
+  if (_uploader)
+    _uploader->enqueue(
+        target, dictionary_key(dictionary->id), dictionary->data);
+
+  ldebug() << "[Cache::train] Trained dictionary "
+           << to_hex(dictionary->id) << " from " << samples.size()
+           << " samples";
+}
+
+uintmax_t Cache::gc(uintmax_t max_size) {
+  lock_guard<mutex> lock(_mutex);
+  _flush();
+  sweep(*_db, root);
+
+  return evict(*_db, root, _token, max_size);
+}
+
+uintmax_t Cache::collect(filesystem::path root, uintmax_t max_size) {
+  ldebug() << "[Cache::collect] Collecting cache at " << root;
+
+  // Not created, nor migrated: a different version may be
+  // used by another `fnxc` binary, which is to migrate it
+  SQLite::Database db(
+      (root / "index.db").string(), SQLite::OPEN_READWRITE);
+
+  db.setBusyTimeout(BUSY_TIMEOUT_MS);
+  const auto version = db.execAndGet("PRAGMA user_version").getInt();
+
+  if (version != SCHEMA_VERSION)
+    throw SQLite::Exception(
+        "The cache index is of version " + to_string(version) +
+        ", while " + to_string(SCHEMA_VERSION) + " is expected");
+
+  sweep(db, root);
+  return evict(db, root, random_token(), max_size);
+}
+
+bool Cache::_store(const string &key, const string &entry) {
+  if (!_write(dir / (key + ENTRY_EXTENSION), entry))
+    return false;
+
+  lock_guard<mutex> lock(_mutex);
+  _stored.insert_or_assign(key, entry.size());
+
+  if (_stored.size() >= FLUSH_THRESHOLD)
+    _flush();
+
+  return true;
+}
+
+optional<string> Cache::_read(const string &key) {
+  ifstream file(dir / (key + ENTRY_EXTENSION), ios::binary);
+
+  // A leased entry may still be missing, e.g. if it
+  // has been deleted manually, which is a cache miss
+  if (!file) {
+    ltrace() << "[Cache] Entry " << key << " is missing";
+    return nullopt;
+  }
+
+  char buffer[sizeof(Compression::Header)];
+  file.read(buffer, sizeof(buffer));
+
+  auto header = Compression::read_header(buffer, file.gcount());
+
+  if (!header) {
+    lwarn() << "[Cache] Entry " << key << " has an invalid header";
+    return nullopt;
+  }
+
+  // Read or decompress straight into the resulting buffer
+  string data(header->raw_size, '\0');
+
+  if (header->codec == Compression::None) {
+    file.read(data.data(), data.size());
+
+    if (file.gcount() == streamsize(data.size()) &&
+        header->stored_size == header->raw_size &&
+        Compression::verify(header.value(), data.data()))
+      return data;
+  } else {
+    string payload(header->stored_size, '\0');
+    file.read(payload.data(), payload.size());
+
+    if (file.gcount() == streamsize(payload.size()) &&
+        Compression::decode(
+            header.value(),
+            payload.data(),
+            data.data(),
+            _find_dictionary(header->dictionary).get()))
+      return data;
+  }
+
+  lwarn() << "[Cache] Entry " << key << " is corrupt";
+  return nullopt;
+}
+
+optional<string> Cache::_decode(const string &entry) {
+  auto header = Compression::read_header(entry.data(), entry.size());
+
+  if (!header ||
+      entry.size() != sizeof(Compression::Header) + header->stored_size)
+    return nullopt;
+
+  string data(header->raw_size, '\0');
+
+  if (!Compression::decode(
+          header.value(),
+          entry.data() + sizeof(Compression::Header),
+          data.data(),
+          _find_dictionary(header->dictionary).get()))
+    return nullopt;
+
+  return data;
+}
+
+optional<string> Cache::_fetch(const string &key) {
+  if (!_remote)
+    return nullopt;
+
+  try {
+    auto entry = _remote->get(target, key);
+
+    if (!entry)
+      return nullopt;
+
+    auto data = _decode(entry.value());
+
+    if (!data) {
+      lwarn() << "[Cache] Remote entry " << key << " is corrupt";
+      return nullopt;
+    }
+
+    _store(key, entry.value());
+    return data;
+  } catch (Remote::Error &e) {
+    lwarn() << "[Cache] Failed to fetch " << key << ": " << e.message;
+    return nullopt;
+  }
+}
+
+shared_ptr<Compression::Dictionary>
+Cache::_find_dictionary(uint32_t id) {
+  if (!id)
+    return nullptr;
+
+  {
+    lock_guard<mutex> lock(_mutex);
+    auto found = _dictionaries.find(id);
+
+    if (found != _dictionaries.end())
+      return found->second;
+  }
+
+  auto path = dir / (to_hex(id) + DICTIONARY_EXTENSION);
+  optional<string> data;
+
+  if (ifstream file{path, ios::binary})
+    data = string(istreambuf_iterator<char>(file), {});
+  else if (_remote) {
+    try {
+      data = _remote->get(target, dictionary_key(id));
+
+      if (data)
+        _write(path, data.value());
+    } catch (Remote::Error &e) {
+      lwarn() << "[Cache] Failed to fetch a dictionary: "
+              << e.message;
+    }
+  }
+
+  if (!data)
+    return nullptr;
+
+  auto dictionary = make_shared<Compression::Dictionary>(data.value());
+
+  if (dictionary->id != id) {
+    lwarn() << "[Cache] Dictionary " << path << " is corrupt";
+    return nullptr;
+  }
+
+  lock_guard<mutex> lock(_mutex);
+  _dictionaries.insert_or_assign(id, dictionary);
+
+  return dictionary;
+}
+
+bool Cache::_write(const filesystem::path &path, const string &data) {
+  auto temp = path;
+  temp += "." + _token + ".tmp";
+
+  {
+    ofstream file(temp, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+
+    if (!file) {
+      lwarn() << "[Cache] Failed to write " << temp;
+      filesystem::remove(temp);
+      return false;
+    }
+  }
+
+  // An atomic replacement on the same filesystem
+  filesystem::rename(temp, path);
+  return true;
+}
+
+optional<string> Cache::_key(const string &path) {
+  auto found = _index.find(path);
+
+  if (found == _index.end())
+    return nullopt;
+
+  auto &entry = found->second;
+
+  // Including terminating nulls, so that
+  // adjacent strings are not ambiguous
+  auto feed = [](uint64_t hash, const string &string) {
+    return FNV1a::hash64(string.c_str(), string.size() + 1, hash);
+  };
+
+  auto hash = feed(FNV1a::hash64(nullptr, 0), target);
+  hash = feed(hash, FNXC_VERSION);
+  hash = feed(hash, Compiler::Macro::engine());
+  hash = feed(hash, to_hex(entry.fingerprint.hash));
+
+  // Sorted, as the order of a set is unspecified
+  vector<string> consumptions(
+      entry.usage.consumptions.begin(),
+      entry.usage.consumptions.end());
+
+  sort(consumptions.begin(), consumptions.end());
+
+  for (auto &name : consumptions) {
+    hash = feed(hash, name);
+
+    auto exporters = _exporters.find(name);
+
+    if (exporters == _exporters.end())
+      continue;
+
+    // A name may be exported by multiple units
+    vector<uint64_t> signatures;
+
+    for (auto &exporter : exporters->second)
+      signatures.push_back(
+          _index.at(exporter).usage.exports.at(name));
+
+    sort(signatures.begin(), signatures.end());
+
+    for (auto signature : signatures)
+      hash = feed(hash, to_hex(signature));
+  }
+
+  if (auto &fn = entry.cache_function)
+    hash = feed(hash, fn->value);
+
+  return to_hex(hash);
+}
+
+optional<int64_t> Cache::_lease(const string &key) {
+  _db->exec("BEGIN IMMEDIATE");
+
+  try {
+    const auto timestamp = now();
+
+    SQLite::Statement touch(
+        *_db,
+        "UPDATE entries SET accessed_at = ? "
+        "WHERE target = ? AND key = ?");
+
+    touch.bind(1, timestamp);
+    touch.bind(2, target);
+    touch.bind(3, key);
+
+    // The entry has been evicted or never stored
+    if (!touch.exec()) {
+      _db->exec("COMMIT");
+      return nullopt;
+    }
+
+    SQLite::Statement insert(
+        *_db,
+        "INSERT INTO leases (target, key, expires_at) "
+        "VALUES (?, ?, ?)");
+
+    insert.bind(1, target);
+    insert.bind(2, key);
+    insert.bind(3, timestamp + LEASE_DURATION_S);
+    insert.exec();
+
+    auto lease = _db->getLastInsertRowid();
+    _db->exec("COMMIT");
+
+    return lease;
+  } catch (SQLite::Exception &e) {
+    _db->exec("ROLLBACK");
+    throw;
+  }
+}
+
+void Cache::_release(int64_t lease) {
+  SQLite::Statement remove(*_db, "DELETE FROM leases WHERE id = ?");
+  remove.bind(1, lease);
+  remove.exec();
+}
+
+bool Cache::_validate(const string &path, Entry &entry) {
+  if (!entry.is_idempotent && !entry.cache_function)
+    return false;
+
+  auto current = stat(path);
+
+  if (!current) {
+    ltrace() << "[Cache] " << path << " does not exist anymore";
+    return false;
+  }
+
+  if (!current->is_stat_equal(entry.fingerprint)) {
+    // The stat has changed, but the contents may be the same
+    // (e.g. after a `touch` or a branch checkout)
+    if (hash(path) != entry.fingerprint.hash) {
+      ltrace() << "[Cache] " << path << " contents has changed";
+      return false;
+    }
+
+    ltrace() << "[Cache] " << path << " has been touched, "
+             << "updating its stat";
+
+    current->hash = entry.fingerprint.hash;
+    entry.fingerprint = current.value();
+  }
+
+  // Only the cache function is run, not the whole unit's macros
+  if (!entry.is_idempotent &&
+      !Compiler::Macro::revalidate(entry.cache_function.value())) {
+    ltrace() << "[Cache] " << path << " cache function has returned "
+             << "a different value";
+    return false;
+  }
+
+  return true;
+}
+
+void Cache::_migrate() {
+  // Take the write lock immediately, so that concurrent
+  // processes would not migrate simultaneously
+  _db->exec("BEGIN IMMEDIATE");
+
+  try {
+    auto version = _db->execAndGet("PRAGMA user_version").getInt();
+
+    if (version != SCHEMA_VERSION) {
+      ldebug() << "[Cache] Migrating the index from version "
+               << version << " to " << SCHEMA_VERSION;
+
+      // Entries and dictionaries are only reachable via the index,
+      // thus they would never be evicted otherwise
+      error_code ec;
+
+      for (auto &target : filesystem::directory_iterator(root, ec)) {
+        if (!target.is_directory())
+          continue;
+
+        for (auto &file :
+             filesystem::directory_iterator(target, ec)) {
+          auto ext = file.path().extension();
+
+          if (ext == ENTRY_EXTENSION || ext == DICTIONARY_EXTENSION)
+            filesystem::remove(file.path(), ec);
+        }
+      }
+
+      _db->exec("DROP TABLE IF EXISTS expansions");
+      _db->exec("DROP TABLE IF EXISTS leases");
+      _db->exec("DROP TABLE IF EXISTS entries");
+      _db->exec("DROP TABLE IF EXISTS consumptions");
+      _db->exec("DROP TABLE IF EXISTS exports");
+      _db->exec("DROP TABLE IF EXISTS requirements");
+      _db->exec("DROP TABLE IF EXISTS units");
+      _db->exec("DROP TABLE IF EXISTS targets");
+
+      _db->exec("CREATE TABLE targets ("
+                "  hash TEXT PRIMARY KEY,"
+                "  accessed_at INTEGER NOT NULL,"
+                "  dictionary INTEGER"
+                ") WITHOUT ROWID");
+
+      _db->exec("CREATE TABLE units ("
+                "  target TEXT NOT NULL,"
+                "  path TEXT NOT NULL,"
+                "  size INTEGER NOT NULL,"
+                "  mtime_ns INTEGER NOT NULL,"
+                "  inode INTEGER NOT NULL,"
+                "  hash INTEGER NOT NULL,"
+                "  is_idempotent INTEGER NOT NULL,"
+                "  cache_function BLOB,"
+                "  cache_value BLOB,"
+                "  accessed_at INTEGER NOT NULL,"
+                "  PRIMARY KEY (target, path)"
+                ") WITHOUT ROWID");
+
+      _db->exec("CREATE TABLE requirements ("
+                "  target TEXT NOT NULL,"
+                "  unit TEXT NOT NULL,"
+                "  position INTEGER NOT NULL,"
+                "  path TEXT NOT NULL,"
+                "  is_import INTEGER NOT NULL,"
+                "  PRIMARY KEY (target, unit, position)"
+                ") WITHOUT ROWID");
+
+      // To look up units requiring a given path
+      _db->exec("CREATE INDEX requirements_path "
+                "ON requirements (target, path)");
+
+      _db->exec("CREATE TABLE exports ("
+                "  target TEXT NOT NULL,"
+                "  unit TEXT NOT NULL,"
+                "  name TEXT NOT NULL,"
+                "  signature INTEGER NOT NULL,"
+                "  PRIMARY KEY (target, unit, name)"
+                ") WITHOUT ROWID");
+
+      _db->exec("CREATE TABLE consumptions ("
+                "  target TEXT NOT NULL,"
+                "  unit TEXT NOT NULL,"
+                "  name TEXT NOT NULL,"
+                "  PRIMARY KEY (target, unit, name)"
+                ") WITHOUT ROWID");
+
+      // To look up units consuming a given declaration
+      _db->exec("CREATE INDEX consumptions_name "
+                "ON consumptions (target, name)");
+
+      _db->exec("CREATE TABLE entries ("
+                "  target TEXT NOT NULL,"
+                "  key TEXT NOT NULL,"
+                "  size INTEGER NOT NULL,"
+                "  accessed_at INTEGER NOT NULL,"
+                "  PRIMARY KEY (target, key)"
+                ") WITHOUT ROWID");
+
+      // To evict in least-recently-used order
+      _db->exec("CREATE INDEX entries_accessed_at "
+                "ON entries (accessed_at)");
+
+      // Expired leases are ignored and eventually deleted
+      _db->exec("CREATE TABLE leases ("
+                "  id INTEGER PRIMARY KEY,"
+                "  target TEXT NOT NULL,"
+                "  key TEXT NOT NULL,"
+                "  expires_at INTEGER NOT NULL"
+                ")");
+
+      _db->exec("CREATE INDEX leases_entry ON leases (target, key)");
+
+      // Memoized outputs of pure macro chunks
+      _db->exec("CREATE TABLE expansions ("
+                "  target TEXT NOT NULL,"
+                "  key INTEGER NOT NULL,"
+                "  output BLOB NOT NULL,"
+                "  created_at INTEGER NOT NULL,"
+                "  PRIMARY KEY (target, key)"
+                ") WITHOUT ROWID");
+
+      _db->exec("CREATE INDEX expansions_created_at "
+                "ON expansions (created_at)");
+
+      _db->exec(
+          "PRAGMA user_version = " + to_string(SCHEMA_VERSION));
+    }
+
+    _db->exec("COMMIT");
+  } catch (SQLite::Exception &e) {
+    _db->exec("ROLLBACK");
+    throw;
+  }
+}
+
+void Cache::_load() {
+  SQLite::Statement units(
+      *_db,
+      "SELECT path, size, mtime_ns, inode, hash, is_idempotent, "
+      "cache_function, cache_value FROM units WHERE target = ?");
+
+  units.bind(1, target);
+
+  while (units.executeStep()) {
+    Entry entry = {};
+
+    entry.fingerprint.size = units.getColumn(1).getInt64();
+    entry.fingerprint.mtime_ns = units.getColumn(2).getInt64();
+    entry.fingerprint.inode = units.getColumn(3).getInt64();
+    entry.fingerprint.hash = units.getColumn(4).getInt64();
+    entry.is_idempotent = units.getColumn(5).getInt();
+
+    if (!units.getColumn(6).isNull()) {
+      auto fn = units.getColumn(6);
+      auto value = units.getColumn(7);
+
+      entry.cache_function = Compiler::Macro::CacheFunction{
+          string((const char *)fn.getBlob(), fn.getBytes()),
+          string((const char *)value.getBlob(), value.getBytes())};
+    }
+
+    _index.insert_or_assign(units.getColumn(0).getString(), entry);
+  }
+
+  SQLite::Statement requirements(
+      *_db,
+      "SELECT unit, path, is_import FROM requirements "
+      "WHERE target = ? ORDER BY unit, position");
+
+  requirements.bind(1, target);
+
+  while (requirements.executeStep()) {
+    auto unit = _index.find(requirements.getColumn(0).getString());
+
+    if (unit == _index.end())
+      continue;
+
+    unit->second.requirements.push_back(Require{
+        requirements.getColumn(1).getString(),
+        bool(requirements.getColumn(2).getInt())});
+  }
+
+  SQLite::Statement exports(
+      *_db,
+      "SELECT unit, name, signature FROM exports WHERE target = ?");
+
+  exports.bind(1, target);
+
+  while (exports.executeStep()) {
+    auto unit = _index.find(exports.getColumn(0).getString());
+
+    if (unit == _index.end())
+      continue;
+
+    auto name = exports.getColumn(1).getString();
+
+    unit->second.usage.exports.insert_or_assign(
+        name, exports.getColumn(2).getInt64());
+
+    _exporters[name].insert(unit->first);
+  }
+
+  SQLite::Statement consumptions(
+      *_db, "SELECT unit, name FROM consumptions WHERE target = ?");
+
+  consumptions.bind(1, target);
+
+  while (consumptions.executeStep()) {
+    auto path = consumptions.getColumn(0).getString();
+    auto unit = _index.find(path);
+
+    if (unit == _index.end())
+      continue;
+
+    auto name = consumptions.getColumn(1).getString();
+    unit->second.usage.consumptions.insert(name);
+    _consumers[name].insert(path);
+  }
+
+  SQLite::Statement expansions(
+      *_db, "SELECT key, output FROM expansions WHERE target = ?");
+
+  expansions.bind(1, target);
+
+  while (expansions.executeStep()) {
+    auto output = expansions.getColumn(1);
+
+    Compiler::Macro::import_expansion(
+        expansions.getColumn(0).getInt64(),
+        string((const char *)output.getBlob(), output.getBytes()));
+  }
+
+  SQLite::Statement dictionary(
+      *_db, "SELECT dictionary FROM targets WHERE hash = ?");
+
+  dictionary.bind(1, target);
+
+  if (dictionary.executeStep() && !dictionary.getColumn(0).isNull())
+    _dictionary = _find_dictionary(dictionary.getColumn(0).getInt64());
+
+  ldebug() << "[Cache] Loaded " << _index.size() << " entries";
+}
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
@@ -0,0 +1,228 @@
+#include <cstring>
+
+#include <lz4.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include "../../../header/app/shared/compression.hpp"
+#include "../../../header/utils/fnv1a.hpp"
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+namespace Compression {
+static const char MAGIC[4] = {'N', 'X', 'B', 'C'};
+static const uint8_t VERSION = 2;
+
+// A balance between ratio and speed;
+// higher levels are much slower to compress.
+static const int ZSTD_LEVEL = 12;
+
+// Contexts are reused by a thread.
+static thread_local struct Contexts {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  ZSTD_DCtx *dctx = ZSTD_createDCtx();
+
+  ~Contexts() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+} contexts;
+
+optional<Codec> parse(const string &name) {
+  if (name == "none")
+    return None;
+  else if (name == "lz4")
+    return LZ4;
+  else if (name == "zstd")
+    return Zstd;
+  else
+    return nullopt;
+}
+
+shared_ptr<Dictionary>
+Dictionary::train(const vector<string> &samples, size_t capacity) {
+  string buffer;
+  vector<size_t> sizes;
+
+  for (auto &sample : samples) {
+    buffer += sample;
+    sizes.push_back(sample.size());
+  }
+
+  string data(capacity, '\0');
+
+  auto size = ZDICT_trainFromBuffer(
+      data.data(),
+      data.size(),
+      buffer.data(),
+      sizes.data(),
+      (unsigned)sizes.size());
+
+  if (ZDICT_isError(size))
+    return nullptr;
+
+  data.resize(size);
+  return make_shared<Dictionary>(data);
+}
+
+Dictionary::Dictionary(string data) :
+    data(data), id(ZDICT_getDictID(data.data(), data.size())) {
+  _cdict = ZSTD_createCDict(data.data(), data.size(), ZSTD_LEVEL);
+  _ddict = ZSTD_createDDict(data.data(), data.size());
+}
+
+Dictionary::~Dictionary() {
+  ZSTD_freeCDict(_cdict);
+  ZSTD_freeDDict(_ddict);
+}
+
+string
+encode(const string &data, Codec codec, const Dictionary *dictionary) {
+  if (data.size() > MAX_SIZE)
+    throw "BUG! An entry exceeds the maximum size";
+
+  Header header = {};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.codec = codec;
+  header.raw_size = data.size();
+
+  size_t bound;
+
+  switch (codec) {
+  case None:
+    bound = data.size();
+    break;
+  case LZ4:
+    bound = LZ4_compressBound((int)data.size());
+    break;
+  case Zstd:
+    bound = ZSTD_compressBound(data.size());
+    break;
+  }
+
+  string entry(sizeof(Header) + bound, '\0');
+  auto out = entry.data() + sizeof(Header);
+  size_t size;
+
+  switch (codec) {
+  case None:
+    memcpy(out, data.data(), data.size());
+    size = data.size();
+    break;
+  case LZ4:
+    size = LZ4_compress_default(
+        data.data(), out, (int)data.size(), (int)bound);
+
+    if (!size && !data.empty())
+      throw "BUG! Failed to compress with LZ4";
+
+    break;
+  case Zstd:
+    if (dictionary) {
+      header.dictionary = dictionary->id;
+
+      size = ZSTD_compress_usingCDict(
+          contexts.cctx,
+          out,
+          bound,
+          data.data(),
+          data.size(),
+          dictionary->_cdict);
+    } else
+      size = ZSTD_compressCCtx(
+          contexts.cctx,
+          out,
+          bound,
+          data.data(),
+          data.size(),
+          ZSTD_LEVEL);
+
+    if (ZSTD_isError(size))
+      throw "BUG! Failed to compress with Zstd";
+
+    break;
+  }
+
+  header.stored_size = size;
+  header.checksum = FNV1a::hash32(out, size);
+  memcpy(entry.data(), &header, sizeof(Header));
+  entry.resize(sizeof(Header) + size);
+
+  return entry;
+}
+
+optional<Header> read_header(const char *data, size_t size) {
+  if (size < sizeof(Header))
+    return nullopt;
+
+  Header header;
+  memcpy(&header, data, sizeof(Header));
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) ||
+      header.version != VERSION || header.codec > Zstd ||
+      header.raw_size > MAX_SIZE || header.stored_size > MAX_SIZE)
+    return nullopt;
+
+  return header;
+}
+
+bool verify(const Header &header, const char *payload) {
+  return FNV1a::hash32(payload, header.stored_size) ==
+         header.checksum;
+}
+
+bool decode(
+    const Header &header,
+    const char *payload,
+    char *out,
+    const Dictionary *dictionary) {
+  if (!verify(header, payload))
+    return false;
+
+  switch (header.codec) {
+  case None:
+    if (header.stored_size != header.raw_size)
+      return false;
+
+    memcpy(out, payload, header.raw_size);
+    return true;
+  case LZ4:
+    return LZ4_decompress_safe(
+               payload,
+               out,
+               (int)header.stored_size,
+               (int)header.raw_size) == (int)header.raw_size;
+  case Zstd: {
+    size_t size;
+
+    if (header.dictionary) {
+      if (!dictionary || dictionary->id != header.dictionary)
+        return false;
+
+      size = ZSTD_decompress_usingDDict(
+          contexts.dctx,
+          out,
+          header.raw_size,
+          payload,
+          header.stored_size,
+          dictionary->_ddict);
+    } else
+      size = ZSTD_decompressDCtx(
+          contexts.dctx,
+          out,
+          header.raw_size,
+          payload,
+          header.stored_size);
+
+    return !ZSTD_isError(size) && size == header.raw_size;
+  }
+  default:
+    return false;
+  }
+}
+} // namespace Compression
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
@@ -0,0 +1,594 @@
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <regex>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "../../../header/app/shared/remote.hpp"
+#include "../../../header/utils/log.hpp"
+
+namespace Onyx {
+namespace App {
+namespace Shared {
+// The number of requests sent before reading their responses.
+static const size_t PIPELINE_DEPTH = 16;
+
+// A remote which does not respond in time is considered failed.
+static const int SOCKET_TIMEOUT_S = 30;
+
+static const size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+
+// Larger bodies are rejected, as an entry is never that large.
+static const size_t MAX_BODY_SIZE = size_t(2) << 30;
+
+#ifdef _WIN32
+using Socket = SOCKET;
+static const Socket NO_SOCKET = INVALID_SOCKET;
+#else
+using Socket = int;
+static const Socket NO_SOCKET = -1;
+#endif
+
+// A blocking HTTP/1.1 client connection.
+class Connection {
+public:
+  struct Response {
+    int status;
+    string body;
+  };
+
+  Connection(const string &host, const string &port) {
+#ifdef _WIN32
+    static once_flag wsa;
+
+    call_once(wsa, []() {
+      WSADATA data;
+      WSAStartup(MAKEWORD(2, 2), &data);
+    });
+#endif
+
+    addrinfo hints = {}, *addresses;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (auto err =
+            getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses))
+      throw Remote::Error{
+          "Failed to resolve " + host + ": " + gai_strerror(err)};
+
+    for (auto addr = addresses; addr; addr = addr->ai_next) {
+      _socket =
+          socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+      if (_socket == NO_SOCKET)
+        continue;
+
+      if (!connect(_socket, addr->ai_addr, (int)addr->ai_addrlen))
+        break;
+
+      _close();
+    }
+
+    freeaddrinfo(addresses);
+
+    if (_socket == NO_SOCKET)
+      throw Remote::Error{"Failed to connect to " + host + ":" + port};
+
+#ifdef _WIN32
+    DWORD timeout = SOCKET_TIMEOUT_S * 1000;
+#else
+    timeval timeout = {SOCKET_TIMEOUT_S, 0};
+#endif
+
+    setsockopt(
+        _socket,
+        SOL_SOCKET,
+        SO_RCVTIMEO,
+        (const char *)&timeout,
+        sizeof(timeout));
+
+    setsockopt(
+        _socket,
+        SOL_SOCKET,
+        SO_SNDTIMEO,
+        (const char *)&timeout,
+        sizeof(timeout));
+  }
+
+  ~Connection() { _close(); }
+
+  void send(const string &data) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    for (size_t sent = 0; sent < data.size();) {
+      auto n = ::send(
+          _socket,
+          data.data() + sent,
+          (int)min<size_t>(data.size() - sent, RECEIVE_CHUNK_SIZE),
+          flags);
+
+      if (n <= 0)
+        throw Remote::Error{"Failed to send a request"};
+
+      sent += n;
+    }
+  }
+
+  // Receive the next response. Its body is delimited either by
+  // a `Content-Length` header, by chunked transfer encoding
+  // or by the connection closing.
+  Response receive() {
+    size_t header_end;
+
+    while ((header_end = _buffer.find("\r\n\r\n")) == string::npos)
+      if (!_read())
+        throw Remote::Error{"Connection closed unexpectedly"};
+
+    stringstream head(_buffer.substr(0, header_end));
+    _buffer.erase(0, header_end + 4);
+
+    string version, line;
+    Response response = {};
+    head >> version >> response.status;
+    getline(head, line);
+
+    optional<size_t> length;
+    bool is_chunked = false, is_closing = false;
+
+    while (getline(head, line)) {
+      auto colon = line.find(':');
+
+      if (colon == string::npos)
+        continue;
+
+      auto name = line.substr(0, colon);
+      auto value = line.substr(colon + 1);
+
+      for (auto &c : name)
+        c = tolower(c);
+
+      for (auto &c : value)
+        c = tolower(c);
+
+      if (name == "content-length")
+        length = _parse_size(value, 10);
+      else if (name == "transfer-encoding" &&
+               value.find("chunked") != string::npos)
+        is_chunked = true;
+      else if (name == "connection" &&
+               value.find("close") != string::npos)
+        is_closing = true;
+    }
+
+    if (response.status == 204 || response.status == 304) {
+      length = 0;
+      is_chunked = false;
+    }
+
+    // Chunked encoding overrides the length
+    if (is_chunked)
+      response.body = _receive_chunked();
+    else if (length) {
+      while (_buffer.size() < length.value())
+        if (!_read())
+          throw Remote::Error{"Connection closed unexpectedly"};
+
+      response.body = _buffer.substr(0, length.value());
+      _buffer.erase(0, length.value());
+    } else {
+      while (_read())
+        ;
+
+      response.body = move(_buffer);
+      _buffer.clear();
+      is_closing = true;
+    }
+
+    if (is_closing)
+      _close();
+
+    return response;
+  }
+
+  bool is_open() { return _socket != NO_SOCKET; }
+
+private:
+  Socket _socket = NO_SOCKET;
+
+  // Received, but not consumed yet.
+  string _buffer;
+
+  // Decode a chunked body, i.e. hex-sized chunks terminated
+  // by an empty one, followed by optional trailers.
+  string _receive_chunked() {
+    string body;
+
+    while (true) {
+      auto line = _receive_line();
+
+      // Chunk extensions are ignored
+      auto size = _parse_size(line.substr(0, line.find(';')), 16);
+
+      if (!size)
+        break;
+
+      if (body.size() + size > MAX_BODY_SIZE)
+        throw Remote::Error{"Chunked body is too large"};
+
+      while (_buffer.size() < size + 2)
+        if (!_read())
+          throw Remote::Error{"Connection closed unexpectedly"};
+
+      if (_buffer.compare(size, 2, "\r\n"))
+        throw Remote::Error{"Malformed chunk"};
+
+      body.append(_buffer, 0, size);
+      _buffer.erase(0, size + 2);
+    }
+
+    // Skip trailers until an empty line
+    while (!_receive_line().empty())
+      ;
+
+    return body;
+  }
+
+  // Receive a CRLF-terminated line, excluding the terminator.
+  string _receive_line() {
+    size_t end;
+
+    while ((end = _buffer.find("\r\n")) == string::npos)
+      if (!_read())
+        throw Remote::Error{"Connection closed unexpectedly"};
+
+    auto line = _buffer.substr(0, end);
+    _buffer.erase(0, end + 2);
+    return line;
+  }
+
+  // Parse a header size value in *base*, ignoring surrounding
+  // whitespace. A remote is not trusted, thus a malformed
+  // or an unreasonably large size is a transport failure.
+  static size_t _parse_size(const string &value, int base) {
+    auto begin = value.find_first_not_of(" \t");
+    auto end = value.find_last_not_of(" \t") + 1;
+    size_t size;
+
+    if (begin == string::npos)
+      throw Remote::Error{"Missing size in a response"};
+
+    auto [ptr, ec] = from_chars(
+        value.data() + begin, value.data() + end, size, base);
+
+    if (ec != errc() || ptr != value.data() + end)
+      throw Remote::Error{
+          "Malformed size in a response: " +
+          value.substr(begin, end - begin)};
+
+    if (size > MAX_BODY_SIZE)
+      throw Remote::Error{"Response body is too large"};
+
+    return size;
+  }
+
+  // Read another chunk into the buffer,
+  // returning `false` if the connection is closed.
+  bool _read() {
+    if (_socket == NO_SOCKET)
+      return false;
+
+    char chunk[RECEIVE_CHUNK_SIZE];
+    auto n = recv(_socket, chunk, sizeof(chunk), 0);
+
+    if (n < 0)
+      throw Remote::Error{"Failed to receive a response"};
+
+    _buffer.append(chunk, n);
+    return n > 0;
+  }
+
+  void _close() {
+    if (_socket == NO_SOCKET)
+      return;
+
+#ifdef _WIN32
+    closesocket(_socket);
+#else
+    ::close(_socket);
+#endif
+
+    _socket = NO_SOCKET;
+  }
+};
+
+Remote::Uploader::Uploader(Remote &remote) :
+    _remote(remote), _is_stopped(false) {
+  _thread = thread(&Uploader::_work, this);
+}
+
+Remote::Uploader::~Uploader() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _is_stopped = true;
+  }
+
+  _cv.notify_one();
+  _thread.join();
+}
+
+void Remote::Uploader::enqueue(string target, string key, string data) {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _queue.push_back(Upload{target, key, move(data)});
+  }
+
+  _cv.notify_one();
+}
+
+void Remote::Uploader::_work() {
+  while (true) {
+    Upload upload;
+
+    {
+      unique_lock<mutex> lock(_mutex);
+      _cv.wait(lock, [&]() { return _is_stopped || !_queue.empty(); });
+
+      // Drain the queue before stopping
+      if (_queue.empty())
+        return;
+
+      upload = move(_queue.front());
+      _queue.pop_front();
+    }
+
+    try {
+      _remote.put(upload.target, upload.key, upload.data);
+      ltrace() << "[Remote::Uploader] Put " << upload.key;
+    } catch (Error &e) {
+      lwarn() << "[Remote::Uploader] Failed to put " << upload.key
+              << ": " << e.message;
+    }
+  }
+}
+
+unique_ptr<Remote> Remote::open(const string &url) {
+  smatch sm;
+
+  if (regex_match(
+          url, sm, regex("^http://([^/:]+)(?::(\\d+))?(/.*)?$"))) {
+    auto prefix = sm[3].str();
+
+    // Would be joined with a slash
+    while (!prefix.empty() && prefix.back() == '/')
+      prefix.pop_back();
+
+    return make_unique<HTTPRemote>(
+        sm[1].str(), sm[2].matched ? sm[2].str() : "80", prefix);
+  } else if (regex_match(url, sm, regex("^file://(.+)$")))
+    return make_unique<FilesystemRemote>(sm[1].str());
+  else if (url.find("://") != string::npos)
+    throw Error{"Unsupported remote cache URL " + url};
+  else
+    return make_unique<FilesystemRemote>(url);
+}
+
+vector<optional<string>> Remote::get_many(
+    const string &target,
+    const vector<string> &keys,
+    unsigned short workers) {
+  vector<optional<string>> results(keys.size());
+  atomic<size_t> next = 0;
+
+  auto work = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < keys.size();) {
+      try {
+        results[i] = get(target, keys[i]);
+      } catch (Error &e) {
+        lwarn() << "[Remote::get_many] Failed to get " << keys[i]
+                << ": " << e.message;
+      }
+    }
+  };
+
+  vector<thread> threads;
+
+  for (size_t i = 1; i < min<size_t>(workers, keys.size()); i++)
+    threads.push_back(thread(work));
+
+  work();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  return results;
+}
+
+FilesystemRemote::FilesystemRemote(filesystem::path root) :
+    root(root) {}
+
+optional<string>
+FilesystemRemote::get(const string &target, const string &key) {
+  ifstream file(_path(target, key), ios::binary);
+
+  if (!file)
+    return nullopt;
+
+  return string(istreambuf_iterator<char>(file), {});
+}
+
+void FilesystemRemote::put(
+    const string &target, const string &key, const string &data) {
+  auto path = _path(target, key);
+
+  if (filesystem::exists(path))
+    return;
+
+  error_code ec;
+  filesystem::create_directories(path.parent_path(), ec);
+
+  if (ec)
+    throw Error{"Failed to create " + path.parent_path().string()};
+
+  // A concurrent reader must never see a partial entry
+  auto temp = path;
+  temp += "." + to_string(random_device()()) + ".tmp";
+
+  {
+    ofstream file(temp, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+
+    if (!file) {
+      filesystem::remove(temp, ec);
+      throw Error{"Failed to write " + temp.string()};
+    }
+  }
+
+  filesystem::rename(temp, path, ec);
+
+  if (ec) {
+    filesystem::remove(temp, ec);
+    throw Error{"Failed to rename " + temp.string()};
+  }
+}
+
+filesystem::path
+FilesystemRemote::_path(const string &target, const string &key) {
+  // Avoid too many files in a single directory
+  return root / target / key.substr(0, 2) / key.substr(2);
+}
+
+HTTPRemote::HTTPRemote(string host, string port, string prefix) :
+    host(host), port(port), prefix(prefix) {}
+
+optional<string>
+HTTPRemote::get(const string &target, const string &key) {
+  Connection connection(host, port);
+  connection.send(_request("GET", target, key));
+  auto response = connection.receive();
+
+  if (response.status == 200)
+    return response.body;
+  else if (response.status == 404)
+    return nullopt;
+  else
+    throw Error{"GET responded with " + to_string(response.status)};
+}
+
+void HTTPRemote::put(
+    const string &target, const string &key, const string &data) {
+  Connection connection(host, port);
+  connection.send(_request("PUT", target, key, &data));
+  auto response = connection.receive();
+
+  if (response.status < 200 || response.status >= 300)
+    throw Error{"PUT responded with " + to_string(response.status)};
+}
+
+vector<optional<string>> HTTPRemote::get_many(
+    const string &target,
+    const vector<string> &keys,
+    unsigned short workers) {
+  vector<optional<string>> results(keys.size());
+  atomic<size_t> next = 0;
+
+  // Every worker takes a window of keys at a time, sends all its
+  // requests at once and then reads the responses in order
+  auto work = [&]() {
+    unique_ptr<Connection> connection;
+
+    while (true) {
+      auto begin = next.fetch_add(PIPELINE_DEPTH);
+
+      if (begin >= keys.size())
+        break;
+
+      auto end = min(begin + PIPELINE_DEPTH, keys.size());
+
+      // The server may close a keep-alive connection any time,
+      // so unanswered requests are resent once on a new one
+      for (int attempt = 0; attempt < 2 && begin < end; attempt++) {
+        try {
+          if (!connection || !connection->is_open())
+            connection = make_unique<Connection>(host, port);
+
+          string requests;
+
+          for (auto i = begin; i < end; i++)
+            requests += _request("GET", target, keys[i]);
+
+          connection->send(requests);
+
+          for (; begin < end; begin++) {
+            if (!connection->is_open())
+              break;
+
+            auto response = connection->receive();
+
+            if (response.status == 200)
+              results[begin] = move(response.body);
+            else if (response.status != 404)
+              lwarn() << "[HTTPRemote::get_many] GET " << keys[begin]
+                      << " responded with " << response.status;
+          }
+        } catch (Error &e) {
+          lwarn() << "[HTTPRemote::get_many] " << e.message;
+          connection.reset();
+        }
+      }
+    }
+  };
+
+  vector<thread> threads;
+  auto windows = (keys.size() + PIPELINE_DEPTH - 1) / PIPELINE_DEPTH;
+
+  for (size_t i = 1; i < min<size_t>(workers, windows); i++)
+    threads.push_back(thread(work));
+
+  work();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  return results;
+}
+
+string HTTPRemote::_request(
+    const string &method,
+    const string &target,
+    const string &key,
+    const string *body) {
+  stringstream ss;
+
+  ss << method << ' ' << prefix << '/' << target << '/' << key
+     << " HTTP/1.1\r\n"
+     << "Host: " << host << ':' << port << "\r\n"
+     << "User-Agent: fnxc\r\n";
+
+  if (body)
+    ss << "Content-Type: application/octet-stream\r\n"
+       << "Content-Length: " << body->size() << "\r\n\r\n"
+       << *body;
+  else
+    ss << "\r\n";
+
+  return ss.str();
+}
+} // namespace Shared
+} // namespace App
+} // namespace Onyx
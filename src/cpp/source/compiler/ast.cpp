@@ -1,64 +1,183 @@
-#include "./sast.hpp"
-#include <iterator>
+#include "../../header/compiler/ast.hpp"
+#include "../../header/compiler/visitor.hpp"
 
 namespace Onyx {
+namespace Compiler {
 namespace AST {
-void Declaration::dump(wostream *buffer, unsigned short tabs) {
-  *buffer << AST::tabs(tabs) << L"DECLARATION";
-}
+vector<const NamedArgument *> Arguments::sorted_named() const {
+  vector<const NamedArgument *> sorted;
+
+  for (auto &arg : named_arguments)
+    sorted.push_back(&arg);
 
-void Namespace::dump(wostream *buffer, unsigned short tabs) {
-  bool top_level = parent_namespace.get();
+  auto &interner = Interner::global();
 
-  if (top_level)
-    *buffer << AST::tabs(tabs) << L"namespace " << name << "\n";
+  sort(sorted.begin(), sorted.end(), [&](auto a, auto b) {
+    return interner.lookup(a->name) < interner.lookup(b->name);
+  });
 
-  auto function = functions.begin();
+  return sorted;
+}
 
-  while (function != functions.end()) {
-    (*function)->dump(buffer, tabs + (top_level && 1 || 0));
-    function++;
+const char *kind_name(Kind kind) {
+  switch (kind) {
+  case Kind::Empty:
+    return "Empty";
+  case Kind::Root:
+    return "Root";
+  case Kind::Namespace:
+    return "Namespace";
+  case Kind::Module:
+    return "Module";
+  case Kind::Enum:
+    return "Enum";
+  case Kind::Annotation:
+    return "Annotation";
+  case Kind::FunctionDefinition:
+    return "FunctionDefinition";
+  case Kind::FunctionDeclaration:
+    return "FunctionDeclaration";
+  case Kind::FunctionPrototype:
+    return "FunctionPrototype";
+  case Kind::FunctionArgumentDeclaration:
+    return "FunctionArgumentDeclaration";
+  case Kind::AnnotationApplication:
+    return "AnnotationApplication";
+  case Kind::Body:
+    return "Body";
+  case Kind::NamedArgument:
+    return "NamedArgument";
+  case Kind::ID:
+    return "ID";
+  case Kind::Splat:
+    return "Splat";
+  case Kind::Binop:
+    return "Binop";
+  case Kind::Unop:
+    return "Unop";
+  case Kind::Ternary:
+    return "Ternary";
+  case Kind::Call:
+    return "Call";
+  case Kind::Literal:
+    return "Literal";
   }
 
-  if (top_level)
-    *buffer << AST::tabs(tabs) << L"end\n";
+  throw "BUG! Unknown node kind";
 }
 
-void FunctionDefinition::dump(wostream *buffer, unsigned short tabs) {
-  *buffer << AST::tabs(tabs) << L"def ";
-  prototype->dump(buffer, tabs);
-  *buffer << AST::tabs(tabs) << L"end\n";
-}
+// Dumps nodes in the order and with the data of `Tree` nodes,
+// including `Empty` for missing optional children.
+struct Dumper : Visitor<Dumper> {
+  ostream *out;
+  unsigned short tab;
 
-void Body::dump(wostream *buffer, unsigned short tabs) {}
+  Dumper(ostream *out, unsigned short tab) : out(out), tab(tab) {}
 
-void FunctionPrototype::dump(wostream *buffer, unsigned short tabs) {
-  if (holds_alternative<shared_ptr<Token::ID>>(name))
-    *buffer << get<shared_ptr<Token::ID>>(name)->value;
-  else
-    *buffer << get<shared_ptr<Token::Op>>(name)->value;
+  bool enter(Node *node) {
+    *out << string(tab * 2, ' ');
 
-  if (args.size() > 0) {
-    *buffer << "(";
-    auto arg = args.begin();
+    if (!node) {
+      *out << kind_name(Kind::Empty) << '\n';
+      return false;
+    }
 
-    while (arg != args.end()) {
-      (*arg)->dump(buffer, tabs + 1);
-      arg++;
+    *out << kind_name(node->kind);
+    _line(node);
+    *out << '\n';
 
-      if (arg != args.end())
-        *buffer << ", ";
-    }
+    tab++;
+    return true;
+  }
+
+  void leave(Node *) { tab--; }
 
-    *buffer << ")";
+  // Named arguments are wrapped in `NamedArgument` lines
+  bool enter_named(const NamedArgument &arg) {
+    *out << string(tab * 2, ' ') << kind_name(Kind::NamedArgument)
+         << ' ' << Interner::global().lookup(arg.name) << '\n';
+
+    tab++;
+    return true;
   }
 
-  *buffer << "\n";
-}
+  void leave_named(const NamedArgument &) { tab--; }
+
+private:
+  // Print the token and the data of a *node*, if any.
+  void _line(Node *node) {
+    shared_ptr<Token::Value> token;
+    uint32_t data = 0;
+
+    switch (node->kind) {
+    case Kind::Root:
+    case Kind::Namespace:
+    case Kind::Module: {
+      auto &name = static_cast<Namespace *>(node)->name;
+
+      if (!name.empty())
+        *out << ' ' << name;
+
+      return;
+    }
+
+    case Kind::FunctionPrototype:
+      token = static_cast<FunctionPrototype *>(node)->name;
+      break;
+
+    case Kind::FunctionArgumentDeclaration: {
+      auto arg = static_cast<FunctionArgumentDeclaration *>(node);
+      token = arg->name;
+      data = uint32_t(arg->type) << 1 | arg->is_const;
+      break;
+    }
+
+    case Kind::AnnotationApplication: {
+      auto annotation = static_cast<AnnotationApplication *>(node);
+      token = annotation->id;
+      data = annotation->args.ordered_arguments.size();
+      break;
+    }
+
+    case Kind::ID:
+      token = static_cast<ID *>(node)->value;
+      break;
+
+    case Kind::Splat:
+      token = static_cast<Splat *>(node)->id;
+      data = static_cast<Splat *>(node)->is_named;
+      break;
+
+    case Kind::Binop:
+      token = static_cast<Binop *>(node)->op;
+      break;
+
+    case Kind::Unop:
+      token = static_cast<Unop *>(node)->op;
+      break;
+
+    case Kind::Call: {
+      auto call = static_cast<Call *>(node);
+      token = call->callee;
+      data = call->args.ordered_arguments.size();
+      break;
+    }
+
+    default:
+      break;
+    }
+
+    if (token)
+      *out << ' ' << token->value;
+
+    if (data)
+      *out << " #" << data;
+  }
+};
 
-void FunctionArgumentDeclaration::dump(
-    wostream *buffer, unsigned short tabs) {
-  *buffer << name->value;
+void Node::dump(ostream *out, unsigned short tab) {
+  Dumper(out, tab).visit(this);
 }
 } // namespace AST
+} // namespace Compiler
 } // namespace Onyx
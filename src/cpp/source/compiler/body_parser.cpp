@@ -0,0 +1,233 @@
+#include <set>
+
+#include "../../header/compiler/body_parser.hpp"
+#include "../../header/compiler/expression_parser.hpp"
+#include "../../header/utils/log.hpp"
+
+namespace Onyx {
+namespace Compiler {
+// IDs opening a block ending with `end` when beginning a statement
+// or an expression. The lexer does not tell keywords apart yet.
+static const set<string> OPENING = {
+    "if", "unless", "while", "until", "begin", "case", "asm"};
+
+// Keywords followed by an expression, e.g. `return if x ...`.
+static const set<string> LEADING = {
+    "return", "convey", "yield", "raise", "then", "else"};
+
+static Token::Value *as_id(const shared_ptr<Token::Base> &token) {
+  auto value = dynamic_cast<Token::Value *>(token.get());
+  return value && value->kind == Token::Value::ID ? value : nullptr;
+}
+
+static bool is(
+    const shared_ptr<Token::Base> &token, Token::Control::Kind kind) {
+  auto control = dynamic_cast<Token::Control *>(token.get());
+  return control && control->kind == kind;
+}
+
+void BodyParser::skip(
+    size_t &cursor, AST::FunctionDefinition *definition) {
+  const auto end = end_of(cursor);
+
+  definition->body_begin = cursor;
+  definition->body_end = end;
+  cursor = end + 1;
+}
+
+size_t BodyParser::end_of(size_t begin) const {
+  auto &tokens = _unit.tokens;
+  unsigned depth = 1;
+
+  for (auto cursor = begin; cursor < tokens.size(); cursor++) {
+    auto id = as_id(tokens[cursor]);
+
+    if (!id)
+      continue;
+
+    const bool is_end = id->value == "end";
+
+    if (!is_end && id->value != "do" && !OPENING.contains(id->value))
+      continue;
+
+    // `x.end` and `x.do` are calls
+    auto previous = _previous(cursor, begin);
+
+    if (previous && is(tokens[*previous], Token::Control::Dot))
+      continue;
+
+    if (is_end) {
+      if (--depth == 0)
+        return cursor;
+    } else if (id->value == "do" || _is_opening(cursor, begin))
+      depth++;
+  }
+
+  throw Error{
+      begin < tokens.size() ? tokens[begin] : nullptr,
+      "Expected `end` of the block"};
+}
+
+size_t BodyParser::statement_end(size_t begin) const {
+  auto &tokens = _unit.tokens;
+  size_t brackets = 0;
+
+  for (auto cursor = begin; cursor < tokens.size(); cursor++) {
+    if (auto control =
+            dynamic_cast<Token::Control *>(tokens[cursor].get())) {
+      switch (control->kind) {
+      case Token::Control::OpenParen:
+      case Token::Control::OpenCurly:
+      case Token::Control::OpenSquare:
+        brackets++;
+        break;
+      case Token::Control::CloseParen:
+      case Token::Control::CloseCurly:
+      case Token::Control::CloseSquare:
+        if (brackets)
+          brackets--;
+        break;
+      case Token::Control::Newline:
+      case Token::Control::Semicolon:
+        if (!brackets)
+          return cursor;
+        break;
+      default:
+        break;
+      }
+
+      continue;
+    }
+
+    auto id = as_id(tokens[cursor]);
+
+    if (!id || (id->value != "do" && !OPENING.contains(id->value)))
+      continue;
+
+    auto previous = _previous(cursor, begin);
+
+    if (previous && is(tokens[*previous], Token::Control::Dot))
+      continue;
+
+    if (id->value == "do" || _is_opening(cursor, begin))
+      cursor = end_of(cursor + 1);
+  }
+
+  return tokens.size();
+}
+
+AST::Body *BodyParser::parse(AST::FunctionDefinition *definition) {
+  lock_guard<mutex> lock(_unit.bodies_mutex);
+
+  if (!definition->is_lazy())
+    return definition->body;
+
+  ltrace() << "[BodyParser::parse] Parsing the body of "
+           << definition->prototype->name->value;
+
+  auto tokens = span(_unit.tokens).subspan(
+      definition->body_begin,
+      definition->body_end - definition->body_begin);
+
+  auto body = _unit.arena.make<AST::Body>();
+  size_t cursor = 0;
+
+  try {
+    while (true) {
+      // Skip statement terminators
+      while (cursor < tokens.size()) {
+        auto control =
+            dynamic_cast<Token::Control *>(tokens[cursor].get());
+
+        if (control
+                ? !(control->kind == Token::Control::Space ||
+                    control->kind == Token::Control::Newline ||
+                    control->kind == Token::Control::Comment ||
+                    control->kind == Token::Control::Semicolon)
+                : !Token::is_comment(tokens, cursor))
+          break;
+
+        cursor++;
+      }
+
+      if (cursor == tokens.size())
+        break;
+
+      auto parser = ExpressionParser(_unit.arena, tokens, cursor);
+      body->expressions.push_back(parser.parse());
+
+      if (cursor < tokens.size() &&
+          !is(tokens[cursor], Token::Control::Newline) &&
+          !is(tokens[cursor], Token::Control::Semicolon))
+        throw Error{tokens[cursor], "Unexpected token"};
+    }
+  } catch (ExpressionParser::Error error) {
+    throw Error{error.token, error.reason};
+  }
+
+  definition->body = body;
+  return body;
+}
+
+void BodyParser::parse_all(AST::Namespace *ns) {
+  for (auto function : ns->functions)
+    parse(function);
+
+  for (auto child : ns->namespaces)
+    parse_all(child);
+}
+
+optional<size_t>
+BodyParser::_previous(size_t index, size_t begin) const {
+  while (index > begin) {
+    auto &token = _unit.tokens[--index];
+
+    if (is(token, Token::Control::Space) ||
+        is(token, Token::Control::Comment))
+      continue;
+
+    if (is(token, Token::Control::Newline))
+      return nullopt;
+
+    return index;
+  }
+
+  return nullopt;
+}
+
+bool BodyParser::_is_opening(size_t index, size_t begin) const {
+  if (!OPENING.contains(as_id(_unit.tokens[index])->value))
+    return false;
+
+  auto previous = _previous(index, begin);
+
+  if (!previous)
+    return true;
+
+  // Not a modifier, i.e. not after an operand
+  auto &token = _unit.tokens[*previous];
+
+  if (auto value = dynamic_cast<Token::Value *>(token.get())) {
+    if (value->kind == Token::Value::ID)
+      return LEADING.contains(value->value);
+
+    return value->kind == Token::Value::Op ||
+           value->kind == Token::Value::Kwarg;
+  }
+
+  if (auto control = dynamic_cast<Token::Control *>(token.get()))
+    switch (control->kind) {
+    case Token::Control::CloseParen:
+    case Token::Control::CloseCurly:
+    case Token::Control::CloseSquare:
+    case Token::Control::DoubleQuotes:
+    case Token::Control::SingleQuote:
+      return false;
+    default:
+      return true;
+    }
+
+  return false; // A literal
+}
+} // namespace Compiler
+} // namespace Onyx
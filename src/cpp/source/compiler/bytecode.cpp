@@ -0,0 +1,997 @@
+#include "../../header/compiler/bytecode.hpp"
+#include "../../header/compiler/location.hpp"
+
+namespace Onyx {
+namespace Compiler {
+namespace Bytecode {
+// Bump it on every format change. Data of
+// a different version is deemed malformed.
+static const uint8_t VERSION = 3;
+
+// Types of tokens of lazy bodies.
+enum class TokenType : uint8_t {
+  Control,
+  Keyword,
+  Value,
+  CharLiteral,
+  StringLiteral,
+  NumericLiteral,
+  PercentLiteral,
+};
+
+class Writer {
+  const vector<shared_ptr<Token::Base>> &_tokens;
+
+public:
+  // Children of a node, in the order they are written.
+  using Children = SmallVector<const AST::Node *, 8>;
+
+  string out;
+
+  // Lazy bodies are written as their *tokens*.
+  explicit Writer(const vector<shared_ptr<Token::Base>> &tokens) :
+      _tokens(tokens) {}
+
+  void byte(uint8_t value) { out.push_back(char(value)); }
+
+  // An unsigned LEB128 number.
+  void number(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      this->byte(value ? byte | 0x80 : byte);
+    } while (value);
+  }
+
+  void text(string_view value) {
+    number(value.size());
+    out.append(value);
+  }
+
+  void hash(const FNV1a::Hash128 &hash) {
+    number(hash.high);
+    number(hash.low);
+  }
+
+  void location(const Location &location) {
+    number(location.begin.row);
+    number(location.begin.col);
+    number(location.end.row);
+    number(location.end.col);
+  }
+
+  void token(const shared_ptr<Token::Value> &token) {
+    if (!token) {
+      byte(0);
+      return;
+    }
+
+    byte(1);
+    byte(token->kind);
+    text(token->value);
+    location(token->location);
+  }
+
+  void codepoint(const Token::Codepoint &codepoint) {
+    location(codepoint.location);
+    byte(codepoint.kind);
+    number(codepoint.value);
+    text(codepoint._source);
+  }
+
+  void chars(const vector<char> &chars) {
+    text(string_view(chars.data(), chars.size()));
+  }
+
+  // Write a token of any type, e.g. of a lazy body.
+  void unit_token(const Token::Base *token) {
+    using namespace Token;
+
+    if (auto control = dynamic_cast<const Control *>(token)) {
+      byte(uint8_t(TokenType::Control));
+      byte(control->kind);
+    } else if (auto keyword = dynamic_cast<const Keyword *>(token)) {
+      byte(uint8_t(TokenType::Keyword));
+      byte(keyword->kind);
+    } else if (auto value = dynamic_cast<const Value *>(token)) {
+      byte(uint8_t(TokenType::Value));
+      byte(value->kind);
+      text(value->value);
+    } else if (
+        auto character = dynamic_cast<const CharLiteral *>(token)) {
+      byte(uint8_t(TokenType::CharLiteral));
+      codepoint(character->codepoint);
+    } else if (
+        auto quoted = dynamic_cast<const StringLiteral *>(token)) {
+      byte(uint8_t(TokenType::StringLiteral));
+      number(quoted->codepoints.size());
+
+      for (auto &element : quoted->codepoints)
+        if (auto linebreak = get_if<Linebreak>(&element)) {
+          byte(0);
+          location(linebreak->location);
+        } else {
+          byte(1);
+          codepoint(get<Codepoint>(element));
+        }
+    } else if (
+        auto numeric = dynamic_cast<const NumericLiteral *>(token)) {
+      byte(uint8_t(TokenType::NumericLiteral));
+      byte(numeric->radix);
+      chars(numeric->whole);
+
+      byte(numeric->fraction.has_value());
+      if (numeric->fraction)
+        chars(*numeric->fraction);
+
+      // Two's complement, as 32 bits
+      byte(numeric->exponent.has_value());
+      if (numeric->exponent)
+        number(uint32_t(*numeric->exponent));
+
+      byte(numeric->type);
+      number(numeric->bitsize);
+    } else if (
+        auto percent = dynamic_cast<const PercentLiteral *>(token)) {
+      byte(uint8_t(TokenType::PercentLiteral));
+      byte(percent->type);
+      byte(percent->bracket);
+      byte(percent->numeric_radix);
+      byte(percent->numeric_type);
+      number(percent->numeric_bitsize);
+    } else
+      throw "BUG! Unexpected token to encode";
+
+    location(token->location);
+  }
+
+  void arguments(const AST::Arguments &args, Children &children) {
+    number(args.ordered_arguments.size());
+
+    for (auto arg : args.ordered_arguments)
+      children.push_back(arg);
+
+    // By name, so that equal sources encode equally
+    auto named = args.sorted_named();
+    number(named.size());
+
+    for (auto arg : named) {
+      text(Interner::global().lookup(arg->name));
+      children.push_back(arg->value);
+    }
+  }
+
+  // Write a *root* node and its subtree. Pending nodes are kept
+  // on an explicit stack, so that a deep tree (e.g. of a long
+  // operator chain) would not overflow the native stack.
+  void tree(const AST::Node *root) {
+    vector<const AST::Node *> stack = {root};
+    Children children;
+
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+
+      children.clear();
+      this->node(node, children);
+
+      for (auto i = children.size(); i > 0; i--)
+        stack.push_back(children[i - 1]);
+    }
+  }
+
+  // Write the kind, the fields and the child counts
+  // of a *node*, collecting its *children*.
+  void node(const AST::Node *node, Children &children) {
+    using namespace AST;
+
+    if (!node) {
+      byte(uint8_t(Kind::Empty));
+      return;
+    }
+
+    byte(uint8_t(node->kind));
+
+    switch (node->kind) {
+    case Kind::Root:
+    case Kind::Namespace:
+    case Kind::Module: {
+      auto ns = static_cast<const Namespace *>(node);
+
+      hash(ns->hash);
+      text(ns->name);
+
+      number(ns->functions.size());
+      for (auto function : ns->functions)
+        children.push_back(function);
+
+      number(ns->namespaces.size());
+      for (auto child : ns->namespaces)
+        children.push_back(child);
+
+      if (node->kind == Kind::Module) {
+        auto module = static_cast<const Module *>(node);
+
+        number(module->function_declarations.size());
+        for (auto declaration : module->function_declarations)
+          children.push_back(declaration);
+      }
+
+      break;
+    }
+
+    case Kind::FunctionDefinition: {
+      auto function = static_cast<const FunctionDefinition *>(node);
+
+      hash(function->hash);
+      hash(function->prototype_hash);
+      hash(function->body_hash);
+      children.push_back(function->prototype);
+
+      // A lazy body is written as its tokens, including the `end`
+      byte(function->is_lazy());
+
+      if (!function->is_lazy()) {
+        children.push_back(function->body);
+        break;
+      }
+
+      number(function->body_end - function->body_begin + 1);
+
+      for (auto i = function->body_begin; i <= function->body_end;
+           i++)
+        unit_token(_tokens[i].get());
+
+      break;
+    }
+
+    case Kind::FunctionDeclaration: {
+      auto function = static_cast<const FunctionDeclaration *>(node);
+
+      hash(function->hash);
+      children.push_back(function->prototype);
+
+      break;
+    }
+
+    case Kind::FunctionPrototype: {
+      auto proto = static_cast<const FunctionPrototype *>(node);
+
+      number(proto->annotations.size());
+      for (auto annotation : proto->annotations)
+        children.push_back(annotation);
+
+      number(proto->modifiers.size());
+      for (auto &modifier : proto->modifiers)
+        token(modifier);
+
+      token(proto->name);
+
+      number(proto->args.size());
+      for (auto arg : proto->args)
+        children.push_back(arg);
+
+      break;
+    }
+
+    case Kind::FunctionArgumentDeclaration: {
+      auto arg =
+          static_cast<const FunctionArgumentDeclaration *>(node);
+
+      number(arg->annotations.size());
+      for (auto annotation : arg->annotations)
+        children.push_back(annotation);
+
+      byte(arg->is_const);
+      byte(arg->type);
+      token(arg->alias);
+      token(arg->name);
+      children.push_back(arg->restriction);
+      children.push_back(arg->default_value);
+
+      break;
+    }
+
+    case Kind::AnnotationApplication: {
+      auto annotation =
+          static_cast<const AnnotationApplication *>(node);
+
+      token(annotation->id);
+      arguments(annotation->args, children);
+
+      break;
+    }
+
+    case Kind::Body: {
+      auto body = static_cast<const Body *>(node);
+
+      number(body->expressions.size());
+      for (auto expr : body->expressions)
+        children.push_back(expr);
+
+      break;
+    }
+
+    case Kind::ID:
+      token(static_cast<const ID *>(node)->value);
+      break;
+
+    case Kind::Splat: {
+      auto splat = static_cast<const Splat *>(node);
+
+      byte(splat->is_named);
+      token(splat->id);
+
+      break;
+    }
+
+    case Kind::Binop: {
+      auto binop = static_cast<const Binop *>(node);
+
+      token(binop->op);
+      children.push_back(binop->lhx);
+      children.push_back(binop->rhx);
+
+      break;
+    }
+
+    case Kind::Unop: {
+      auto unop = static_cast<const Unop *>(node);
+
+      token(unop->op);
+      children.push_back(unop->expr);
+
+      break;
+    }
+
+    case Kind::Ternary: {
+      auto ternary = static_cast<const Ternary *>(node);
+
+      children.push_back(ternary->cond);
+      children.push_back(ternary->then);
+      children.push_back(ternary->else_);
+
+      break;
+    }
+
+    case Kind::Call: {
+      auto call = static_cast<const Call *>(node);
+
+      token(call->modifiers);
+      token(call->callee);
+      children.push_back(call->caller);
+      arguments(call->args, children);
+
+      break;
+    }
+
+    case Kind::Literal:
+      break;
+
+    default:
+      throw "BUG! Unexpected SAST node to encode";
+    }
+  }
+};
+
+// Thrown by `Reader` on malformed data.
+struct Malformed {};
+
+class Reader {
+  // A node which children are being read. They are grouped in up
+  // to three consecutive ranges, e.g. functions, namespaces and
+  // function declarations of a module.
+  struct Open {
+    AST::Node *node;
+    size_t sizes[3] = {};
+    size_t read = 0; // Children read so far
+
+    // The index of the first named argument name in `_names`
+    size_t names = 0;
+
+    size_t size() const { return sizes[0] + sizes[1] + sizes[2]; }
+  };
+
+  const char *_cursor;
+  const char *const _end;
+
+  shared_ptr<Unit> _unit;
+
+  // Names of named arguments of open nodes, in the written order.
+  vector<Interner::Id> _names;
+
+public:
+  Reader(string_view data, shared_ptr<Unit> unit) :
+      _cursor(data.data()),
+      _end(data.data() + data.size()),
+      _unit(unit) {}
+
+  bool is_end() const { return _cursor == _end; }
+
+  uint8_t byte() {
+    if (_cursor == _end)
+      throw Malformed();
+
+    return uint8_t(*_cursor++);
+  }
+
+  uint64_t number() {
+    uint64_t value = 0;
+
+    for (unsigned shift = 0;; shift += 7) {
+      if (shift > 63)
+        throw Malformed();
+
+      auto byte = this->byte();
+      value |= uint64_t(byte & 0x7f) << shift;
+
+      if (!(byte & 0x80))
+        return value;
+    }
+  }
+
+  // Read an element count, each element taking at least a byte.
+  size_t count() {
+    auto count = number();
+
+    if (count > uint64_t(_end - _cursor))
+      throw Malformed();
+
+    return count;
+  }
+
+  string text() {
+    auto size = count();
+    string value(_cursor, size);
+    _cursor += size;
+
+    return value;
+  }
+
+  FNV1a::Hash128 hash() {
+    auto high = number();
+    return {high, number()};
+  }
+
+  // Read a byte as an enumerator up to the *last* one.
+  template <class T> T enumerator(T last) {
+    auto value = byte();
+
+    if (value > uint8_t(last))
+      throw Malformed();
+
+    return T(value);
+  }
+
+  Location location() {
+    // Arguments are evaluated in an unspecified order
+    Position begin, end;
+    begin.row = number();
+    begin.col = number();
+    end.row = number();
+    end.col = number();
+
+    return Location(_unit, begin, end);
+  }
+
+  shared_ptr<Token::Value> token() {
+    if (!byte())
+      return nullptr;
+
+    auto kind = enumerator(Token::Value::Text);
+    auto value = text();
+
+    return make_shared<Token::Value>(location(), kind, value);
+  }
+
+  Token::Codepoint codepoint() {
+    auto location = this->location();
+    auto kind = enumerator(Token::Codepoint::Hexadecimal);
+    auto value = number();
+
+    if (value > UINT32_MAX)
+      throw Malformed();
+
+    return Token::Codepoint(location, kind, value, text());
+  }
+
+  vector<char> chars() {
+    auto value = text();
+    return vector<char>(value.begin(), value.end());
+  }
+
+  // Read a token of any type, e.g. of a lazy body.
+  shared_ptr<Token::Base> unit_token() {
+    using namespace Token;
+
+    switch (enumerator(TokenType::PercentLiteral)) {
+    case TokenType::Control: {
+      auto kind = enumerator(Control::PipeArrow);
+      return make_shared<Control>(location(), kind);
+    }
+
+    case TokenType::Keyword: {
+      auto kind = enumerator(Keyword::Unordered);
+      return make_shared<Keyword>(location(), kind);
+    }
+
+    case TokenType::Value: {
+      auto kind = enumerator(Value::Text);
+      auto value = text();
+
+      return make_shared<Value>(location(), kind, value);
+    }
+
+    case TokenType::CharLiteral: {
+      auto codepoint = this->codepoint();
+      return make_shared<CharLiteral>(location(), codepoint);
+    }
+
+    case TokenType::StringLiteral: {
+      vector<variant<Linebreak, Codepoint>> codepoints;
+
+      for (auto i = count(); i > 0; i--)
+        if (byte())
+          codepoints.push_back(codepoint());
+        else
+          codepoints.push_back(Linebreak(location()));
+
+      return make_shared<StringLiteral>(location(), codepoints);
+    }
+
+    case TokenType::NumericLiteral: {
+      auto radix = enumerator(NumericLiteral::Hexa);
+      auto whole = chars();
+
+      optional<vector<char>> fraction;
+      if (byte())
+        fraction = chars();
+
+      optional<int> exponent;
+      if (byte())
+        exponent = int(uint32_t(number()));
+
+      auto type = enumerator(NumericLiteral::Float);
+      auto bitsize = uint32_t(number());
+
+      return make_shared<NumericLiteral>(
+          location(),
+          radix,
+          whole,
+          fraction,
+          exponent,
+          type,
+          bitsize);
+    }
+
+    case TokenType::PercentLiteral: {
+      auto type = enumerator(PercentLiteral::Numbers);
+      auto bracket = enumerator(PercentLiteral::Angle);
+      auto radix = enumerator(PercentLiteral::Hexa);
+      auto numeric_type = enumerator(PercentLiteral::Float);
+      auto bitsize = uint32_t(number());
+
+      return make_shared<PercentLiteral>(
+          location(),
+          type,
+          bracket,
+          radix,
+          numeric_type,
+          bitsize);
+    }
+    }
+
+    throw Malformed();
+  }
+
+  // Read a root node and its subtree, or `nullptr` if it is not
+  // a root. Open nodes are kept on an explicit stack, so that
+  // a deep tree would not overflow the native stack.
+  AST::Root *tree() {
+    if (AST::Kind(byte()) != AST::Kind::Root)
+      return nullptr;
+
+    auto root = _unit->arena.make<AST::Root>();
+    vector<Open> stack = {_namespace(root)};
+
+    while (!stack.empty()) {
+      auto &parent = stack.back();
+
+      if (parent.read == parent.size()) {
+        auto node = parent.node;
+        _names.resize(parent.names);
+        stack.pop_back();
+
+        if (!stack.empty())
+          _attach(stack.back(), node);
+
+        continue;
+      }
+
+      auto child = _read();
+
+      if (child.size())
+        stack.push_back(child);
+      else
+        _attach(parent, child.node);
+    }
+
+    return root;
+  }
+
+private:
+  // Read a node kind and fields, but its children. An empty node
+  // is returned as an open `nullptr` without children.
+  Open _read() {
+    using namespace AST;
+    auto &arena = _unit->arena;
+
+    switch (Kind(byte())) {
+    case Kind::Empty:
+      return {nullptr};
+
+    case Kind::Namespace:
+      return _namespace(arena.make<Namespace>());
+
+    case Kind::Module:
+      return _namespace(arena.make<Module>());
+
+    case Kind::FunctionDefinition: {
+      auto function = arena.make<FunctionDefinition>();
+
+      function->hash = hash();
+      function->prototype_hash = hash();
+      function->body_hash = hash();
+
+      if (!byte())
+        return {function, {1, 1}};
+
+      // A lazy body, appended to the unit tokens
+      auto &tokens = _unit->tokens;
+      auto size = count();
+
+      if (!size)
+        throw Malformed();
+
+      function->body_begin = tokens.size();
+
+      for (auto i = size; i > 0; i--)
+        tokens.push_back(unit_token());
+
+      function->body_end = tokens.size() - 1;
+
+      // There is nothing to parse, and a zero `body_end`
+      // would not mark the body lazy anyway
+      if (size == 1)
+        function->body = arena.make<Body>();
+
+      return {function, {1}};
+    }
+
+    case Kind::FunctionDeclaration: {
+      auto function = arena.make<FunctionDeclaration>();
+      function->hash = hash();
+      return {function, {1}};
+    }
+
+    case Kind::FunctionPrototype: {
+      auto proto = arena.make<FunctionPrototype>();
+      auto annotations = count();
+
+      for (auto i = count(); i > 0; i--)
+        proto->modifiers.push_back(token());
+
+      proto->name = token();
+
+      return {proto, {annotations, count()}};
+    }
+
+    case Kind::FunctionArgumentDeclaration: {
+      auto arg = arena.make<FunctionArgumentDeclaration>();
+      auto annotations = count();
+
+      arg->is_const = byte();
+      auto type = byte();
+
+      if (type > FunctionArgumentDeclaration::Kwargs)
+        throw Malformed();
+
+      arg->type = decltype(arg->type)(type);
+      arg->alias = token();
+      arg->name = token();
+
+      // The restriction and the default value
+      return {arg, {annotations, 2}};
+    }
+
+    case Kind::AnnotationApplication: {
+      auto annotation = arena.make<AnnotationApplication>();
+      annotation->id = token();
+      return _arguments(annotation, 0);
+    }
+
+    case Kind::Body:
+      return {arena.make<Body>(), {count()}};
+
+    case Kind::ID: {
+      auto id = arena.make<ID>();
+      id->value = token();
+      return {id};
+    }
+
+    case Kind::Splat: {
+      auto splat = arena.make<Splat>();
+
+      splat->is_named = byte();
+      splat->id = token();
+
+      return {splat};
+    }
+
+    case Kind::Binop: {
+      auto binop = arena.make<Binop>();
+      binop->op = token();
+      return {binop, {2}};
+    }
+
+    case Kind::Unop: {
+      auto unop = arena.make<Unop>();
+      unop->op = token();
+      return {unop, {1}};
+    }
+
+    case Kind::Ternary:
+      return {arena.make<Ternary>(), {3}};
+
+    case Kind::Call: {
+      auto call = arena.make<Call>();
+
+      call->modifiers = token();
+      call->callee = token();
+
+      // The caller goes first
+      return _arguments(call, 1);
+    }
+
+    case Kind::Literal:
+      return {arena.make<Literal>()};
+
+    // A root is only expected at the top
+    default:
+      throw Malformed();
+    }
+  }
+
+  // Read the child counts of a namespace *ns*.
+  Open _namespace(AST::Namespace *ns) {
+    ns->hash = hash();
+    ns->name = text();
+
+    auto functions = count();
+    auto namespaces = count();
+
+    if (ns->kind != AST::Kind::Module)
+      return {ns, {functions, namespaces}};
+
+    return {ns, {functions, namespaces, count()}};
+  }
+
+  // Read the argument counts and names of a *node*,
+  // with *leading* children before its arguments.
+  Open _arguments(AST::Node *node, size_t leading) {
+    Open open = {node, {leading, count()}};
+    open.names = _names.size();
+
+    for (auto i = count(); i > 0; i--) {
+      _names.push_back(Interner::global().intern(text()));
+      open.sizes[2]++;
+    }
+
+    return open;
+  }
+
+  // Attach the next *child* to an open *parent*.
+  void _attach(Open &parent, AST::Node *child) {
+    using namespace AST;
+
+    // The range of the child, and its index within the range
+    auto i = parent.read++;
+    unsigned range = 0;
+
+    while (i >= parent.sizes[range])
+      i -= parent.sizes[range++];
+
+    switch (parent.node->kind) {
+    case Kind::Root:
+    case Kind::Namespace:
+    case Kind::Module: {
+      auto ns = static_cast<Namespace *>(parent.node);
+
+      if (range == 0) {
+        auto function = _expect<FunctionDefinition>(
+            child, Kind::FunctionDefinition);
+
+        function->parent_namespace = ns;
+        ns->functions.push_back(function);
+      } else if (range == 1) {
+        if (!child || (child->kind != Kind::Namespace &&
+                       child->kind != Kind::Module))
+          throw Malformed();
+
+        static_cast<Namespace *>(child)->parent_namespace = ns;
+        ns->namespaces.push_back(static_cast<Namespace *>(child));
+      } else
+        static_cast<Module *>(ns)->function_declarations.push_back(
+            _expect<FunctionDeclaration>(
+                child, Kind::FunctionDeclaration));
+
+      break;
+    }
+
+    case Kind::FunctionDefinition: {
+      auto function = static_cast<FunctionDefinition *>(parent.node);
+
+      if (range == 0)
+        function->prototype = _expect<FunctionPrototype>(
+            child, Kind::FunctionPrototype);
+      else if (!child || child->kind == Kind::Body)
+        function->body = static_cast<Body *>(child);
+      else
+        throw Malformed();
+
+      break;
+    }
+
+    case Kind::FunctionDeclaration:
+      static_cast<FunctionDeclaration *>(parent.node)->prototype =
+          _expect<FunctionPrototype>(child, Kind::FunctionPrototype);
+      break;
+
+    case Kind::FunctionPrototype: {
+      auto proto = static_cast<FunctionPrototype *>(parent.node);
+
+      if (range == 0)
+        proto->annotations.push_back(
+            _expect<AnnotationApplication>(
+                child, Kind::AnnotationApplication));
+      else
+        proto->args.push_back(
+            _expect<FunctionArgumentDeclaration>(
+                child, Kind::FunctionArgumentDeclaration));
+
+      break;
+    }
+
+    case Kind::FunctionArgumentDeclaration: {
+      auto arg =
+          static_cast<FunctionArgumentDeclaration *>(parent.node);
+
+      if (range == 0)
+        arg->annotations.push_back(
+            _expect<AnnotationApplication>(
+                child, Kind::AnnotationApplication));
+      else if (i == 0)
+        arg->restriction = _expression(child);
+      else
+        arg->default_value = _expression(child);
+
+      break;
+    }
+
+    case Kind::AnnotationApplication:
+    case Kind::Call: {
+      auto node = parent.node;
+
+      // Only a call has a caller, which goes first
+      if (range == 0) {
+        static_cast<Call *>(node)->caller = _expression(child);
+        break;
+      }
+
+      auto &args =
+          node->kind == Kind::Call
+              ? static_cast<Call *>(node)->args
+              : static_cast<AnnotationApplication *>(node)->args;
+
+      if (range == 1)
+        args.ordered_arguments.push_back(_expression(child));
+      else if (!args.add_named(
+                   _names[parent.names + i], _expression(child)))
+        throw Malformed();
+
+      break;
+    }
+
+    case Kind::Body:
+      static_cast<Body *>(parent.node)->expressions.push_back(
+          _expression(child));
+      break;
+
+    case Kind::Binop: {
+      auto binop = static_cast<Binop *>(parent.node);
+      (i == 0 ? binop->lhx : binop->rhx) = _expression(child);
+      break;
+    }
+
+    case Kind::Unop:
+      static_cast<Unop *>(parent.node)->expr = _expression(child);
+      break;
+
+    case Kind::Ternary: {
+      auto ternary = static_cast<Ternary *>(parent.node);
+      auto expression = _expression(child);
+
+      if (i == 0)
+        ternary->cond = expression;
+      else if (i == 1)
+        ternary->then = expression;
+      else
+        ternary->else_ = expression;
+
+      break;
+    }
+
+    default:
+      throw "BUG! Unexpected SAST node to attach to";
+    }
+  }
+
+  // Return a *node* as of the *kind*, which may not be empty.
+  template <class T>
+  static T *_expect(AST::Node *node, AST::Kind kind) {
+    if (!node || node->kind != kind)
+      throw Malformed();
+
+    return static_cast<T *>(node);
+  }
+
+  // Return a *node* as an expression, which may be empty.
+  static AST::Expression *_expression(AST::Node *node) {
+    if (!node)
+      return nullptr;
+
+    switch (node->kind) {
+    case AST::Kind::ID:
+    case AST::Kind::Splat:
+    case AST::Kind::Binop:
+    case AST::Kind::Unop:
+    case AST::Kind::Ternary:
+    case AST::Kind::Call:
+    case AST::Kind::Literal:
+      return static_cast<AST::Expression *>(node);
+    default:
+      throw Malformed();
+    }
+  }
+};
+
+string encode(const Unit &unit) {
+  Writer writer(unit.tokens);
+
+  writer.byte(VERSION);
+  writer.tree(unit.sast);
+
+  return move(writer.out);
+}
+
+AST::Root *decode(string_view data, shared_ptr<Unit> unit) {
+  Reader reader(data, unit);
+  auto tokens = unit->tokens.size();
+
+  try {
+    if (reader.byte() != VERSION)
+      return nullptr;
+
+    if (auto root = reader.tree(); root && reader.is_end())
+      return root;
+  } catch (Malformed) {
+    // Fall through
+  }
+
+  // Drop tokens of lazy bodies read so far
+  unit->tokens.resize(tokens);
+  return nullptr;
+}
+} // namespace Bytecode
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,426 @@
+#include <deque>
+#include <set>
+#include <span>
+
+#include "../../header/compiler/declaration_parser.hpp"
+#include "../../header/compiler/expression_parser.hpp"
+#include "../../header/compiler/structural_hash.hpp"
+#include "../../header/utils/log.hpp"
+
+namespace Onyx {
+namespace Compiler {
+// IDs declaring a function with a body.
+static const set<string> FUNCTIONS = {"def", "impl"};
+
+// IDs declaring a block of declarations.
+static const set<string> CONTAINERS = {
+    "namespace",
+    "module",
+    "primitive",
+    "struct",
+    "class",
+    "enum",
+    "flag",
+    "annotation",
+    "trait",
+    "derive"};
+
+// Modifiers of a function without a body.
+static const set<string> BODILESS = {"native", "extern"};
+
+static Token::Value *as_id(const shared_ptr<Token::Base> &token) {
+  auto value = dynamic_cast<Token::Value *>(token.get());
+  return value && value->kind == Token::Value::ID ? value : nullptr;
+}
+
+static bool is(
+    const shared_ptr<Token::Base> &token,
+    Token::Control::Kind kind) {
+  auto control = dynamic_cast<Token::Control *>(token.get());
+  return control && control->kind == kind;
+}
+
+// Return `true` if a token at *index* separates statements.
+static bool is_blank(
+    const vector<shared_ptr<Token::Base>> &tokens, size_t index) {
+  auto control = dynamic_cast<Token::Control *>(tokens[index].get());
+
+  if (!control)
+    return Token::is_comment(tokens, index);
+
+  return control->kind == Token::Control::Space ||
+         control->kind == Token::Control::Comment ||
+         control->kind == Token::Control::Newline ||
+         control->kind == Token::Control::Semicolon;
+}
+
+void DeclarationParser::parse_unit(
+    Unit &unit, TaskQueue &queue, size_t part_tokens) {
+  const auto ranges = split(unit);
+
+  // Consecutive declarations parsed by a task
+  struct Part {
+    size_t begin = 0; // Indices in `ranges`
+    size_t end = 0;
+
+    Arena arena;
+    AST::Root *root = nullptr;
+  };
+
+  deque<Part> parts; // Arenas are not movable
+
+  for (size_t i = 0; i < ranges.size();) {
+    auto &part = parts.emplace_back();
+    part.begin = i;
+
+    for (size_t tokens = 0;
+         i < ranges.size() && tokens < part_tokens;
+         i++)
+      tokens += ranges[i].end - ranges[i].begin;
+
+    part.end = i;
+  }
+
+  ldebug() << "[DeclarationParser] Parsing " << ranges.size()
+           << " declarations of " << unit.path << " in "
+           << parts.size() << " tasks";
+
+  vector<shared_ptr<TaskQueue::Task>> tasks;
+
+  for (auto &part : parts) {
+    auto parse = [&unit, &ranges, &part]() {
+      part.root = part.arena.make<AST::Root>();
+      auto parser = DeclarationParser(unit, part.arena);
+
+      for (auto i = part.begin; i < part.end; i++)
+        parser.parse(ranges[i], part.root);
+    };
+
+    if (parts.size() == 1)
+      parse();
+    else
+      tasks.push_back(queue.push(parse));
+  }
+
+  queue.join(tasks);
+
+  // Nodes are not copied, their arenas are adopted instead
+  for (auto &part : parts) {
+    for (auto function : part.root->functions) {
+      function->parent_namespace = unit.sast;
+      unit.sast->functions.push_back(function);
+    }
+
+    for (auto ns : part.root->namespaces) {
+      ns->parent_namespace = unit.sast;
+      unit.sast->namespaces.push_back(ns);
+    }
+
+    unit.arena.adopt(part.arena);
+  }
+
+  AST::rehash(unit.sast);
+}
+
+vector<DeclarationParser::Range>
+DeclarationParser::split(Unit &unit, size_t begin) {
+  vector<Range> ranges;
+  _split(unit, BodyParser(unit), begin, ranges, false);
+  return ranges;
+}
+
+size_t DeclarationParser::_split(
+    Unit &unit,
+    const BodyParser &bodies,
+    size_t begin,
+    vector<Range> &ranges,
+    bool is_block) {
+  auto &tokens = unit.tokens;
+  auto cursor = begin;
+
+  while (true) {
+    while (cursor < tokens.size() && is_blank(tokens, cursor))
+      cursor++;
+
+    if (cursor == tokens.size()) {
+      if (is_block)
+        throw Error{
+            tokens[begin - 1], "Expected `end` of the block"};
+
+      return cursor;
+    }
+
+    const auto statement = cursor;
+    auto id = as_id(tokens[cursor]);
+
+    if (id && id->value == "end") {
+      if (is_block)
+        return cursor;
+
+      throw Error{tokens[cursor], "Unexpected `end`"};
+    }
+
+    // Modifiers are IDs followed by an ID, e.g. `private def`
+    bool is_bodiless = false;
+
+    while (id && !FUNCTIONS.contains(id->value) &&
+           !CONTAINERS.contains(id->value)) {
+      auto next = cursor + 1;
+
+      while (next < tokens.size() &&
+             is(tokens[next], Token::Control::Space))
+        next++;
+
+      if (next == tokens.size() || !as_id(tokens[next]))
+        break;
+
+      if (BODILESS.contains(id->value))
+        is_bodiless = true;
+
+      cursor = next;
+      id = as_id(tokens[cursor]);
+    }
+
+    cursor = bodies.statement_end(cursor);
+
+    // `def foo;` is a declaration without a body
+    const bool has_block =
+        cursor < tokens.size() &&
+        !is(tokens[cursor], Token::Control::Semicolon);
+
+    if (id && FUNCTIONS.contains(id->value)) {
+      if (has_block && !is_bodiless)
+        cursor = bodies.end_of(cursor) + 1;
+    } else if (id && CONTAINERS.contains(id->value)) {
+      if (has_block) {
+        vector<Range> nested;
+        cursor = _split(unit, bodies, cursor, nested, true) + 1;
+      }
+    }
+
+    ranges.push_back({statement, cursor});
+  }
+}
+
+DeclarationParser::DeclarationParser(Unit &unit, Arena &arena) :
+    _unit(unit), _arena(arena), _bodies(unit), _cursor(0), _end(0) {}
+
+void DeclarationParser::parse(Range range, AST::Namespace *ns) {
+  _cursor = range.begin;
+  _end = range.end;
+
+  vector<shared_ptr<Token::Value>> modifiers;
+
+  while (true) {
+    auto token = _peek(true);
+    auto id = as_id(token);
+
+    if (!id)
+      _err(token, "Expected declaration");
+
+    _cursor++;
+
+    if (FUNCTIONS.contains(id->value)) {
+      _function(ns, modifiers, range.begin);
+      break;
+    } else if (id->value == "namespace") {
+      _namespace(ns);
+      break;
+    } else if (CONTAINERS.contains(id->value))
+      _err(token, "Unsupported declaration");
+    else if (as_id(_peek()))
+      modifiers.push_back(static_pointer_cast<Token::Value>(token));
+    else
+      _err(token, "Unsupported declaration");
+  }
+
+  if (auto token = _peek(true))
+    _err(token, "Unexpected token");
+}
+
+shared_ptr<Token::Base>
+DeclarationParser::_peek(bool skip_newlines) {
+  while (_cursor < _end) {
+    auto &token = _unit.tokens[_cursor];
+
+    if (!(is(token, Token::Control::Space) ||
+          Token::is_comment(_unit.tokens, _cursor) ||
+          (skip_newlines &&
+           (is(token, Token::Control::Newline) ||
+            is(token, Token::Control::Semicolon)))))
+      return token;
+
+    _cursor++;
+  }
+
+  return nullptr;
+}
+
+AST::Expression *DeclarationParser::_expression() {
+  auto tokens = span(_unit.tokens).first(_end);
+
+  try {
+    return ExpressionParser(_arena, tokens, _cursor).parse();
+  } catch (ExpressionParser::Error error) {
+    throw Error{error.token, error.reason};
+  }
+}
+
+void DeclarationParser::_function(
+    AST::Namespace *ns,
+    const vector<shared_ptr<Token::Value>> &modifiers,
+    size_t begin) {
+  auto name = _peek();
+
+  if (!as_id(name))
+    _err(name, "Expected function name");
+
+  _cursor++;
+
+  auto prototype = _arena.make<AST::FunctionPrototype>();
+  prototype->name = static_pointer_cast<Token::Value>(name);
+
+  bool is_bodiless = false;
+
+  for (auto &modifier : modifiers) {
+    prototype->modifiers.push_back(modifier);
+
+    if (BODILESS.contains(modifier->value))
+      is_bodiless = true;
+  }
+
+  if (is(_peek(), Token::Control::OpenParen)) {
+    _cursor++;
+
+    while (!is(_peek(true), Token::Control::CloseParen)) {
+      auto arg = _arena.make<AST::FunctionArgumentDeclaration>();
+      arg->is_const = false;
+      arg->type = AST::FunctionArgumentDeclaration::Common;
+
+      auto token = _peek(true);
+      auto value = dynamic_cast<Token::Value *>(token.get());
+
+      if (value && value->kind == Token::Value::Kwarg) {
+        // `name: T`
+        _cursor++;
+        arg->name = static_pointer_cast<Token::Value>(token);
+        arg->restriction = _expression();
+      } else if (value && value->kind == Token::Value::ID) {
+        // `[alias] name [: T]`
+        _cursor++;
+        arg->name = static_pointer_cast<Token::Value>(token);
+
+        if (auto name = _peek(); as_id(name)) {
+          _cursor++;
+          arg->alias = arg->name;
+          arg->name = static_pointer_cast<Token::Value>(name);
+        }
+
+        if (is(_peek(), Token::Control::Colon)) {
+          _cursor++;
+          arg->restriction = _expression();
+        }
+      } else
+        _err(token, "Expected argument name");
+
+      if (is(_peek(), Token::Control::Assignment)) {
+        _cursor++;
+        arg->default_value = _expression();
+      }
+
+      prototype->args.push_back(arg);
+
+      if (is(_peek(true), Token::Control::Comma))
+        _cursor++;
+      else if (!is(_peek(true), Token::Control::CloseParen))
+        _err(_peek(true), "Expected comma or closing parenthesis");
+    }
+
+    _cursor++;
+  }
+
+  // The return restriction and the `forall` clause
+  // are not represented yet
+  _cursor = _bodies.statement_end(_cursor);
+
+  auto definition = _arena.make<AST::FunctionDefinition>();
+  definition->parent_namespace = ns;
+  definition->prototype = prototype;
+
+  const auto prototype_end = _cursor;
+
+  if (_cursor < _end &&
+      !is(_unit.tokens[_cursor], Token::Control::Semicolon) &&
+      !is_bodiless)
+    _bodies.skip(_cursor, definition);
+
+  auto tokens = span<const shared_ptr<Token::Base>>(_unit.tokens);
+
+  AST::rehash(
+      definition,
+      tokens.subspan(begin, prototype_end - begin),
+      tokens.subspan(
+          definition->body_begin,
+          definition->body_end - definition->body_begin));
+
+  ns->functions.push_back(definition);
+}
+
+void DeclarationParser::_namespace(AST::Namespace *ns) {
+  auto child = _arena.make<AST::Namespace>();
+  child->parent_namespace = ns;
+
+  // `namespace Foo::Bar`
+  while (auto token = _peek()) {
+    auto value = dynamic_cast<Token::Value *>(token.get());
+
+    if (value && (value->kind == Token::Value::ID ||
+                  value->kind == Token::Value::Type))
+      child->name += value->value;
+    else if (is(token, Token::Control::DoubleColon))
+      child->name += "::";
+    else
+      break;
+
+    _cursor++;
+  }
+
+  if (child->name.empty())
+    _err(_peek(), "Expected namespace name");
+
+  // `namespace Foo;` has no block, as split
+  const auto statement_end = _bodies.statement_end(_cursor);
+
+  if (statement_end >= _end ||
+      is(_unit.tokens[statement_end], Token::Control::Semicolon)) {
+    _cursor = statement_end;
+
+    AST::rehash(child);
+    ns->namespaces.push_back(child);
+
+    return;
+  }
+
+  vector<Range> ranges;
+  const auto end = _split(_unit, _bodies, _cursor, ranges, true);
+  const auto outer_end = _end;
+
+  for (auto &range : ranges)
+    parse(range, child);
+
+  _cursor = end + 1;
+  _end = outer_end;
+
+  AST::rehash(child);
+  ns->namespaces.push_back(child);
+}
+
+void DeclarationParser::_err(
+    shared_ptr<Token::Base> token, string reason) {
+  if (!token && _end)
+    token = _unit.tokens[_end - 1];
+
+  throw Error{token, reason};
+}
+} // namespace Compiler
+} // namespace Onyx
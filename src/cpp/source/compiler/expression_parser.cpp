@@ -0,0 +1,459 @@
+#include <unordered_map>
+
+#include "../../header/compiler/expression_parser.hpp"
+
+namespace Onyx {
+namespace Compiler {
+// Binding powers, the higher the tighter. They are even, so that
+// `power + 1` reduces equal operators for right associativity.
+static const unsigned char TERNARY = 2;
+static const unsigned char PIPE = 4;
+static const unsigned char ELVIS = 6;
+static const unsigned char PREFIX = 28;
+
+// Operators missing in the table, e.g. custom ones.
+static const unsigned char DEFAULT_POWER = 16;
+
+struct Infix {
+  unsigned char power;
+  bool is_right;
+};
+
+static const unordered_map<string, Infix> INFIX = {
+    {"||", {8, false}},   {"&&", {10, false}},  {"==", {12, false}},
+    {"!=", {12, false}},  {"===", {12, false}}, {"<=>", {12, false}},
+    {"=~", {12, false}},  {"<", {14, false}},   {"<=", {14, false}},
+    {">", {14, false}},   {">=", {14, false}},  {"|", {16, false}},
+    {"^", {18, false}},   {"&", {20, false}},   {"<<", {22, false}},
+    {">>", {22, false}},  {"+", {24, false}},   {"-", {24, false}},
+    {"*", {26, false}},   {"/", {26, false}},   {"//", {26, false}},
+    {"%", {26, false}},   {"**", {30, true}},
+};
+
+static bool is(
+    const shared_ptr<Token::Base> &token,
+    Token::Control::Kind kind) {
+  auto control = dynamic_cast<Token::Control *>(token.get());
+  return control && control->kind == kind;
+}
+
+static Token::Value *as_value(
+    const shared_ptr<Token::Base> &token,
+    Token::Value::Kind kind) {
+  auto value = dynamic_cast<Token::Value *>(token.get());
+  return value && value->kind == kind ? value : nullptr;
+}
+
+ExpressionParser::ExpressionParser(
+    Arena &arena,
+    span<const shared_ptr<Token::Base>> tokens,
+    size_t &cursor,
+    size_t max_depth) :
+    _arena(arena),
+    _tokens(tokens),
+    _cursor(cursor),
+    _max_depth(max_depth),
+    _is_spaced(false) {}
+
+AST::Expression *ExpressionParser::parse() {
+  _stack.clear();
+  _brackets = 0;
+
+  AST::Expression *value = nullptr;
+  bool is_operand = true; // Whether an operand is expected
+
+  while (true) {
+    if (is_operand) {
+      auto token = _peek(true);
+
+      if (!token)
+        _err(token, "Expected expression");
+
+      // Types are referred to as IDs, e.g. `Int` in `a : Int`
+      if (as_value(token, Token::Value::ID) ||
+          as_value(token, Token::Value::Type)) {
+        _cursor++;
+
+        auto ref = static_pointer_cast<Token::Value>(token);
+        auto next = _peek();
+
+        // `f(` is a call, while `f (` is not
+        if (is(next, Token::Control::OpenParen) && !_is_spaced) {
+          _cursor++;
+
+          auto call = _arena.make<AST::Call>();
+          call->callee = ref;
+
+          if (is(_peek(true), Token::Control::CloseParen)) {
+            _cursor++;
+            value = call;
+            is_operand = false;
+          } else
+            _push(
+                {.kind = Frame::Arguments,
+                 .token = next,
+                 .call = call});
+        } else {
+          auto node = _arena.make<AST::ID>();
+          node->value = ref;
+          value = node;
+          is_operand = false;
+        }
+      } else if (auto kwarg = as_value(token, Token::Value::Kwarg)) {
+        if (_stack.empty() ||
+            _stack.back().kind != Frame::Arguments ||
+            _stack.back().name)
+          _err(token, "Unexpected named argument");
+
+        _stack.back().name = Interner::global().intern(kwarg->value);
+        _cursor++;
+
+        if (is(_peek(), Token::Control::Colon))
+          _cursor++;
+      } else if (auto op = as_value(token, Token::Value::Op)) {
+        _cursor++;
+
+        auto next = _peek();
+
+        // `**foo` is a named splat
+        if (op->value == "**" && !_is_spaced &&
+            as_value(next, Token::Value::ID)) {
+          _cursor++;
+
+          auto splat = _arena.make<AST::Splat>();
+          splat->is_named = true;
+          splat->id = static_pointer_cast<Token::Value>(next);
+          value = splat;
+          is_operand = false;
+        } else
+          _push(
+              {.kind = Frame::Prefix,
+               .power = PREFIX,
+               .token = token});
+      } else if (is(token, Token::Control::OpenParen)) {
+        _cursor++;
+        _push({.kind = Frame::Paren, .token = token});
+      } else if (is(token, Token::Control::Splat)) {
+        _cursor++;
+
+        auto id = _peek();
+
+        if (!as_value(id, Token::Value::ID) || _is_spaced)
+          _err(id, "Expected splatted identifier");
+
+        _cursor++;
+
+        auto splat = _arena.make<AST::Splat>();
+        splat->is_named = false;
+        splat->id = static_pointer_cast<Token::Value>(id);
+        value = splat;
+        is_operand = false;
+      } else if (
+          is(token, Token::Control::DoubleQuotes) ||
+          is(token, Token::Control::SingleQuote)) {
+        const auto quote =
+            static_cast<Token::Control *>(token.get())->kind;
+
+        // Interpolations are not lexed yet
+        do
+          _cursor++;
+        while (_cursor < _tokens.size() &&
+               !is(_tokens[_cursor], quote));
+
+        if (_cursor == _tokens.size())
+          _err(token, "Expected closing quotes");
+
+        _cursor++;
+
+        if (quote == Token::Control::DoubleQuotes)
+          value = _arena.make<AST::StringLiteral>();
+        else
+          value = _arena.make<AST::Literal>();
+
+        is_operand = false;
+      } else if (dynamic_cast<Token::NumericLiteral *>(
+                     token.get())) {
+        _cursor++;
+        value = _arena.make<AST::NumericLiteral>();
+        is_operand = false;
+      } else
+        _err(token, "Expected expression");
+
+      continue;
+    }
+
+    // Expecting an operator, or the end of the expression
+    auto token = _peek(_brackets > 0);
+
+    if (auto op = as_value(token, Token::Value::Op)) {
+      auto it = INFIX.find(op->value);
+      auto infix = it == INFIX.end() ? Infix{DEFAULT_POWER, false}
+                                     : it->second;
+
+      _reduce(value, infix.is_right ? infix.power + 1 : infix.power);
+
+      _push(
+          {.kind = Frame::Infix,
+           .power = infix.power,
+           .token = token,
+           .lhx = value});
+
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::Dot)) {
+      _cursor++;
+
+      auto callee = _peek(true);
+
+      if (!as_value(callee, Token::Value::ID))
+        _err(callee, "Expected method name");
+
+      _cursor++;
+
+      auto call = _arena.make<AST::Call>();
+      call->caller = value;
+      call->callee = static_pointer_cast<Token::Value>(callee);
+
+      auto next = _peek();
+
+      if (is(next, Token::Control::OpenParen) && !_is_spaced) {
+        _cursor++;
+
+        if (is(_peek(true), Token::Control::CloseParen)) {
+          _cursor++;
+          value = call;
+        } else {
+          _push(
+              {.kind = Frame::Arguments,
+               .token = next,
+               .call = call});
+
+          is_operand = true;
+        }
+      } else
+        value = call;
+    } else if (is(token, Token::Control::Ternary)) {
+      _reduce(value, TERNARY + 1);
+
+      _push(
+          {.kind = Frame::TernaryThen,
+           .token = token,
+           .lhx = value});
+
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::Elvis)) {
+      _reduce(value, ELVIS + 1);
+
+      _push(
+          {.kind = Frame::Elvis,
+           .power = ELVIS,
+           .token = token,
+           .lhx = value});
+
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::PipeArrow)) {
+      _reduce(value, PIPE);
+
+      _push(
+          {.kind = Frame::Pipe,
+           .power = PIPE,
+           .token = token,
+           .lhx = value});
+
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::Colon)) {
+      _reduce(value);
+
+      if (_stack.empty() || _stack.back().kind != Frame::TernaryThen)
+        break;
+
+      auto frame = _stack.back();
+      _stack.pop_back();
+
+      _push(
+          {.kind = Frame::TernaryElse,
+           .power = TERNARY,
+           .token = token,
+           .lhx = frame.lhx,
+           .then = value});
+
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::Comma)) {
+      _reduce(value);
+
+      if (_stack.empty() || _stack.back().kind != Frame::Arguments)
+        break;
+
+      _argument(value);
+      _cursor++;
+      is_operand = true;
+    } else if (is(token, Token::Control::CloseParen)) {
+      _reduce(value);
+
+      if (_stack.empty())
+        break;
+      else if (_stack.back().kind == Frame::Arguments) {
+        _argument(value);
+        value = _stack.back().call;
+      } else if (_stack.back().kind != Frame::Paren)
+        break;
+
+      _stack.pop_back();
+      _brackets--;
+      _cursor++;
+    } else
+      break;
+  }
+
+  _reduce(value);
+
+  if (!_stack.empty()) {
+    if (_stack.back().kind == Frame::TernaryThen)
+      _err(_peek(), "Expected colon of the ternary operator");
+    else
+      _err(_peek(), "Expected closing parenthesis");
+  }
+
+  return value;
+}
+
+shared_ptr<Token::Base> ExpressionParser::_peek(bool skip_newlines) {
+  _is_spaced = false;
+
+  while (_cursor < _tokens.size()) {
+    auto control =
+        dynamic_cast<Token::Control *>(_tokens[_cursor].get());
+
+    // A comment text is a value
+    if (control ? !(control->kind == Token::Control::Space ||
+                    control->kind == Token::Control::Comment ||
+                    (skip_newlines &&
+                     control->kind == Token::Control::Newline))
+                : !Token::is_comment(_tokens, _cursor))
+      return _tokens[_cursor];
+
+    _is_spaced = true;
+    _cursor++;
+  }
+
+  return nullptr;
+}
+
+void ExpressionParser::_push(Frame frame) {
+  if (_stack.size() >= _max_depth)
+    _err(frame.token, "Expression is nested too deeply");
+
+  if (frame.kind == Frame::Paren || frame.kind == Frame::Arguments)
+    _brackets++;
+
+  _stack.push_back(frame);
+}
+
+void ExpressionParser::_reduce(
+    AST::Expression *&value, unsigned power) {
+  while (!_stack.empty()) {
+    auto &frame = _stack.back();
+
+    switch (frame.kind) {
+    case Frame::Prefix:
+    case Frame::Infix:
+    case Frame::Elvis:
+    case Frame::Pipe:
+    case Frame::TernaryElse:
+      break;
+    default:
+      return; // A bracket
+    }
+
+    if (frame.power < power)
+      return;
+
+    value = _apply(frame, value);
+    _stack.pop_back();
+  }
+}
+
+AST::Expression *
+ExpressionParser::_apply(Frame &frame, AST::Expression *rhx) {
+  switch (frame.kind) {
+  case Frame::Prefix: {
+    auto unop = _arena.make<AST::Unop>();
+    unop->op = static_pointer_cast<Token::Value>(frame.token);
+    unop->expr = rhx;
+    return unop;
+  }
+
+  case Frame::Infix: {
+    auto binop = _arena.make<AST::Binop>();
+    binop->lhx = frame.lhx;
+    binop->op = static_pointer_cast<Token::Value>(frame.token);
+    binop->rhx = rhx;
+    return binop;
+  }
+
+  case Frame::Elvis: {
+    auto ternary = _arena.make<AST::Ternary>();
+    ternary->cond = frame.lhx;
+    ternary->else_ = rhx;
+    return ternary;
+  }
+
+  case Frame::TernaryElse: {
+    auto ternary = _arena.make<AST::Ternary>();
+    ternary->cond = frame.lhx;
+    ternary->then = frame.then;
+    ternary->else_ = rhx;
+    return ternary;
+  }
+
+  case Frame::Pipe: {
+    // `a |> f(b)` is `f(a, b)`, and `a |> f` is `f(a)`
+    AST::Call *call;
+
+    if (rhx->kind == AST::Kind::Call)
+      call = static_cast<AST::Call *>(rhx);
+    else if (rhx->kind == AST::Kind::ID) {
+      call = _arena.make<AST::Call>();
+      call->callee = static_cast<AST::ID *>(rhx)->value;
+    } else
+      _err(frame.token, "Expected a call after the pipe");
+
+    auto &args = call->args.ordered_arguments;
+    args.insert(args.begin(), frame.lhx);
+
+    return call;
+  }
+
+  default:
+    throw "BUG! Applying a bracket frame";
+  }
+}
+
+void ExpressionParser::_argument(AST::Expression *value) {
+  auto &frame = _stack.back();
+  auto &args = frame.call->args;
+
+  if (frame.name) {
+    if (!args.add_named(*frame.name, value))
+      _err(frame.token, "Duplicate named argument");
+
+    frame.name = nullopt;
+  } else if (!args.named_arguments.empty())
+    _err(frame.token, "Positional argument after named ones");
+  else
+    args.ordered_arguments.push_back(value);
+}
+
+void ExpressionParser::_err(
+    shared_ptr<Token::Base> token, string reason) {
+  if (!token && !_tokens.empty())
+    token = _tokens.back();
+
+  throw Error{token, reason};
+}
+} // namespace Compiler
+} // namespace Onyx
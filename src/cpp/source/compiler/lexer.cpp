@@ -20,8 +20,15 @@ Lexer::Lexer(std::shared_ptr<Unit> unit) :
 
   // The file is opened in text mode to make
   // newline-dependent code cross-platform.
-  _input = make_unique<ifstream>(ifstream(unit->path));
-  ldebug() << "[Lexer()] Opened the file";
+  ifstream file(unit->path);
+
+  if (!file)
+    throw Error(_cursor, Error::FileError);
+
+  // Read at once to lex from a contiguous buffer
+  _inputs.push_back(
+      Input{string(istreambuf_iterator<char>(file), {})});
+  ldebug() << "[Lexer()] Read the file";
 
   _read(false);
 }
@@ -29,29 +36,29 @@ Lexer::Lexer(std::shared_ptr<Unit> unit) :
 char Lexer::_read(bool raise_on_eof) {
   char prev_codeunit = _codeunit;
 
-  if (_is_reading_from_macro) {
-    ltrace() << "[Lexer::_read] Accessing macro output";
-    auto stream = &_macro->output;
+  // Exhausted macro outputs are popped
+  while (_inputs.size() > 1 &&
+         _inputs.back().offset >= _inputs.back().data.size()) {
+    ltrace() << "[Lexer::_read] Stop reading from macro (EOF)";
+    _inputs.pop_back();
+  }
 
-    if (stream->eof()) {
-      ltrace() << "[Lexer::_read] Stop reading from macro (EOF)";
-      _is_reading_from_macro = false;
-    } else {
-      ltrace() << "[Lexer::_read] Reading from macro";
-      _codeunit = stream->get();
-      ltrace() << "[Lexer::_read] Read `" << _codeunit << "` (0x"
-               << std::hex << +_codeunit << std::dec
-               << ") from macro output";
-      return prev_codeunit;
-    }
+  auto &input = _inputs.back();
+
+  // Reading from a macro output does not move the cursor
+  if (_inputs.size() > 1) {
+    _codeunit = input.data[input.offset++];
+    ltrace() << "[Lexer::_read] Read `" << _codeunit << "` (0x"
+             << std::hex << +_codeunit << std::dec
+             << ") from macro output";
+    return prev_codeunit;
   }
 
-  // Reading from the `_input` would not happen
-  // if already read from the macro input.
-  //
+  _codeunit = input.offset < input.data.size()
+                  ? input.data[input.offset]
+                  : (char)EOF;
 
-  ltrace() << "[Lexer::_read] Reading from source";
-  _codeunit = _input->get();
+  input.offset++;
   ltrace() << "[Lexer::_read] Read `" << _codeunit << "` (0x"
            << std::hex << +_codeunit << ")" << std::dec;
 
@@ -74,6 +81,59 @@ char Lexer::_read(bool raise_on_eof) {
   return prev_codeunit;
 }
 
+Macro *Lexer::macro() { return _macro.get(); }
+
+void Lexer::_read_macro_output() {
+  if (!_macro->output.empty()) {
+    _inputs.push_back(Input{move(_macro->output)});
+    _macro->output.clear();
+  }
+
+  _read(false); // There may be no output at all and also EOF
+}
+
+shared_ptr<Macro::Handle> Lexer::_read_splice() {
+  _read(); // Consume the opening marker
+
+  size_t index = 0;
+  bool has_digits = false;
+
+  while (_is_num()) {
+    index = index * 10 + (_read() - '0');
+    has_digits = true;
+  }
+
+  if (!has_digits || !_is(Macro::SPLICE) ||
+      index >= _macro->spliced.size())
+    _err();
+
+  _read(false); // Consume the closing marker
+
+  return _macro->spliced[index];
+}
+
+bool Lexer::_is_eof() {
+  return _inputs.size() == 1 &&
+         _inputs.front().offset > _inputs.front().data.size();
+}
+
+Macro *Lexer::_ensure_macro() {
+  if (!_macro) {
+    ltrace() << "[Lexer] Instantiating a macro";
+    _macro = make_unique<Macro>();
+  }
+
+  return _macro.get();
+}
+
+void Lexer::_set_macro_site(Position position) {
+  // A statement continued by another macro keeps its site
+  if (_macro->input.empty())
+    _macro->site = _unit->path.string() + ':' +
+                   to_string(position.row) + ':' +
+                   to_string(position.col);
+}
+
 void Lexer::_err(Error::Kind kind) { throw Error(_cursor, kind); }
 
 void Lexer::_err_expect(set<char> expected) {
@@ -776,8 +836,16 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
   // Stateful? E.g. `.` only after `Callable`.
   // Match brackets?
   //
-  while (!_input->eof()) {
+  while (!_is_eof()) {
+    if (_inputs.size() > 1 && _is(Macro::SPLICE)) {
+      for (auto &token : _read_splice()->tokens)
+        co_yield token;
+
+      continue;
+    }
+
     if (_is('{')) /* Macro */ {
+      const auto begin = _cursor;
       _read();
 
       if (_is('%')) {
@@ -813,6 +881,8 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
                    << "output from macro yet";
         }
 
+        _set_macro_site(begin);
+
         ltrace() << "[Lexer::lex] Reading the macro code...";
 
         // Within a macro, `%}` would mean macro termination.
@@ -835,10 +905,10 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
 
             // That's just an escaped char,
             // the macro continues
-            _macro->input << '%';
+            _macro->input += '%';
           } else {
             is_backslash = false;
-            _macro->input << _codeunit;
+            _macro->input += _codeunit;
           }
 
           _read();
@@ -866,15 +936,16 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
           ltrace() << "[Lexer::lex] The macro has been successfully "
                    << "evaluated. Start reading from its output";
 
-          _is_reading_from_macro = true;
-          _read(false); // There may be no output at all and also EOF
+          _read_macro_output();
         }
       } else if (_is('{')) {
         _read();
 
         // That's an emitting macro, e.g. `{{ "foo" }}`.
         ltrace() << "[Lexer::lex] Encountered an emitting macro";
-        _ensure_macro()->begin_explicit_emit();
+        _ensure_macro();
+        _set_macro_site(begin);
+        _macro->begin_explicit_emit();
         ltrace() << "[Lexer::lex] Reading the macro code...";
 
         // Within a macro, `}}` would mean macro termination.
@@ -895,10 +966,10 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
               break;
             }
 
-            _macro->input << '}';
+            _macro->input += '}';
           } else {
             is_backslash = false;
-            _macro->input << _codeunit;
+            _macro->input += _codeunit;
           }
 
           _read();
@@ -938,8 +1009,7 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
           ltrace() << "[Lexer::lex] The macro has been successfully "
                    << "evaluated. Start reading from its output";
 
-          _is_reading_from_macro = true;
-          _read(false); // The output may be empty, EOF allowed
+          _read_macro_output();
         }
       } else if (_macro && _macro->is_incomplete()) {
         // Within an incomplete macro expression block,
@@ -947,7 +1017,7 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
         ltrace() << "[Lexer::lex] Putting the code unit "
                  << "into the macro buffer";
         // _macro->ensure_implicit_emit();
-        _macro->input << '{';
+        _macro->input += '{';
       } else {
         co_yield _control(Token::Control::OpenCurly);
       }
@@ -1012,9 +1082,9 @@ generator<shared_ptr<Token::Base>> Lexer::lex() {
       // _macro->ensure_begin_emitting_onyx_code();
 
       if (Macro::needs_escape(_codeunit))
-        _macro->input << '\\' << _codeunit;
-      else
-        _macro->input << _codeunit;
+        _macro->input += '\\';
+
+      _macro->input += _codeunit;
 
       _read(); // EOF is not allowed until the expression is complete
       continue;
@@ -1,76 +1,1482 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../header/compiler/lua_compat.hpp"
+#include "../../header/compiler/macro.hpp"
+#include "../../header/utils/arena.hpp"
+#include "../../header/utils/fnv1a.hpp"
+#include "../../header/utils/log.hpp"
+
+// A registry field pointing to the idempotency flag
+// of the macro currently owning a pooled state.
+static const char *const IDEMPOTENT_KEY = "fnxc.idempotent";
+
+// A registry field pointing to the output buffer
+// of the macro currently owning a pooled state.
+static const char *const OUTPUT_KEY = "fnxc.output";
+
+// A registry field pointing to the purity flag
+// of the macro currently owning a pooled state.
+static const char *const PURE_KEY = "fnxc.pure";
+
+// A registry field pointing to the spliced handles
+// of the macro currently owning a pooled state.
+static const char *const SPLICED_KEY = "fnxc.spliced";
+
+// The registry name of the metatable of handles.
+static const char *const HANDLE_METATABLE = "fnxc.handle";
+
+// A registry field containing the state reset function.
+static const char *const RESET_KEY = "fnxc.reset";
+
+// A registry field containing the environment of macro chunks.
+static const char *const ENV_KEY = "fnxc.env";
+
+// A registry field containing the function checking
+// whether the snapshot tables of a state are pristine.
+static const char *const PRISTINE_KEY = "fnxc.pristine";
+
+// How often the count hook is called, in VM instructions.
+static const int HOOK_STEP = 1000;
+
+// Sample the stack every this many hook calls when profiling.
+static const int PROFILE_PERIOD = 50;
+
+// The maximum depth of a sampled stack.
+static const int PROFILE_DEPTH = 32;
+
+// A profile entry of a folded stack.
+struct Sample {
+  chrono::nanoseconds duration = {};
+  uint64_t allocated = 0; // In bytes
+  uint64_t count = 0;
+};
+
+// Samples keyed by a folded stack, i.e. the evaluated
+// site followed by Lua functions, separated by `;`.
+using Samples = unordered_map<string, Sample>;
+
+// The allocator state of an interpreter, which
+// also tracks the budget of the current evaluation.
+struct Budget {
+  enum Limit { None, Instructions, Memory, Duration };
+
+  // As a state is owned by a thread, its
+  // allocations never contend with other threads.
+  Arena arena;
+  bool is_closing = false;
+
+  size_t used = 0;
+  size_t peak = 0;
+  uint64_t instructions = 0;
+
+  // Limits of the current evaluation; zero if unlimited.
+  size_t memory_limit = 0;
+  uint64_t instruction_limit = 0;
+  chrono::steady_clock::time_point deadline;
+
+  // The limit hit during the current evaluation.
+  Limit exceeded = None;
+
+  // Set if the current evaluation is profiled.
+  Samples *samples = nullptr;
+  const string *site;
+  chrono::steady_clock::time_point sampled_at;
+  uint64_t allocated = 0; // Since the last sample
+  int hooks = 0;
+
+#ifdef FNXC_MACRO_LUAJIT
+  // Set if the JIT compiler is off for the state.
+  bool is_jit_off = false;
+#endif
+};
+
+// Attribute the time and allocations since the last sample to
+// the current stack, or to the site alone if *state* is null.
+static void sample(
+    lua_State *state,
+    Budget *budget,
+    chrono::steady_clock::time_point now) {
+  string stack = budget->site->empty() ? "?" : *budget->site;
+
+  if (state) {
+    lua_Debug frames[PROFILE_DEPTH];
+    int depth = 0;
+
+    while (depth < PROFILE_DEPTH &&
+           lua_getstack(state, depth, &frames[depth]))
+      depth++;
+
+    // From the outermost frame; the main chunk is the site itself
+    for (int i = depth - 1; i >= 0; i--) {
+      auto &frame = frames[i];
+      lua_getinfo(state, "Sn", &frame);
+
+      if (!strcmp(frame.what, "main"))
+        continue;
+
+      stack += ';';
+      stack += frame.name ? frame.name : "?";
+
+      if (strcmp(frame.what, "C"))
+        stack += " (" + string(frame.short_src) + ':' +
+                 to_string(frame.linedefined) + ')';
+    }
+  }
+
+  auto &entry = (*budget->samples)[stack];
+  entry.duration += now - budget->sampled_at;
+  entry.allocated += budget->allocated;
+  entry.count++;
+
+  budget->sampled_at = now;
+  budget->allocated = 0;
+}
 
 extern "C" {
-#include "../../../lib/lua/lauxlib.h"
-#include "../../../lib/lua/lua.h"
-#include "../../../lib/lua/lualib.h"
+// Raise an error once a limit is hit. After that, the hook is
+// called on every instruction, so that a `pcall` within the
+// macro code could not swallow the error.
+static void count_hook(lua_State *state, lua_Debug *) {
+  void *ud;
+  lua_getallocf(state, &ud);
+  auto budget = (Budget *)ud;
+
+  if (budget->exceeded == Budget::None) {
+    budget->instructions += HOOK_STEP;
+    const auto now = chrono::steady_clock::now();
+
+    if (budget->instruction_limit &&
+        budget->instructions > budget->instruction_limit)
+      budget->exceeded = Budget::Instructions;
+    else if (now > budget->deadline)
+      budget->exceeded = Budget::Duration;
+    else {
+      if (budget->samples && ++budget->hooks % PROFILE_PERIOD == 0)
+        sample(state, budget, now);
+
+      return;
+    }
+
+    lua_sethook(state, count_hook, LUA_MASKCOUNT, 1);
+  }
+
+  luaL_error(state, "macro limit exceeded");
 }
 
-#include "./macro.hpp"
+// A `lua_Alloc` accounting the memory used by a state.
+static void *
+allocate(void *ud, void *ptr, size_t osize, size_t nsize) {
+  auto budget = (Budget *)ud;
+  const size_t old_size = ptr ? osize : 0; // Otherwise a type tag
+
+  if (!nsize) {
+    // The arena is freed at once on close
+    if (!budget->is_closing)
+      budget->arena.free(ptr, old_size);
+
+    budget->used -= old_size;
+    return nullptr;
+  }
+
+  if (nsize > old_size)
+    budget->allocated += nsize - old_size;
+
+  if (nsize > old_size && budget->memory_limit &&
+      budget->used - old_size + nsize > budget->memory_limit)
+    return nullptr; // Lua collects garbage and retries once
+
+  auto result = budget->arena.reallocate(ptr, old_size, nsize);
+
+  if (result) {
+    budget->used = budget->used - old_size + nsize;
+    budget->peak = max(budget->peak, budget->used);
+  }
+
+  return result;
+}
+
+static int panic(lua_State *state) {
+  lerror() << "[Macro] Unprotected Lua error: "
+           << lua_tostring(state, -1);
+  return 0; // Aborts
+}
+
+static void reset_idempotent(lua_State *state) {
+  lua_getfield(state, LUA_REGISTRYINDEX, IDEMPOTENT_KEY);
+  *(bool *)lua_touserdata(state, -1) = false;
+  lua_pop(state, 1);
+}
+
+static void reset_pure(lua_State *state) {
+  lua_getfield(state, LUA_REGISTRYINDEX, PURE_KEY);
+  *(bool *)lua_touserdata(state, -1) = false;
+  lua_pop(state, 1);
+}
+
+// Called on a write to `nx.file` or `nx.ctx`.
+static int lua_impure(lua_State *state) {
+  reset_pure(state);
+  return 0;
+}
+
+// The `__index` of the chunk environment, with the global table
+// and its pristine fields as upvalues. Reading a global which
+// differs from the pristine one (e.g. set by a previous chunk)
+// makes the chunk depend on more than its source.
+static int lua_env_index(lua_State *state) {
+  lua_pushvalue(state, 2);
+  lua_rawget(state, lua_upvalueindex(1));
+  lua_pushvalue(state, 2);
+  lua_rawget(state, lua_upvalueindex(2));
+
+  if (!lua_rawequal(state, -1, -2))
+    reset_pure(state);
+
+  lua_pop(state, 1);
+  return 1;
+}
+
+// The `__newindex` of the chunk environment, with the global table
+// as an upvalue. Setting a global is a side effect.
+static int lua_env_newindex(lua_State *state) {
+  reset_pure(state);
+  lua_rawset(state, lua_upvalueindex(1));
+  return 0;
+}
+
+using Onyx::Compiler::Macro;
+
+// A handle userdata, i.e. a reference to a shared handle.
+using HandleRef = std::shared_ptr<Macro::Handle>;
+
+static int lua_handle_gc(lua_State *state) {
+  ((HandleRef *)lua_touserdata(state, 1))->~HandleRef();
+  return 0;
+}
+
+// Return the source of the handle tokens.
+static int lua_handle_tostring(lua_State *state) {
+  auto &handle = *(HandleRef *)lua_touserdata(state, 1);
+  std::string source;
+
+  for (auto &token : handle->tokens)
+    source += token->source();
+
+  lua_pushlstring(state, source.data(), source.size());
+  return 1;
+}
+
+static int lua_handle_len(lua_State *state) {
+  auto &handle = *(HandleRef *)lua_touserdata(state, 1);
+  lua_pushinteger(state, handle->tokens.size());
+  return 1;
+}
+
+// Return the source of a token by its 1-based index.
+static int lua_handle_index(lua_State *state) {
+  auto &handle = *(HandleRef *)lua_touserdata(state, 1);
+  auto index = luaL_checkinteger(state, 2);
+
+  if (index < 1 || size_t(index) > handle->tokens.size())
+    return 0;
+
+  auto source = handle->tokens[index - 1]->source();
+  lua_pushlstring(state, source.data(), source.size());
 
-extern "C" {
-static int lua_emit(lua_State *state) {
-  luaL_checkstring(state, 1);
-  lua_pushboolean(state, 1);
   return 1;
 }
+
+// Append every argument to the output buffer.
+// A handle is spliced by reference.
+static int lua_emit(lua_State *state) {
+  auto count = lua_gettop(state);
+
+  lua_getfield(state, LUA_REGISTRYINDEX, OUTPUT_KEY);
+  auto output = (std::string *)lua_touserdata(state, -1);
+  lua_pop(state, 1);
+
+  for (int i = 1; i <= count; i++) {
+    auto handle =
+        (HandleRef *)luaL_testudata(state, i, HANDLE_METATABLE);
+
+    if (handle) {
+      lua_getfield(state, LUA_REGISTRYINDEX, SPLICED_KEY);
+      auto spliced =
+          (std::vector<HandleRef> *)lua_touserdata(state, -1);
+      lua_pop(state, 1);
+
+      *output += Macro::SPLICE;
+      *output += std::to_string(spliced->size());
+      *output += Macro::SPLICE;
+
+      spliced->push_back(*handle);
+
+      // A splice refers to the unit handles
+      reset_pure(state);
+
+      continue;
+    }
+
+    size_t size;
+    auto data = luaL_checklstring(state, i, &size);
+    output->append(data, size);
+  }
+
+  return 0;
+}
+
+// Call the wrapped function stored in the first upvalue
+// with all the arguments, returning all its results.
+static int call_wrapped(lua_State *state) {
+  lua_pushvalue(state, lua_upvalueindex(1));
+  lua_insert(state, 1);
+  lua_call(state, lua_gettop(state) - 1, LUA_MULTRET);
+
+  return lua_gettop(state);
+}
+
+// Called instead of a non-idempotent function
+// stored in the first upvalue.
+static int lua_nonidempotent(lua_State *state) {
+  reset_idempotent(state);
+  return call_wrapped(state);
+}
+
+// Called instead of `collectgarbage`. Only a full collection is
+// idempotent, as other options return or change the collector
+// state, e.g. `collectgarbage("count")`.
+static int lua_collectgarbage(lua_State *state) {
+  if (strcmp(luaL_optstring(state, 1, "collect"), "collect"))
+    reset_idempotent(state);
+
+  return call_wrapped(state);
+}
+
+// Return `true` if a value at *index* is converted to a string
+// by its address, e.g. `table: 0x5581e0a0`, differing between runs.
+static bool is_address_string(lua_State *state, int index) {
+  switch (lua_type(state, index)) {
+  case LUA_TTABLE:
+  case LUA_TFUNCTION:
+  case LUA_TTHREAD:
+  case LUA_TUSERDATA:
+  case LUA_TLIGHTUSERDATA:
+    break;
+  default:
+    return false;
+  }
+
+  if (!luaL_getmetafield(state, index, "__tostring"))
+    return true;
+
+  lua_pop(state, 1);
+  return false;
+}
+
+// Called instead of `tostring` and `string.format`, which are only
+// non-idempotent if an argument is converted by its address.
+static int lua_tostring_checked(lua_State *state) {
+  for (int i = 1; i <= lua_gettop(state); i++) {
+    if (is_address_string(state, i)) {
+      reset_idempotent(state);
+      break;
+    }
+  }
+
+  return call_wrapped(state);
+}
+
+// Called instead of `require`. Requiring an already loaded
+// module (e.g. a standard library) is idempotent, while
+// a new module (especially a C one) may depend on anything.
+static int lua_require(lua_State *state) {
+  auto name = luaL_checkstring(state, 1);
+
+  lua_getfield(state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  lua_getfield(state, -1, name);
+
+  if (!lua_toboolean(state, -1))
+    reset_idempotent(state);
+
+  lua_pop(state, 2);
+  return call_wrapped(state);
+}
+
+// A contiguous chunk to load.
+struct Chunk {
+  const char *data;
+  size_t size;
+};
+
+// A `lua_Reader` handing out a whole chunk at once, without copying.
+static const char *read_chunk(lua_State *, void *ud, size_t *size) {
+  auto chunk = (Chunk *)ud;
+  *size = chunk->size;
+  chunk->size = 0; // The next call signals the end
+  return chunk->data;
+}
+
+// A `lua_Writer` appending to an `std::string`.
+static int
+write_string(lua_State *, const void *p, size_t size, void *ud) {
+  ((std::string *)ud)->append((const char *)p, size);
+  return 0;
+}
 }
 
 namespace Onyx {
+namespace Compiler {
+// Standard functions depending on the outer context.
+// A global function has a null library name.
+static const pair<const char *, const char *> NONIDEMPOTENT[] = {
+    {"os", "clock"},
+    {"os", "date"},
+    {"os", "execute"},
+    {"os", "getenv"},
+    {"os", "remove"},
+    {"os", "rename"},
+    {"os", "time"},
+    {"os", "tmpname"},
+    {"os", "exit"},
+    {"os", "setlocale"},
+    {"io", "close"},
+    {"io", "flush"},
+    {"io", "input"},
+    {"io", "lines"},
+    {"io", "open"},
+    {"io", "output"},
+    {"io", "popen"},
+    {"io", "read"},
+    {"io", "tmpfile"},
+    {"io", "write"},
+    {"math", "random"},
+    {nullptr, "dofile"},
+    {nullptr, "loadfile"},
+    {nullptr, "print"},
+};
+
+// Methods of file handles, e.g. `io.stdin:read()`, all of which
+// depend on or affect the outer context.
+static const char *const NONIDEMPOTENT_METHODS[] = {
+    "close", "flush", "lines", "read", "seek", "setvbuf", "write"};
+
+// Functions of the `debug` library visible to the macro code.
+static const char *const SAFE_DEBUG_FUNCTIONS[] = {"traceback"};
+
+// Snapshot tables reachable from the global table (i.e. libraries
+// and their nested tables, e.g. `package.preload`), as well as
+// the string and file handle metatables, returning a function
+// which restores them by value, including their metatables,
+// and recreates the `nx` table,
+// followed by the pristine global fields and a function checking
+// whether the tables are still pristine. Functions used for
+// restoring are captured beforehand, so that the macro code
+// could not alter them.
+//
+// The `debug.getmetatable` and `debug.setmetatable` functions are
+// passed as arguments, as the `debug` library is hidden by then.
+//
+// `nx.file` and `nx.ctx` are proxies calling the `impure`
+// argument on write, as writing them is a side effect.
+// Their contents are kept in hidden storage tables.
+static const char *SNAPSHOT = R"LUA(
+  local impure, getmetatable, setmetatable = ...
+  local next, rawget, rawset, type = next, rawget, rawset, type
+
+  -- Reading `nx.file` is impure as well, since
+  -- unlike `nx.ctx` it is not a part of the memo key
+  local function proxy(is_opaque)
+    local storage = {}
+
+    local t = {}
+
+    -- Not returning the result, as it is
+    -- a boolean in 5.1 (i.e. LuaJIT)
+    setmetatable(t, {
+      __index = is_opaque and function(_, k)
+        impure()
+        return storage[k]
+      end or storage,
+      __newindex = function(_, k, v)
+        impure()
+        rawset(storage, k, v)
+      end,
+      __pairs = function() return next, storage, nil end,
+      __metatable = false,
+    })
+
+    return t
+  end
+
+  local nx = _G.nx
+  rawset(nx, "file", proxy(true))
+  rawset(nx, "ctx", proxy())
+
+  local snapshot = {}
+
+  -- The proxies are recreated instead
+  local function copy(t)
+    if snapshot[t] or t == nx.file or t == nx.ctx then return end
+    local c = {}
+    snapshot[t] = {fields = c, metatable = getmetatable(t)}
+
+    for k, v in next, t do
+      c[k] = v
+      if type(v) == "table" then copy(v) end
+    end
+  end
+
+  local string_metatable = getmetatable("")
+
+  copy(_G)
+  copy(string_metatable)
+  copy(getmetatable(io.stdout))
+
+  return function()
+    for t, s in next, snapshot do
+      for k in next, t do
+        if s.fields[k] == nil then rawset(t, k, nil) end
+      end
+      for k, v in next, s.fields do rawset(t, k, v) end
+      setmetatable(t, s.metatable)
+    end
+
+    setmetatable("", string_metatable)
+    rawset(nx, "file", proxy(true))
+    rawset(nx, "ctx", proxy())
+
+    -- The new proxies are pristine
+    snapshot[nx].fields.file = nx.file
+    snapshot[nx].fields.ctx = nx.ctx
+  end, snapshot[_G].fields, function()
+    if getmetatable("") ~= string_metatable then return false end
+
+    for t, s in next, snapshot do
+      if getmetatable(t) ~= s.metatable then return false end
+
+      -- A changed or added field, then a removed one
+      for k, v in next, t do
+        if s.fields[k] ~= v then return false end
+      end
+      for k in next, s.fields do
+        if rawget(t, k) == nil then return false end
+      end
+    end
+
+    return true
+  end
+)LUA";
+
+// The maximum number of idle states kept by a thread.
+static const size_t POOL_CAPACITY = 4;
+
+// Create a state with a budget as its allocator state.
+// Memory is allocated from the arena of the budget.
+static lua_State *open() {
+  auto budget = new Budget();
+  auto state = lua_newstate(allocate, budget);
+
+  if (!state)
+    throw "BUG! Failed to create a Lua state";
+
+  lua_atpanic(state, panic);
+  return state;
+}
+
+static void close(lua_State *state) {
+  void *ud;
+  lua_getallocf(state, &ud);
+
+  auto budget = (Budget *)ud;
+  budget->is_closing = true;
+
+  lua_close(state);
+  delete budget;
+}
+
+// Samples of macro evaluations, if profiling is enabled.
+static struct {
+  bool is_enabled = false;
+  Samples samples;
+  std::mutex mutex;
+} profile;
+
+// Samples of a thread, merged into the profile
+// when a macro is destroyed to avoid contention.
+static thread_local Samples thread_samples;
+
+// Idle pristine states of a thread. A state is created and
+// initialized once, then reset between units instead.
+static thread_local struct Pool {
+  vector<lua_State *> states;
+
+  ~Pool() {
+    for (auto state : states)
+      close(state);
+  }
+} pool;
+
+// Reset a released *state* to its pristine snapshot,
+// returning `false` if it is not reusable.
+static bool reset(lua_State *state) {
+  lua_settop(state, 0);
+  lua_getfield(state, LUA_REGISTRYINDEX, RESET_KEY);
+
+  if (lua_pcall(state, 0, 0, 0) != LUA_OK) {
+    ldebug() << "[Macro] Failed to reset a state: "
+             << lua_tostring(state, -1);
+    return false;
+  }
+
+  lua_pushnil(state);
+  lua_setfield(state, LUA_REGISTRYINDEX, IDEMPOTENT_KEY);
+  lua_pushnil(state);
+  lua_setfield(state, LUA_REGISTRYINDEX, OUTPUT_KEY);
+  lua_pushnil(state);
+  lua_setfield(state, LUA_REGISTRYINDEX, PURE_KEY);
+  lua_pushnil(state);
+  lua_setfield(state, LUA_REGISTRYINDEX, SPLICED_KEY);
+  lua_gc(state, LUA_GCCOLLECT, 0);
+
+  return true;
+}
+
+// The maximum number of compiled chunks to keep.
+static const size_t BYTECODE_CACHE_CAPACITY = 4096;
+
+// Compiled macro chunks shared by all threads, so that an identical
+// macro block met again (e.g. in another unit) skips the parser.
+static struct {
+  // Keyed by the source hash; the source size is
+  // stored along to further reduce collisions.
+  unordered_map<uint64_t, pair<size_t, string>> chunks;
+  shared_mutex mutex;
+} bytecode_cache;
+
+// The maximum total size of memoized expansions.
+static const size_t EXPANSION_CACHE_CAPACITY = 64 * 1024 * 1024;
+
+// Outputs of pure macro chunks shared by all threads, so that
+// the same expansion met in another unit (e.g. `@describe` from
+// a spec helper) is not evaluated again.
+static struct {
+  // Keyed by `Macro::_expansion_key`.
+  unordered_map<uint64_t, string> outputs;
+
+  // Keys memoized since the last export.
+  vector<uint64_t> fresh;
+
+  size_t size = 0;
+  shared_mutex mutex;
+} expansion_cache;
+
+// Memoize an expansion *output* by *key*, unless the cache is
+// full. A *fresh* expansion is to be exported later.
+static void memoize(uint64_t key, string output, bool is_fresh) {
+  unique_lock lock(expansion_cache.mutex);
+
+  if (expansion_cache.size + output.size() >
+      EXPANSION_CACHE_CAPACITY)
+    return;
+
+  auto size = output.size();
+
+  if (!expansion_cache.outputs.try_emplace(key, move(output)).second)
+    return;
+
+  expansion_cache.size += size;
+
+  if (is_fresh)
+    expansion_cache.fresh.push_back(key);
+}
+
+// Serialize a value at *index*, returning
+// `nullopt` if its type is not serializable.
+static optional<string> serialize(lua_State *state, int index) {
+  switch (lua_type(state, index)) {
+  case LUA_TNIL:
+    return "l";
+  case LUA_TBOOLEAN:
+    return lua_toboolean(state, index) ? "t" : "f";
+  case LUA_TNUMBER:
+    if (lua_isinteger(state, index))
+      return "i" + to_string(lua_tointeger(state, index));
+    else {
+      char buffer[32];
+      snprintf(
+          buffer,
+          sizeof(buffer),
+          "%.17g",
+          lua_tonumber(state, index));
+      return "n" + string(buffer);
+    }
+  case LUA_TSTRING: {
+    size_t size;
+    auto data = lua_tolstring(state, index, &size);
+    return "s" + string(data, size);
+  }
+  default:
+    return nullopt;
+  }
+}
+
+// The maximum nesting of a table serialized into a memo key.
+static const int CONTEXT_DEPTH = 8;
+
+// Serialize a handle by its token types and sources, which is all
+// the macro code may observe. Returns `false` if a token does not
+// keep its source.
+static bool
+serialize_handle(const Macro::Handle &handle, string &out) {
+  string tokens;
+
+  for (auto &token : handle.tokens) {
+    auto source = token->source();
+
+    if (source.empty())
+      return false;
+
+    tokens += token->type_id() + ':' + to_string(source.size()) +
+              ':' + source;
+  }
+
+  out += to_string(tokens.size() + 1) + ":h" + tokens;
+  return true;
+}
+
+// Serialize a value at *index* into *out*, including tables with
+// their pairs sorted and handles. Returns `false` if a (nested)
+// value is not serializable, e.g. a function or a table with
+// a metatable.
+static bool
+serialize_deep(lua_State *state, int index, string &out, int depth) {
+  if (auto handle =
+          (HandleRef *)luaL_testudata(state, index, HANDLE_METATABLE))
+    return serialize_handle(**handle, out);
+
+  if (lua_type(state, index) != LUA_TTABLE) {
+    auto value = serialize(state, index);
+
+    if (!value)
+      return false;
+
+    out += to_string(value->size()) + ':' + value.value();
+    return true;
+  }
+
+  if (!depth || lua_getmetatable(state, index)) {
+    if (depth)
+      lua_pop(state, 1);
+
+    return false;
+  }
+
+  index = lua_absindex(state, index);
+  vector<pair<string, string>> fields;
+  lua_pushnil(state);
+
+  while (lua_next(state, index)) {
+    string key, value;
+
+    if (!serialize_deep(state, -2, key, 0) ||
+        !serialize_deep(state, -1, value, depth - 1)) {
+      lua_pop(state, 2);
+      return false;
+    }
+
+    fields.emplace_back(move(key), move(value));
+    lua_pop(state, 1);
+  }
+
+  sort(fields.begin(), fields.end());
+  out += '{';
+
+  for (auto &[key, value] : fields)
+    out += key + value;
+
+  out += '}';
+  return true;
+}
+
+// Push a *value* previously returned by `serialize`.
+static void deserialize(lua_State *state, const string &value) {
+  switch (value.at(0)) {
+  case 'l':
+    lua_pushnil(state);
+    break;
+  case 't':
+  case 'f':
+    lua_pushboolean(state, value[0] == 't');
+    break;
+  case 'i':
+    lua_pushinteger(state, stoll(value.substr(1)));
+    break;
+  case 'n':
+    lua_pushnumber(state, strtod(value.c_str() + 1, nullptr));
+    break;
+  case 's':
+    lua_pushlstring(state, value.data() + 1, value.size() - 1);
+    break;
+  default:
+    throw "BUG! Unknown serialized value type";
+  }
+}
 
 Macro::Macro() {
-  _state = luaL_newstate();
+  if (!pool.states.empty()) {
+    _state = pool.states.back();
+    pool.states.pop_back();
+  } else {
+    _state = open();
+    _init();
+  }
+
+  lua_pushlightuserdata((lua_State *)_state, &_is_idempotent);
+  lua_setfield(
+      (lua_State *)_state, LUA_REGISTRYINDEX, IDEMPOTENT_KEY);
+
+  lua_pushlightuserdata((lua_State *)_state, &output);
+  lua_setfield((lua_State *)_state, LUA_REGISTRYINDEX, OUTPUT_KEY);
 
-  luaopen_table((lua_State *)_state);
-  luaopen_string((lua_State *)_state);
+  lua_pushlightuserdata((lua_State *)_state, &_is_pure);
+  lua_setfield((lua_State *)_state, LUA_REGISTRYINDEX, PURE_KEY);
 
-  lua_pushcfunction((lua_State *)_state, lua_emit);
-  lua_setglobal((lua_State *)_state, "emit");
+  lua_pushlightuserdata((lua_State *)_state, &spliced);
+  lua_setfield((lua_State *)_state, LUA_REGISTRYINDEX, SPLICED_KEY);
 
   _is_expression_emitted_onyx_code = false;
+  _is_incomplete = false;
+  _is_explicit_emit = false;
+  _is_idempotent = true;
+  _is_pure = true;
+  _is_pristine = true;
 
   input.clear();
   output.clear();
+  spliced.clear();
 
-  is_incomplete = false;
-  error = nullptr;
+  error = nullopt;
 };
 
-Macro::~Macro() { lua_close((lua_State *)_state); }
+Macro::~Macro() {
+  auto state = (lua_State *)_state;
 
-void Macro::eval() {
-  char buff[256];
+  if (!thread_samples.empty()) {
+    lock_guard lock(profile.mutex);
+
+    for (auto &[stack, entry] : thread_samples) {
+      auto &total = profile.samples[stack];
+      total.duration += entry.duration;
+      total.allocated += entry.allocated;
+      total.count += entry.count;
+    }
+
+    thread_samples.clear();
+  }
+
+  if (pool.states.size() < POOL_CAPACITY && reset(state))
+    pool.states.push_back(state);
+  else
+    close(state);
+}
+
+Macro::Limits Macro::limits;
+
+const char *Macro::engine() { return MACRO_ENGINE; }
+
+void Macro::enable_profiler() { profile.is_enabled = true; }
+
+void Macro::write_profile(ostream &report, ostream &folded) {
+  using namespace chrono;
+  lock_guard lock(profile.mutex);
+
+  // Inclusive by site and exclusive by function
+  unordered_map<string, Sample> sites, functions;
+
+  auto add = [](Sample &total, const Sample &entry) {
+    total.duration += entry.duration;
+    total.allocated += entry.allocated;
+    total.count += entry.count;
+  };
+
+  for (auto &[stack, entry] : profile.samples) {
+    auto first = stack.find(';');
+    add(sites[stack.substr(0, first)], entry);
+
+    if (first != string::npos)
+      add(functions[stack.substr(stack.rfind(';') + 1)], entry);
+
+    auto us = duration_cast<microseconds>(entry.duration).count();
 
-  while (input.getline(buff, sizeof(buff))) {
-    int error = luaL_loadbuffer(
-        (lua_State *)_state, (char *)buff, strlen(buff), "line");
+    if (us > 0)
+      folded << stack << ' ' << us << '\n';
   }
+
+  auto print = [&](const char *title, auto &entries) {
+    vector<pair<string, Sample>> sorted(
+        entries.begin(), entries.end());
+
+    sort(sorted.begin(), sorted.end(), [](auto &a, auto &b) {
+      return a.second.duration > b.second.duration;
+    });
+
+    report << title << '\n'
+           << "        ms   samples     alloc KiB  name\n";
+
+    for (auto &[name, entry] : sorted) {
+      char line[64];
+
+      snprintf(
+          line,
+          sizeof(line),
+          "%10.3f %9llu %13llu  ",
+          duration_cast<nanoseconds>(entry.duration).count() / 1e6,
+          (unsigned long long)entry.count,
+          (unsigned long long)(entry.allocated / 1024));
+
+      report << line << name << '\n';
+    }
+
+    report << '\n';
+  };
+
+  print("Macro sites by total time:", sites);
+  print("Lua functions by self time:", functions);
 }
 
-bool Macro::does_onyx_code_need_escape(char c) { return c == '"'; }
+bool Macro::is_incomplete() { return _is_incomplete; }
 
-void Macro::begin_emit() { input << "\nemit('' .. "; }
+bool Macro::is_idempotent() { return _is_idempotent; }
+
+void Macro::import_expansion(uint64_t key, string output) {
+  memoize(key, move(output), false);
+}
+
+vector<pair<uint64_t, string>> Macro::export_expansions() {
+  unique_lock lock(expansion_cache.mutex);
+  vector<pair<uint64_t, string>> result;
+
+  for (auto key : expansion_cache.fresh)
+    result.emplace_back(key, expansion_cache.outputs.at(key));
+
+  expansion_cache.fresh.clear();
+  return result;
+}
+
+void Macro::eval() {
+  if (_is_explicit_emit) {
+    input += ')';
+    end_emit();
+    _is_explicit_emit = false;
+  }
+
+  auto state = (lua_State *)_state;
+  error = nullopt;
+
+  const auto hash = FNV1a::hash64(input.data(), input.size());
+  const auto key =
+      _is_pristine ? _expansion_key(hash) : optional<uint64_t>();
+
+  if (key) {
+    shared_lock lock(expansion_cache.mutex);
+    auto found = expansion_cache.outputs.find(key.value());
+
+    if (found != expansion_cache.outputs.end()) {
+      output += found->second;
+      _is_incomplete = false;
+      input.clear();
+
+      return;
+    }
+  }
+
+  if (!_load(hash)) {
+    // The chunk is incomplete, e.g. an unterminated `for` loop,
+    // thus the input is kept until the next evaluation
+    if (_is_incomplete)
+      return;
+
+    error = lua_tostring(state, -1);
+    lua_pop(state, 1);
+    input.clear();
 
-void Macro::ensure_begin_emitting_onyx_code() {
-  if (_is_expression_emitted_onyx_code)
     return;
+  }
+
+  _is_incomplete = false;
+  input.clear();
+
+  // Run in the tracking environment with per-chunk flags
+  lua_getfield(state, LUA_REGISTRYINDEX, ENV_KEY);
+  lua_setchunkenv(state, -2);
+
+  const bool was_idempotent = _is_idempotent;
+  const auto offset = output.size();
+  _is_idempotent = true;
+  _is_pure = true;
+
+  const auto status = _pcall(0, 0);
+
+  // Even a failed chunk may have changed the state. The check is
+  // only run on evaluation, a memoized expansion changes nothing
+  if (_is_pristine)
+    _is_pristine = _check_pristine();
+
+  if (status != LUA_OK) {
+    error = lua_tostring(state, -1);
+    lua_pop(state, 1);
+  } else if (key && _is_idempotent && _is_pure && _is_pristine)
+    memoize(key.value(), output.substr(offset), true);
+
+  _is_idempotent = was_idempotent && _is_idempotent;
+}
+
+int Macro::_pcall(int nargs, int nresults) {
+  using namespace chrono;
+  auto state = (lua_State *)_state;
+
+  void *ud;
+  lua_getallocf(state, &ud);
+  auto budget = (Budget *)ud;
+
+  const auto started_at = steady_clock::now();
+
+  budget->peak = budget->used;
+  budget->instructions = 0;
+  budget->exceeded = Budget::None;
+  budget->instruction_limit = limits.instructions;
+  budget->memory_limit =
+      limits.memory ? budget->used + limits.memory : 0;
+  budget->deadline = limits.duration.count()
+                         ? started_at + limits.duration
+                         : steady_clock::time_point::max();
+
+  if (profile.is_enabled) {
+    budget->samples = &thread_samples;
+    budget->site = &site;
+    budget->sampled_at = started_at;
+    budget->allocated = 0;
+    budget->hooks = 0;
+  }
+
+#ifdef FNXC_MACRO_LUAJIT
+  // Hooks are not called from compiled traces, thus a hot loop
+  // would escape the limits and the profiler. Switching the mode
+  // flushes the compiled code, hence only done on a change.
+  const bool is_jit_off = limits.instructions ||
+                          limits.duration.count() ||
+                          profile.is_enabled;
+
+  if (is_jit_off != budget->is_jit_off) {
+    luaJIT_setmode(
+        state,
+        0,
+        LUAJIT_MODE_ENGINE |
+            (is_jit_off ? LUAJIT_MODE_OFF : LUAJIT_MODE_ON));
+
+    budget->is_jit_off = is_jit_off;
+  }
+#endif
+
+  lua_sethook(state, count_hook, LUA_MASKCOUNT, HOOK_STEP);
+  auto status = lua_pcall(state, nargs, nresults, 0);
+  lua_sethook(state, nullptr, 0, 0);
+
+  // The rest since the last sample is attributed to the site
+  if (budget->samples) {
+    sample(nullptr, budget, steady_clock::now());
+    budget->samples = nullptr;
+  }
+
+  budget->memory_limit = 0;
+  const auto duration = steady_clock::now() - started_at;
+
+  if (status == LUA_ERRMEM && limits.memory)
+    budget->exceeded = Budget::Memory;
+
+  if (status != LUA_OK && budget->exceeded != Budget::None) {
+    string message;
+
+    switch (budget->exceeded) {
+    case Budget::Instructions:
+      message = "instruction limit of " +
+                to_string(limits.instructions) + " exceeded";
+      break;
+    case Budget::Memory:
+      message = "memory limit of " + to_string(limits.memory) +
+                " bytes exceeded";
+      break;
+    default:
+      message = "time limit of " +
+                to_string(limits.duration.count()) + " ms exceeded";
+    }
+
+    lua_pop(state, 1);
+    lua_pushstring(state, message.c_str());
+  }
+
+  stats.evaluations++;
+  stats.duration += duration;
+  stats.instructions += budget->instructions;
+  stats.peak_memory = max(stats.peak_memory, budget->peak);
+
+  ltrace() << "[Macro] Evaluated in "
+           << duration_cast<microseconds>(duration).count()
+           << "us, ~" << budget->instructions << " instructions, "
+           << budget->peak << " bytes peak";
+
+  return status;
+}
+
+bool Macro::_check_pristine() {
+  auto state = (lua_State *)_state;
 
+  lua_getfield(state, LUA_REGISTRYINDEX, PRISTINE_KEY);
+
+  // Not limited, as the check is not the macro code
+  const auto is_pristine = lua_pcall(state, 0, 1, 0) == LUA_OK &&
+                           lua_toboolean(state, -1);
+
+  lua_pop(state, 1);
+  return is_pristine;
+}
+
+optional<uint64_t> Macro::_expansion_key(uint64_t hash) {
+  auto state = (lua_State *)_state;
+
+  // Engines differ, e.g. in number formatting
+  string context = MACRO_ENGINE;
+  context += '\0';
+
+  // The storage of the `nx.ctx` proxy
+  lua_getglobal(state, "nx");
+  lua_getfield(state, -1, "ctx");
+
+  if (!lua_getmetatable(state, -1)) {
+    lua_pop(state, 2);
+    return nullopt;
+  }
+
+  lua_getfield(state, -1, "__index");
+
+  const bool is_ok =
+      lua_istable(state, -1) &&
+      serialize_deep(state, -1, context, CONTEXT_DEPTH);
+
+  lua_pop(state, 4);
+
+  if (!is_ok)
+    return nullopt;
+
+  return FNV1a::hash64(context.data(), context.size(), hash);
+}
+
+bool Macro::_load(uint64_t hash) {
+  auto state = (lua_State *)_state;
+
+  {
+    shared_lock lock(bytecode_cache.mutex);
+    auto found = bytecode_cache.chunks.find(hash);
+
+    if (found != bytecode_cache.chunks.end() &&
+        found->second.first == input.size()) {
+      auto &bytecode = found->second.second;
+      Chunk chunk = {bytecode.data(), bytecode.size()};
+
+      if (lua_load(state, read_chunk, &chunk, "=macro", "b") ==
+          LUA_OK)
+        return true;
+
+      lua_pop(state, 1);
+    }
+  }
+
+  Chunk chunk = {input.data(), input.size()};
+
+  if (lua_load(state, read_chunk, &chunk, "=macro", "t") != LUA_OK) {
+    // A syntax error at the end of the input means that the chunk
+    // is not complete yet, e.g. "'end' expected near <eof>", or
+    // "near '<eof>'" in LuaJIT
+    const string_view message = lua_tostring(state, -1);
+
+    _is_incomplete = message.ends_with("<eof>") ||
+                     message.ends_with("<eof>'");
+
+    if (_is_incomplete)
+      lua_pop(state, 1);
+
+    return false;
+  }
+
+  stats.compilations++;
+
+  string bytecode;
+  lua_dump(state, write_string, &bytecode, 0);
+
+  unique_lock lock(bytecode_cache.mutex);
+
+  if (bytecode_cache.chunks.size() < BYTECODE_CACHE_CAPACITY)
+    bytecode_cache.chunks.try_emplace(
+        hash, input.size(), move(bytecode));
+
+  return true;
+}
+
+void Macro::set_context(const string &name,
+                        shared_ptr<Handle> handle) {
+  auto state = (lua_State *)_state;
+
+  // Set into the storage directly, as the proxy
+  // would mark the current chunk impure
+  lua_getglobal(state, "nx");
+  lua_getfield(state, -1, "ctx");
+  lua_getmetatable(state, -1);
+  lua_getfield(state, -1, "__index");
+
+  new (lua_newuserdata(state, sizeof(HandleRef)))
+      HandleRef(move(handle));
+
+  luaL_setmetatable(state, HANDLE_METATABLE);
+  lua_setfield(state, -2, name.c_str());
+  lua_pop(state, 4);
+}
+
+optional<Macro::CacheFunction> Macro::cache_function() {
+  auto state = (lua_State *)_state;
+
+  lua_getglobal(state, "nx");
+  lua_getfield(state, -1, "file");
+  lua_getfield(state, -1, "cache");
+
+  if (!lua_isfunction(state, -1) || lua_iscfunction(state, -1)) {
+    lua_pop(state, 3);
+    return nullopt;
+  }
+
+  CacheFunction function;
+  lua_dump(state, write_string, &function.bytecode, 0);
+
+  // The cache function itself is expected to be non-idempotent,
+  // which shall not affect the unit
+  const bool was_idempotent = _is_idempotent;
+
+  lua_pushnil(state); // There is no previous value yet
+  const bool is_ok = _pcall(1, 1) == LUA_OK;
+
+  _is_idempotent = was_idempotent;
+
+  if (!is_ok) {
+    error = string("nx.file.cache: ") + lua_tostring(state, -1);
+    lua_pop(state, 3);
+    return nullopt;
+  }
+
+  auto value = serialize(state, -1);
+  lua_pop(state, 3);
+
+  if (!value) {
+    ldebug() << "[Macro] nx.file.cache returned "
+             << "a non-serializable value";
+    return nullopt;
+  }
+
+  function.value = value.value();
+  return function;
+}
+
+bool Macro::revalidate(const CacheFunction &function) {
+  Macro macro;
+  auto state = (lua_State *)macro._state;
+
+  if (luaL_loadbufferx(
+          state,
+          function.bytecode.data(),
+          function.bytecode.size(),
+          "nx.file.cache",
+          "b") != LUA_OK) {
+    ldebug() << "[Macro::revalidate] Failed to load: "
+             << lua_tostring(state, -1);
+    return false;
+  }
+
+  deserialize(state, function.value);
+
+  if (macro._pcall(1, 1) != LUA_OK) {
+    ldebug() << "[Macro::revalidate] Failed to call: "
+             << lua_tostring(state, -1);
+    return false;
+  }
+
+  auto value = serialize(state, -1);
+  return value && value.value() == function.value;
+}
+
+bool Macro::needs_escape(char c) { return c == '"'; }
+
+void Macro::begin_emit() { input += "\nemit(''"; }
+
+void Macro::begin_implicit_emit() {
+  begin_emit();
   _is_expression_emitted_onyx_code = true;
-  input << " .. \"";
+  input += " .. \"";
 }
 
-void Macro::begin_emitting_expression() {
-  _end_onyx_code();
-  input << " .. (";
+void Macro::end_implicit_emit() { end_emit(); }
+
+void Macro::begin_explicit_emit() {
+  if (_is_incomplete)
+    _end_onyx_code();
+  else {
+    // Would be closed on `eval`
+    begin_emit();
+    _is_explicit_emit = true;
+  }
+
+  input += " .. (";
 }
 
-void Macro::end_emitting_expression() { input << ')'; }
+void Macro::end_explicit_emit() {
+  input += ')';
+
+  // Continue emitting Onyx code
+  _is_expression_emitted_onyx_code = true;
+  input += " .. \"";
+}
 
 void Macro::end_emit() {
   if (_is_expression_emitted_onyx_code)
     _end_onyx_code();
 
-  input << ")\n";
+  input += ")\n";
+}
+
+void Macro::_init() {
+  auto state = (lua_State *)_state;
+  luaL_openlibs(state);
+  lua_opencompat(state);
+
+  // Wrap non-idempotent functions to reset the flag
+  for (auto &[lib, name] : NONIDEMPOTENT) {
+    if (lib)
+      lua_getglobal(state, lib);
+    else
+      lua_pushglobaltable(state);
+
+    lua_getfield(state, -1, name);
+    lua_pushcclosure(state, lua_nonidempotent, 1);
+    lua_setfield(state, -2, name);
+    lua_pop(state, 1);
+  }
+
+  // The methods are shared by all file handles
+  luaL_getmetatable(state, LUA_FILEHANDLE);
+  lua_getfield(state, -1, "__index");
+
+  for (auto name : NONIDEMPOTENT_METHODS) {
+    lua_getfield(state, -1, name);
+    lua_pushcclosure(state, lua_nonidempotent, 1);
+    lua_setfield(state, -2, name);
+  }
+
+  lua_pop(state, 2);
+
+  lua_getglobal(state, "collectgarbage");
+  lua_pushcclosure(state, lua_collectgarbage, 1);
+  lua_setglobal(state, "collectgarbage");
+
+  lua_getglobal(state, "tostring");
+  lua_pushcclosure(state, lua_tostring_checked, 1);
+  lua_setglobal(state, "tostring");
+
+  lua_getglobal(state, "string");
+  lua_getfield(state, -1, "format");
+  lua_pushcclosure(state, lua_tostring_checked, 1);
+  lua_setfield(state, -2, "format");
+  lua_pop(state, 1);
+
+  lua_getglobal(state, "require");
+  lua_pushcclosure(state, lua_require, 1);
+  lua_setglobal(state, "require");
+
+  lua_pushcfunction(state, lua_emit);
+  lua_setglobal(state, "emit");
+
+  luaL_newmetatable(state, HANDLE_METATABLE);
+  lua_pushcfunction(state, lua_handle_gc);
+  lua_setfield(state, -2, "__gc");
+  lua_pushcfunction(state, lua_handle_tostring);
+  lua_setfield(state, -2, "__tostring");
+  lua_pushcfunction(state, lua_handle_len);
+  lua_setfield(state, -2, "__len");
+  lua_pushcfunction(state, lua_handle_index);
+  lua_setfield(state, -2, "__index");
+  lua_pushboolean(state, false);
+  lua_setfield(state, -2, "__metatable");
+  lua_pop(state, 1);
+
+  // The `nx` table, e.g. `nx.file.cache`; its
+  // `file` and `ctx` fields are set by the snapshot
+  lua_newtable(state);
+  lua_setglobal(state, "nx");
+
+  if (luaL_loadstring(state, SNAPSHOT) != LUA_OK)
+    throw "BUG! Failed to load the Lua snapshot chunk";
+
+  lua_pushcfunction(state, lua_impure);
+  lua_getglobal(state, "debug");
+  lua_getfield(state, -1, "getmetatable");
+  lua_getfield(state, -2, "setmetatable");
+  lua_remove(state, -3);
+
+  // Hide the `debug` library, which would let the macro code
+  // remove the count hook (escaping the limits) or reach hidden
+  // storage tables, e.g. with `debug.getregistry`
+  lua_getglobal(state, "debug");
+  lua_newtable(state);
+
+  for (auto name : SAFE_DEBUG_FUNCTIONS) {
+    lua_getfield(state, -2, name);
+    lua_setfield(state, -2, name);
+  }
+
+  lua_getfield(state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  lua_pushvalue(state, -2);
+  lua_setfield(state, -2, "debug");
+  lua_pop(state, 1);
+  lua_setglobal(state, "debug");
+  lua_pop(state, 1);
+
+  if (lua_pcall(state, 3, 3, 0) != LUA_OK)
+    throw "BUG! Failed to snapshot a Lua state";
+
+  lua_setfield(state, LUA_REGISTRYINDEX, PRISTINE_KEY);
+
+  // The environment proxy tracking global access
+  // by chunks, with the pristine fields on top
+  lua_newtable(state);
+  lua_newtable(state);
+  lua_pushglobaltable(state);
+  lua_pushvalue(state, -4);
+  lua_pushcclosure(state, lua_env_index, 2);
+  lua_setfield(state, -2, "__index");
+  lua_pushglobaltable(state);
+  lua_pushcclosure(state, lua_env_newindex, 1);
+  lua_setfield(state, -2, "__newindex");
+  lua_pushboolean(state, false);
+  lua_setfield(state, -2, "__metatable");
+  lua_setmetatable(state, -2);
+  lua_setfield(state, LUA_REGISTRYINDEX, ENV_KEY);
+
+  lua_pop(state, 1);
+  lua_setfield(state, LUA_REGISTRYINDEX, RESET_KEY);
 }
 
 void Macro::_end_onyx_code() {
@@ -78,6 +1484,7 @@ void Macro::_end_onyx_code() {
     return;
 
   _is_expression_emitted_onyx_code = false;
-  input << '"';
+  input += '"';
 }
+} // namespace Compiler
 } // namespace Onyx
@@ -228,6 +228,13 @@ void Parser::lex() {
   debug_token();
 };
 
+void Parser::tokenize(vector<shared_ptr<Token::Base>> &tokens) {
+  while (!is_eof()) {
+    tokens.push_back(_token);
+    lex();
+  }
+}
+
 void Parser::debug_token() {
   if (auto id = as<Token::Value>())
     wcerr << id->pretty_kind() << '\t' << id->value << '\n';
@@ -0,0 +1,121 @@
+#include <deque>
+#include <unordered_map>
+
+#include "../../header/compiler/reload.hpp"
+
+namespace Onyx {
+namespace Compiler {
+// Previous functions by the low half of one of their hashes.
+using Index =
+    unordered_multimap<uint64_t, const AST::FunctionDefinition *>;
+
+// Remove a function from the *index* which *member* hash equals
+// *hash*. Returns `false` if there is none.
+static bool
+take(Index &index,
+     const FNV1a::Hash128 &hash,
+     FNV1a::Hash128 AST::FunctionDefinition::*member) {
+  auto [begin, end] = index.equal_range(hash.low);
+
+  for (auto it = begin; it != end; it++) {
+    if (it->second->*member == hash) {
+      index.erase(it);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+Reload Reload::classify(
+    const AST::Namespace *previous, AST::Namespace *current) {
+  Reload reload;
+  reload._compare(previous, current);
+
+  if (reload.kind == None &&
+      !(reload.changed.empty() && reload.added.empty()))
+    reload.kind = Bodies;
+
+  return reload;
+}
+
+void Reload::_compare(
+    const AST::Namespace *previous, AST::Namespace *current) {
+  if (kind == Full || previous->hash == current->hash)
+    return;
+
+  if (previous->kind != current->kind ||
+      previous->name != current->name) {
+    kind = Full;
+    return;
+  }
+
+  // Match unchanged functions first, so that an overload which body
+  // has changed does not take the place of an unchanged one
+  Index unchanged;
+
+  for (auto function : previous->functions)
+    unchanged.emplace(function->hash.low, function);
+
+  vector<AST::FunctionDefinition *> unmatched;
+
+  for (auto function : current->functions)
+    if (!take(
+            unchanged,
+            function->hash,
+            &AST::FunctionDefinition::hash))
+      unmatched.push_back(function);
+
+  Index prototypes;
+
+  for (auto [_, function] : unchanged)
+    prototypes.emplace(function->prototype_hash.low, function);
+
+  for (auto function : unmatched) {
+    if (take(
+            prototypes,
+            function->prototype_hash,
+            &AST::FunctionDefinition::prototype_hash))
+      changed.push_back(function);
+    else
+      added.push_back(function);
+  }
+
+  // A function is removed, or its prototype changed
+  if (!prototypes.empty()) {
+    kind = Full;
+    return;
+  }
+
+  // Namespaces may be reopened, thus they are
+  // matched by their names and occurrences
+  unordered_map<string, deque<const AST::Namespace *>> namespaces;
+
+  for (auto child : previous->namespaces)
+    namespaces[child->name].push_back(child);
+
+  for (auto child : current->namespaces) {
+    auto &same = namespaces[child->name];
+
+    if (same.empty())
+      _add(child);
+    else {
+      _compare(same.front(), child);
+      same.pop_front();
+    }
+  }
+
+  for (auto &[_, same] : namespaces)
+    if (!same.empty())
+      kind = Full;
+}
+
+void Reload::_add(AST::Namespace *ns) {
+  added.insert(
+      added.end(), ns->functions.begin(), ns->functions.end());
+
+  for (auto child : ns->namespaces)
+    _add(child);
+}
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,114 @@
+#include "../../header/compiler/structural_hash.hpp"
+
+namespace Onyx {
+namespace Compiler {
+namespace AST {
+// Tags of hashed items, so that e.g. a `foo` ID
+// does not hash the same as a `foo` string.
+enum Tag : uint8_t {
+  ValueTag = 1,
+  ControlTag,
+  SourceTag,
+  SeparatorTag,
+  FunctionTag,
+  NamespaceTag,
+};
+
+static void feed(FNV1a::Hash128 &hash, uint8_t byte) {
+  hash = FNV1a::hash128(&byte, 1, hash);
+}
+
+static void feed(FNV1a::Hash128 &hash, const string &string) {
+  // Including the terminating null
+  hash = FNV1a::hash128(string.c_str(), string.size() + 1, hash);
+}
+
+// Bytes are fed in the big-endian order,
+// so that hashes do not depend on the platform.
+static void feed(FNV1a::Hash128 &hash, uint64_t value) {
+  for (int shift = 56; shift >= 0; shift -= 8)
+    feed(hash, uint8_t(value >> shift));
+}
+
+static void feed(FNV1a::Hash128 &hash, const FNV1a::Hash128 &other) {
+  feed(hash, other.high);
+  feed(hash, other.low);
+}
+
+FNV1a::Hash128 hash(span<const shared_ptr<Token::Base>> tokens) {
+  auto hash = FNV1a::hash128(nullptr, 0);
+  bool is_separated = false, is_empty = true;
+
+  for (size_t i = 0; i < tokens.size(); i++) {
+    auto &token = tokens[i];
+
+    if (Token::is_comment(tokens, i))
+      continue;
+
+    if (auto control = dynamic_cast<Token::Control *>(token.get())) {
+      switch (control->kind) {
+      case Token::Control::Space:
+        continue;
+      case Token::Control::Newline:
+      case Token::Control::Semicolon:
+        is_separated = true;
+        continue;
+      default:
+        break;
+      }
+    }
+
+    if (is_separated && !is_empty)
+      feed(hash, uint8_t(SeparatorTag));
+
+    is_separated = false;
+    is_empty = false;
+
+    if (auto value = dynamic_cast<Token::Value *>(token.get())) {
+      feed(hash, uint8_t(ValueTag));
+      feed(hash, uint8_t(value->kind));
+      feed(hash, value->value);
+    } else if (auto control =
+                   dynamic_cast<Token::Control *>(token.get())) {
+      feed(hash, uint8_t(ControlTag));
+      feed(hash, uint8_t(control->kind));
+    } else {
+      feed(hash, uint8_t(SourceTag));
+      feed(hash, token->source());
+    }
+  }
+
+  return hash;
+}
+
+void rehash(
+    FunctionDefinition *definition,
+    span<const shared_ptr<Token::Base>> prototype,
+    span<const shared_ptr<Token::Base>> body) {
+  definition->prototype_hash = hash(prototype);
+  definition->body_hash = hash(body);
+
+  auto &combined = definition->hash = FNV1a::hash128(nullptr, 0);
+  feed(combined, uint8_t(FunctionTag));
+  feed(combined, definition->prototype_hash);
+  feed(combined, definition->body_hash);
+}
+
+void rehash(Namespace *ns) {
+  auto &hash = ns->hash = FNV1a::hash128(nullptr, 0);
+
+  feed(hash, uint8_t(NamespaceTag));
+  feed(hash, uint8_t(ns->kind));
+  feed(hash, ns->name);
+
+  feed(hash, uint64_t(ns->functions.size()));
+  for (auto function : ns->functions)
+    feed(hash, function->hash);
+
+  feed(hash, uint64_t(ns->namespaces.size()));
+  for (auto child : ns->namespaces)
+    feed(hash, child->hash);
+}
+} // namespace AST
+} // namespace Compiler
+} // namespace Onyx
@@ -1,8 +1,7 @@
-#include "../../header/compile/token.hpp"
-#include "../../header/utils/containers.hpp"
+#include "../../header/compiler/token.hpp"
 
 namespace Onyx {
-namespace Compile {
+namespace Compiler {
 namespace Token {
 const unordered_map<Keyword::Kind, string> Keyword::_map = {
     {Var, "var"},
@@ -59,8 +58,94 @@ const set<string> Value::_comment_intrinsics = {
     "nodoc",
 };
 
-const unordered_map<string, Keyword::Kind> Keyword::_invmap =
-    inverse_map(_map);
+const unordered_map<string, Keyword::Kind> Keyword::_invmap = []() {
+  unordered_map<string, Kind> map;
+
+  for (auto &[kind, string] : _map)
+    map.emplace(string, kind);
+
+  return map;
+}();
+
+string Base::source() { return ""; }
+string Base::type_id() { return "Base"; }
+
+string Control::source() {
+  switch (kind) {
+  case Eof:
+    return "";
+  case Newline:
+    return "\n";
+  case Space:
+    return " ";
+  case Comment:
+    return "#";
+  case Dot:
+    return ".";
+  case Comma:
+    return ",";
+  case Semicolon:
+    return ";";
+  case Colon:
+    return ":";
+  case DoubleColon:
+    return "::";
+  case DotColon:
+    return ":.";
+  case Splat:
+    return "..";
+  case Assignment:
+    return "=";
+  case Ternary:
+    return "?";
+  case Elvis:
+    return "?:";
+  case SingleQuote:
+    return "'";
+  case DoubleQuotes:
+    return "\"";
+  case Tick:
+    return "`";
+  case OpenParen:
+    return "(";
+  case CloseParen:
+    return ")";
+  case OpenCurly:
+    return "{";
+  case CloseCurly:
+    return "}";
+  case OpenSquare:
+    return "[";
+  case CloseSquare:
+    return "]";
+  case BlockPipe:
+    return "|";
+  case Annotation:
+    return "@[";
+  case DelayedMacro:
+    return "\\{%";
+  case DelayedEmitMacro:
+    return "\\{{";
+  case MacroClose:
+    return "%}";
+  case EmitMacroClose:
+    return "}}";
+  case CurlyArrow:
+    return "~>";
+  case ThinArrow:
+    return "->";
+  case ThickArrow:
+    return "=>";
+  case PipeArrow:
+    return "|>";
+  }
+
+  throw "BUG! Unknown control token kind";
+}
+
+string Control::type_id() { return "Control"; }
+
+Keyword::Keyword(Location loc, Kind kind) : Base(loc), kind(kind) {}
 
 optional<Keyword::Kind> Keyword::from_string(string cmp) {
   auto pos = _invmap.find(cmp);
@@ -83,6 +168,92 @@ string Keyword::to_string() {
 bool Value::is_comment_intrinsic(string checked) {
   return _comment_intrinsics.count(checked) > 0;
 }
+
+string Value::source() {
+  switch (kind) {
+  case CID:
+    return '`' + value + '`';
+  case Kwarg:
+    return value + ':';
+  case Intrinsic:
+    return '@' + value;
+  case CommentIntrinsic:
+    return ':' + value + ':';
+  case Symbol:
+    return ':' + value;
+  case StringSymbol:
+    return ":\"" + value + '"';
+  default:
+    return value;
+  }
+}
+
+string Value::type_id() { return "Value"; }
+
+CharLiteral::CharLiteral(Location loc, Codepoint codepoint) :
+    Base(loc), codepoint(codepoint) {}
+
+string CharLiteral::source() {
+  return '\'' + codepoint._source + '\'';
+}
+
+string CharLiteral::type_id() { return "CharLiteral"; }
+
+string StringLiteral::source() {
+  string source = "\"";
+
+  for (auto &codepoint : codepoints) {
+    if (holds_alternative<Linebreak>(codepoint))
+      source += '\n';
+    else
+      source += get<Codepoint>(codepoint)._source;
+  }
+
+  return source + '"';
+}
+
+string StringLiteral::type_id() { return "StringLiteral"; }
+
+string NumericLiteral::source() {
+  static const char *RADICES[] = {"", "0b", "0o", "0x"};
+  static const char *TYPES[] = {"", "i", "u", "f"};
+
+  string source = RADICES[radix];
+  source.append(whole.begin(), whole.end());
+
+  if (fraction) {
+    source += '.';
+    source.append(fraction->begin(), fraction->end());
+  }
+
+  if (exponent)
+    source += 'e' + to_string(exponent.value());
+
+  source += TYPES[type];
+
+  if (bitsize)
+    source += to_string(bitsize);
+
+  return source;
+}
+
+string NumericLiteral::type_id() { return "NumericLiteral"; }
+
+bool is_comment(span<const shared_ptr<Base>> tokens, size_t index) {
+  for (;; index--) {
+    auto token = tokens[index].get();
+
+    if (auto value = dynamic_cast<Value *>(token)) {
+      if ((value->kind != Value::Text &&
+           value->kind != Value::CommentIntrinsic) ||
+          !index)
+        return false;
+    } else {
+      auto control = dynamic_cast<Control *>(token);
+      return control && control->kind == Control::Comment;
+    }
+  }
+}
 } // namespace Token
-} // namespace Compile
+} // namespace Compiler
 } // namespace Onyx
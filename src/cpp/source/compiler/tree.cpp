@@ -0,0 +1,292 @@
+#include "../../header/compiler/tree.hpp"
+
+namespace Onyx {
+namespace Compiler {
+namespace AST {
+const shared_ptr<Token::Value> &Tree::Handle::token() const {
+  return _tree->token_table[_tree->tokens[_index]];
+}
+
+void Tree::Handle::dump(ostream *out, unsigned short tab) const {
+  // Pending nodes along with their indentation, the next one last
+  vector<pair<Handle, size_t>> stack = {{*this, tab}};
+
+  while (!stack.empty()) {
+    auto [node, tab] = stack.back();
+    stack.pop_back();
+
+    *out << string(tab * 2, ' ') << kind_name(node.kind());
+
+    if (auto &token = node.token())
+      *out << ' ' << token->value;
+
+    switch (node.kind()) {
+    case Kind::Root:
+    case Kind::Namespace:
+    case Kind::Module:
+    case Kind::NamedArgument:
+      // The data is an interned name, empty for the root
+      if (auto name = Interner::global().lookup(node.data());
+          !name.empty())
+        *out << ' ' << name;
+
+      break;
+    default:
+      if (node.data())
+        *out << " #" << node.data();
+    }
+
+    *out << '\n';
+
+    for (auto i = node.size(); i > 0; i--)
+      stack.push_back({node[i - 1], tab + 1});
+  }
+}
+
+Tree::Tree(const Node *root) {
+  token_table.push_back(nullptr);
+  _flatten(root);
+}
+
+Tree::Index Tree::_push(
+    Kind kind,
+    const shared_ptr<Token::Value> &token,
+    uint32_t value) {
+  const auto index = Index(kinds.size());
+
+  kinds.push_back(kind);
+  data.push_back(value);
+  first_children.push_back(0);
+  child_counts.push_back(0);
+
+  if (token) {
+    tokens.push_back(Index(token_table.size()));
+    token_table.push_back(token);
+  } else
+    tokens.push_back(0);
+
+  return index;
+}
+
+void Tree::_flatten(const Node *root) {
+  // A node to append, which is either a SAST node or a named
+  // argument, and the index of its parent's `children` to set
+  struct Step {
+    const Node *node;
+    const NamedArgument *named = nullptr;
+    size_t slot = 0;
+  };
+
+  // Pending nodes, the next one last, so that nodes are appended
+  // depth-first without recursion
+  vector<Step> stack = {{root}};
+
+  // Children of the current node
+  SmallVector<Step, 8> nodes;
+
+  while (!stack.empty()) {
+    const auto step = stack.back();
+    stack.pop_back();
+
+    auto node = step.node;
+    Index index;
+    nodes.clear();
+
+    auto arguments = [&](const Arguments &args) {
+      for (auto arg : args.ordered_arguments)
+        nodes.push_back({arg});
+
+      // In the dump order
+      for (auto arg : args.sorted_named())
+        nodes.push_back({nullptr, arg});
+    };
+
+    if (step.named) {
+      index = _push(Kind::NamedArgument, nullptr, step.named->name);
+      nodes.push_back({step.named->value});
+    } else if (!node)
+      index = _push(Kind::Empty, nullptr, 0);
+    else
+      switch (node->kind) {
+      case Kind::Root:
+      case Kind::Namespace:
+      case Kind::Module: {
+        auto ns = static_cast<const Namespace *>(node);
+
+        index = _push(
+            node->kind,
+            nullptr,
+            Interner::global().intern(ns->name));
+
+        for (auto function : ns->functions)
+          nodes.push_back({function});
+
+        for (auto child : ns->namespaces)
+          nodes.push_back({child});
+
+        if (node->kind == Kind::Module)
+          for (auto declaration : static_cast<const Module *>(node)
+                                      ->function_declarations)
+            nodes.push_back({declaration});
+
+        break;
+      }
+
+      case Kind::Enum:
+      case Kind::Annotation:
+      case Kind::Literal:
+        index = _push(node->kind, nullptr, 0);
+        break;
+
+      case Kind::FunctionDefinition: {
+        auto function =
+            static_cast<const FunctionDefinition *>(node);
+
+        index = _push(Kind::FunctionDefinition, nullptr, 0);
+        nodes.push_back({function->prototype});
+        nodes.push_back({function->body});
+
+        break;
+      }
+
+      case Kind::FunctionDeclaration: {
+        auto function =
+            static_cast<const FunctionDeclaration *>(node);
+
+        index = _push(Kind::FunctionDeclaration, nullptr, 0);
+        nodes.push_back({function->prototype});
+
+        break;
+      }
+
+      case Kind::FunctionPrototype: {
+        auto proto = static_cast<const FunctionPrototype *>(node);
+        index = _push(Kind::FunctionPrototype, proto->name, 0);
+
+        for (auto annotation : proto->annotations)
+          nodes.push_back({annotation});
+
+        for (auto arg : proto->args)
+          nodes.push_back({arg});
+
+        break;
+      }
+
+      case Kind::FunctionArgumentDeclaration: {
+        auto arg =
+            static_cast<const FunctionArgumentDeclaration *>(node);
+
+        index = _push(
+            Kind::FunctionArgumentDeclaration,
+            arg->name,
+            uint32_t(arg->type) << 1 | arg->is_const);
+
+        for (auto annotation : arg->annotations)
+          nodes.push_back({annotation});
+
+        nodes.push_back({arg->restriction});
+        nodes.push_back({arg->default_value});
+
+        break;
+      }
+
+      case Kind::AnnotationApplication: {
+        auto annotation =
+            static_cast<const AnnotationApplication *>(node);
+
+        index = _push(
+            Kind::AnnotationApplication,
+            annotation->id,
+            annotation->args.ordered_arguments.size());
+
+        arguments(annotation->args);
+        break;
+      }
+
+      case Kind::Body:
+        index = _push(Kind::Body, nullptr, 0);
+
+        for (auto expr :
+             static_cast<const Body *>(node)->expressions)
+          nodes.push_back({expr});
+
+        break;
+
+      case Kind::ID:
+        index =
+            _push(Kind::ID, static_cast<const ID *>(node)->value, 0);
+        break;
+
+      case Kind::Splat: {
+        auto splat = static_cast<const Splat *>(node);
+        index = _push(Kind::Splat, splat->id, splat->is_named);
+        break;
+      }
+
+      case Kind::Binop: {
+        auto binop = static_cast<const Binop *>(node);
+
+        index = _push(Kind::Binop, binop->op, 0);
+        nodes.push_back({binop->lhx});
+        nodes.push_back({binop->rhx});
+
+        break;
+      }
+
+      case Kind::Unop: {
+        auto unop = static_cast<const Unop *>(node);
+
+        index = _push(Kind::Unop, unop->op, 0);
+        nodes.push_back({unop->expr});
+
+        break;
+      }
+
+      case Kind::Ternary: {
+        auto ternary = static_cast<const Ternary *>(node);
+
+        index = _push(Kind::Ternary, nullptr, 0);
+        nodes.push_back({ternary->cond});
+        nodes.push_back({ternary->then});
+        nodes.push_back({ternary->else_});
+
+        break;
+      }
+
+      case Kind::Call: {
+        auto call = static_cast<const Call *>(node);
+
+        index = _push(
+            Kind::Call,
+            call->callee,
+            call->args.ordered_arguments.size());
+
+        nodes.push_back({call->caller});
+        arguments(call->args);
+
+        break;
+      }
+
+      default:
+        throw "BUG! Unexpected SAST node to flatten";
+      }
+
+    // The root is the only node without a parent
+    if (index)
+      children[step.slot] = index;
+
+    // Children are appended later, their slots are reserved now
+    const auto first = children.size();
+    first_children[index] = first;
+    child_counts[index] = nodes.size();
+    children.resize(first + nodes.size());
+
+    for (auto i = nodes.size(); i > 0; i--) {
+      nodes[i - 1].slot = first + i - 1;
+      stack.push_back(nodes[i - 1]);
+    }
+  }
+}
+} // namespace AST
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <sstream>
+#include <variant>
+
+#include "../../header/compiler/ast.hpp"
+#include "../../header/compiler/unit.hpp"
+#include "../../header/compiler/usage.hpp"
+#include "../../header/utils/fnv1a.hpp"
+
+namespace Onyx {
+namespace Compiler {
+// A part of a canonical representation of an expression:
+// a subexpression, which may be empty, or a text.
+using Part = variant<AST::Expression *, string_view>;
+
+// Append parts of call *args*, e.g. `(a,x:b,)`.
+static void
+arguments(const AST::Arguments &args, vector<Part> &parts) {
+  parts.push_back("(");
+
+  for (auto arg : args.ordered_arguments) {
+    parts.push_back(arg);
+    parts.push_back(",");
+  }
+
+  // Name ids depend on the interning order,
+  // thus the names are sorted for a stable signature
+  for (auto arg : args.sorted_named()) {
+    parts.push_back(Interner::global().lookup(arg->name));
+    parts.push_back(":");
+    parts.push_back(arg->value);
+    parts.push_back(",");
+  }
+
+  parts.push_back(")");
+}
+
+// Write a canonical representation of *parts* into *out* (if any),
+// ignoring locations, and note consumed names. Subexpressions are
+// expanded on an explicit stack, so that a deep expression (e.g.
+// a long operator chain) would not overflow the native stack.
+static void write(ostream *out, vector<Part> parts, Usage &usage) {
+  // Pending parts, the next one last
+  vector<Part> stack(parts.rbegin(), parts.rend());
+
+  while (!stack.empty()) {
+    auto part = stack.back();
+    stack.pop_back();
+
+    if (auto text = get_if<string_view>(&part)) {
+      if (out)
+        *out << *text;
+
+      continue;
+    }
+
+    auto expr = get<AST::Expression *>(part);
+    parts.clear();
+
+    if (!expr) {
+      if (out)
+        *out << '_';
+
+      continue;
+    }
+
+    switch (expr->kind) {
+    case AST::Kind::ID: {
+      auto id = static_cast<AST::ID *>(expr);
+      usage.consumptions.insert(id->value->value);
+
+      if (out)
+        *out << id->value->value;
+
+      break;
+    }
+
+    case AST::Kind::Splat: {
+      auto splat = static_cast<AST::Splat *>(expr);
+      usage.consumptions.insert(splat->id->value);
+
+      if (out)
+        *out << (splat->is_named ? "**" : "..") << splat->id->value;
+
+      break;
+    }
+
+    case AST::Kind::Binop: {
+      auto binop = static_cast<AST::Binop *>(expr);
+      parts = {"(", binop->lhx, binop->op->value, binop->rhx, ")"};
+      break;
+    }
+
+    case AST::Kind::Unop: {
+      auto unop = static_cast<AST::Unop *>(expr);
+      parts = {unop->op->value, unop->expr};
+      break;
+    }
+
+    case AST::Kind::Ternary: {
+      auto ternary = static_cast<AST::Ternary *>(expr);
+
+      parts = {
+          "(",
+          ternary->cond,
+          "?",
+          ternary->then,
+          ":",
+          ternary->else_,
+          ")"};
+
+      break;
+    }
+
+    case AST::Kind::Call: {
+      auto call = static_cast<AST::Call *>(expr);
+      usage.consumptions.insert(call->callee->value);
+
+      if (call->caller)
+        parts = {call->caller, "."};
+
+      parts.push_back(call->callee->value);
+      arguments(call->args, parts);
+
+      break;
+    }
+
+    default:
+      // Literals do not consume anything, and
+      // do not appear in signatures verbatim yet
+      if (out)
+        *out << '?';
+    }
+
+    stack.insert(stack.end(), parts.rbegin(), parts.rend());
+  }
+}
+
+static void
+write(ostream *out, const AST::Arguments &args, Usage &usage) {
+  vector<Part> parts;
+  arguments(args, parts);
+  write(out, move(parts), usage);
+}
+
+// Return a hash of a function *prototype*, noting consumed names.
+static uint64_t
+signature(AST::FunctionPrototype *proto, Usage &usage) {
+  stringstream ss;
+
+  for (auto &annotation : proto->annotations) {
+    ss << '@' << annotation->id->value;
+    write(&ss, annotation->args, usage);
+  }
+
+  // Modifiers may be written in any order
+  vector<string_view> modifiers;
+
+  for (auto &modifier : proto->modifiers)
+    modifiers.push_back(modifier->value);
+
+  sort(modifiers.begin(), modifiers.end());
+
+  for (auto &modifier : modifiers)
+    ss << modifier << ' ';
+
+  ss << proto->name->value << '(';
+
+  for (auto &arg : proto->args) {
+    ss << (arg->is_const ? "const " : "") << arg->type << ' ';
+
+    if (arg->alias)
+      ss << arg->alias->value << ' ';
+
+    ss << arg->name->value << ':';
+    write(&ss, {arg->restriction}, usage);
+    ss << '=';
+    write(&ss, {arg->default_value}, usage);
+    ss << ',';
+  }
+
+  ss << ')';
+  return FNV1a::hash64(ss.str());
+}
+
+static void
+collect(const Unit &unit, AST::Namespace *ns, Usage &usage) {
+  for (auto &function : ns->functions) {
+    auto &name = function->prototype->name->value;
+
+    // Overloads are combined in an order-independent manner
+    usage.exports[name] += signature(function->prototype, usage);
+
+    if (function->body)
+      for (auto &expr : function->body->expressions)
+        write(nullptr, {expr}, usage);
+    else if (function->is_lazy())
+      for (auto i = function->body_begin; i < function->body_end;
+           i++) {
+        auto id = dynamic_cast<Token::Value *>(unit.tokens[i].get());
+
+        if (id && id->kind == Token::Value::ID)
+          usage.consumptions.insert(id->value);
+      }
+  }
+
+  for (auto &child : ns->namespaces)
+    collect(unit, child, usage);
+}
+
+Usage Usage::collect(const Unit &unit) {
+  Usage usage;
+
+  if (unit.sast)
+    Compiler::collect(unit, unit.sast, usage);
+
+  return usage;
+}
+} // namespace Compiler
+} // namespace Onyx
@@ -0,0 +1,216 @@
+#include <cstring>
+#include <new>
+
+#include "../../header/utils/arena.hpp"
+
+// The number of chunks kept on reset.
+static const size_t RETAINED_CHUNKS = 16;
+
+static void *allocate_aligned(size_t size) {
+  return ::operator new(
+      size, std::align_val_t(Arena::ALIGNMENT), std::nothrow);
+}
+
+static void free_aligned(void *block) {
+  ::operator delete(block, std::align_val_t(Arena::ALIGNMENT));
+}
+
+// Return the size class of a small block.
+static size_t class_of(size_t size) {
+  return (size + Arena::ALIGNMENT - 1) / Arena::ALIGNMENT - 1;
+}
+
+Arena::Arena() :
+    _free(), _large(nullptr), _large_size(0), _chunk(0),
+    _cursor(nullptr), _end(nullptr) {}
+
+Arena::~Arena() {
+  reset();
+
+  for (auto chunk : _chunks)
+    free_aligned(chunk);
+}
+
+void *Arena::allocate(size_t size) {
+  if (!size)
+    size = 1;
+
+  if (size > MAX_SMALL_SIZE)
+    return _allocate_large(size);
+
+  const auto index = class_of(size);
+
+  if (auto block = _free[index]) {
+    _free[index] = block->next;
+    return block;
+  }
+
+  const auto block_size = (index + 1) * ALIGNMENT;
+
+  if (size_t(_end - _cursor) < block_size && !_next_chunk())
+    return nullptr;
+
+  auto block = _cursor;
+  _cursor += block_size;
+
+  return block;
+}
+
+void *
+Arena::reallocate(void *block, size_t old_size, size_t new_size) {
+  if (!block)
+    return allocate(new_size);
+
+  // A block of the same class fits as is
+  if (old_size <= MAX_SMALL_SIZE && new_size <= MAX_SMALL_SIZE &&
+      class_of(old_size ? old_size : 1) ==
+          class_of(new_size ? new_size : 1))
+    return block;
+
+  auto result = allocate(new_size);
+
+  if (!result)
+    return nullptr;
+
+  memcpy(result, block, old_size < new_size ? old_size : new_size);
+  free(block, old_size);
+
+  return result;
+}
+
+void Arena::free(void *block, size_t size) {
+  if (!block)
+    return;
+
+  if (size > MAX_SMALL_SIZE)
+    return _free_large(block);
+
+  const auto index = class_of(size ? size : 1);
+  auto free_block = (FreeBlock *)block;
+
+  free_block->next = _free[index];
+  _free[index] = free_block;
+}
+
+void Arena::reset() {
+  // An object may refer to another one, made before it
+  for (auto it = _destructors.rbegin(); it != _destructors.rend();
+       it++)
+    it->second(it->first);
+
+  _destructors.clear();
+
+  while (_large)
+    _free_large(_large + 1);
+
+  while (_chunks.size() > RETAINED_CHUNKS) {
+    free_aligned(_chunks.back());
+    _chunks.pop_back();
+  }
+
+  memset(_free, 0, sizeof(_free));
+
+  _chunk = 0;
+
+  if (_chunks.empty())
+    _cursor = _end = nullptr;
+  else {
+    _cursor = _chunks[0];
+    _end = _cursor + CHUNK_SIZE;
+  }
+}
+
+void Arena::adopt(Arena &other) {
+  _destructors.insert(
+      _destructors.end(),
+      other._destructors.begin(),
+      other._destructors.end());
+
+  // Adopted chunks are in use, thus go before the current one,
+  // never to be carved again until reset
+  _chunks.insert(
+      _chunks.begin() + _chunk,
+      other._chunks.begin(),
+      other._chunks.end());
+
+  _chunk += other._chunks.size();
+
+  if (auto last = other._large) {
+    while (last->next)
+      last = last->next;
+
+    last->next = _large;
+
+    if (_large)
+      _large->prev = last;
+
+    _large = other._large;
+    _large_size += other._large_size;
+  }
+
+  other._destructors.clear();
+  other._chunks.clear();
+  memset(other._free, 0, sizeof(other._free));
+  other._large = nullptr;
+  other._large_size = 0;
+  other._chunk = 0;
+  other._cursor = other._end = nullptr;
+}
+
+size_t Arena::reserved() const {
+  return _chunks.size() * CHUNK_SIZE + _large_size;
+}
+
+bool Arena::_next_chunk() {
+  if (_cursor)
+    _chunk++;
+
+  if (_chunk == _chunks.size()) {
+    auto chunk = (char *)allocate_aligned(CHUNK_SIZE);
+
+    if (!chunk)
+      return false;
+
+    _chunks.push_back(chunk);
+  }
+
+  _cursor = _chunks[_chunk];
+  _end = _cursor + CHUNK_SIZE;
+
+  return true;
+}
+
+void *Arena::_allocate_large(size_t size) {
+  auto header =
+      (LargeHeader *)allocate_aligned(sizeof(LargeHeader) + size);
+
+  if (!header)
+    return nullptr;
+
+  header->prev = nullptr;
+  header->next = _large;
+  header->size = size;
+
+  if (_large)
+    _large->prev = header;
+
+  _large = header;
+  _large_size += size;
+
+  return header + 1;
+}
+
+void Arena::_free_large(void *block) {
+  auto header = (LargeHeader *)block - 1;
+
+  if (header->prev)
+    header->prev->next = header->next;
+  else
+    _large = header->next;
+
+  if (header->next)
+    header->next->prev = header->prev;
+
+  _large_size -= header->size;
+  free_aligned(header);
+}
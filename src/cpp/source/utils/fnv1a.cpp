@@ -20,12 +20,15 @@ uint32_t FNV1a::hash32(const std::string input) {
 }
 
 uint64_t FNV1a::hash64(const void *input, const uint64_t length) {
-  const char *data = (char *)input;
+  return hash64(input, length, 0xcbf29ce484222325);
+}
 
-  uint64_t hash = 0xcbf29ce484222325;
+uint64_t FNV1a::hash64(
+    const void *input, const uint64_t length, uint64_t hash) {
+  const char *data = (char *)input;
   uint64_t prime = 0x100000001b3;
 
-  for (int i = 0; i < length; ++i) {
+  for (uint64_t i = 0; i < length; ++i) {
     uint8_t value = data[i];
     hash = hash ^ value;
     hash *= prime;
@@ -37,3 +40,34 @@ uint64_t FNV1a::hash64(const void *input, const uint64_t length) {
 uint64_t FNV1a::hash64(const std::string input) {
   return hash64(input.c_str(), input.size());
 }
+
+FNV1a::Hash128
+FNV1a::hash128(const void *input, const uint64_t length) {
+  return hash128(
+      input, length, {0x6c62272e07bb0142, 0x62b821756295c58d});
+}
+
+FNV1a::Hash128 FNV1a::hash128(
+    const void *input, const uint64_t length, Hash128 hash) {
+  const char *data = (char *)input;
+
+  // The prime is `2^88 + 0x13b`; the product is computed
+  // in 32-bit halves, as there is no portable 128-bit integer
+  const uint64_t prime = 0x13b;
+  const uint64_t mask = 0xffffffff;
+
+  for (uint64_t i = 0; i < length; ++i) {
+    uint8_t value = data[i];
+    hash.low ^= value;
+
+    const uint64_t a = (hash.low & mask) * prime;
+    const uint64_t b = (hash.low >> 32) * prime;
+    const uint64_t middle = (a >> 32) + (b & mask);
+
+    hash.high = hash.high * prime + (b >> 32) + (middle >> 32) +
+                (hash.low << 24);
+    hash.low = (a & mask) | (middle << 32);
+  }
+
+  return hash;
+}
@@ -0,0 +1,42 @@
+#include <mutex>
+
+#include "../../header/utils/interner.hpp"
+
+Interner::Id Interner::intern(std::string_view string) {
+  {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _ids.find(string);
+
+    if (it != _ids.end())
+      return it->second;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+
+  // Another thread may have interned it meanwhile
+  auto it = _ids.find(string);
+
+  if (it != _ids.end())
+    return it->second;
+
+  const auto id = Id(_strings.size());
+  _strings.emplace_back(string);
+  _ids.emplace(_strings.back(), id);
+
+  return id;
+}
+
+std::string_view Interner::lookup(Id id) const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _strings.at(id);
+}
+
+size_t Interner::size() const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _strings.size();
+}
+
+Interner &Interner::global() {
+  static Interner interner;
+  return interner;
+}
@@ -0,0 +1,73 @@
+#include "../../header/utils/task_queue.hpp"
+
+TaskQueue::TaskQueue(std::function<void()> notify) :
+    _notify(std::move(notify)) {}
+
+std::shared_ptr<TaskQueue::Task>
+TaskQueue::push(std::function<void()> run) {
+  auto task = std::make_shared<Task>();
+  task->run = std::move(run);
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push(task);
+  }
+
+  // A joining thread may run the task as well
+  _condvar.notify_all();
+
+  if (_notify)
+    _notify();
+
+  return task;
+}
+
+std::shared_ptr<TaskQueue::Task> TaskQueue::pop() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_tasks.empty())
+    return nullptr;
+
+  auto task = _tasks.front();
+  _tasks.pop();
+
+  return task;
+}
+
+void TaskQueue::run(std::shared_ptr<Task> task) {
+  try {
+    task->run();
+  } catch (...) {
+    task->exception = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    task->is_done = true;
+  }
+
+  _condvar.notify_all();
+}
+
+void TaskQueue::join(
+    const std::vector<std::shared_ptr<Task>> &tasks) {
+  for (auto &task : tasks) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!task->is_done) {
+      if (!_tasks.empty()) {
+        const auto next = _tasks.front();
+        _tasks.pop();
+        lock.unlock();
+
+        run(next);
+        lock.lock();
+      } else
+        _condvar.wait(lock);
+    }
+  }
+
+  for (auto &task : tasks)
+    if (task->exception)
+      std::rethrow_exception(task->exception);
+}
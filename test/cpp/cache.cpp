@@ -0,0 +1,419 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <fstream>
+#include <random>
+
+#include "SQLiteCpp/Database.h"
+#include "SQLiteCpp/Statement.h"
+
+#include "../../src/cpp/header/app/shared/cache.hpp"
+#include "../../src/cpp/header/utils/log.hpp"
+
+using namespace Onyx;
+using App::Shared::Cache;
+
+Verbosity verbosity = Warn;
+
+// A temporary directory removed on destruction.
+struct TempDir {
+  filesystem::path path;
+
+  TempDir() {
+    random_device device;
+
+    path = filesystem::temp_directory_path() /
+           ("fnxc-test-" + to_string(device()));
+
+    filesystem::create_directories(path);
+  }
+
+  ~TempDir() { filesystem::remove_all(path); }
+};
+
+static void write(filesystem::path path, const string &contents) {
+  ofstream(path, ios::binary | ios::trunc) << contents;
+}
+
+// Open a cache, validating it.
+static unique_ptr<Cache> open(const TempDir &dir) {
+  auto cache = make_unique<Cache>(dir.path / "cache", "target", 2);
+  cache->validate();
+  return cache;
+}
+
+TEST_CASE("testing `Cache` stat tier") {
+  TempDir dir;
+  auto source = dir.path / "main.nx";
+  write(source, "foo");
+
+  open(dir)->update(source, {}, {});
+  auto mtime = filesystem::last_write_time(source);
+
+  // Same size, inode and modification time: the contents is not
+  // hashed at all, thus a change is not noticed
+  write(source, "bar");
+  filesystem::last_write_time(source, mtime);
+  CHECK(open(dir)->is_fresh(source));
+
+  // Different size
+  write(source, "foobar");
+  filesystem::last_write_time(source, mtime);
+  CHECK(!open(dir)->is_fresh(source));
+}
+
+TEST_CASE("testing `Cache` hash tier") {
+  TempDir dir;
+  auto source = dir.path / "main.nx";
+  write(source, "foo");
+
+  open(dir)->update(source, {}, {});
+  auto mtime = filesystem::last_write_time(source);
+
+  // Touched, but the contents is the same
+  filesystem::last_write_time(source, mtime + chrono::seconds(1));
+
+  {
+    auto cache = open(dir);
+    CHECK(cache->is_fresh(source));
+
+    // The new stat is written back on flush
+    cache->flush();
+  }
+
+  // Thus the stat tier matches again, which a same-sized change
+  // with the same modification time demonstrates
+  write(source, "bar");
+  filesystem::last_write_time(source, mtime + chrono::seconds(1));
+  CHECK(open(dir)->is_fresh(source));
+
+  // Changed contents with a changed modification time
+  write(source, "baz");
+  filesystem::last_write_time(source, mtime + chrono::seconds(2));
+  CHECK(!open(dir)->is_fresh(source));
+}
+
+TEST_CASE("testing `Cache` freshness of missing and new files") {
+  TempDir dir;
+  auto source = dir.path / "main.nx", other = dir.path / "other.nx";
+  write(source, "foo");
+  write(other, "bar");
+
+  {
+    auto cache = open(dir);
+
+    // Not indexed yet
+    CHECK(!cache->is_fresh(source));
+
+    // Fresh right after an update
+    cache->update(source, {{dir.path / "lib.nx", true}}, {});
+    CHECK(cache->is_fresh(source));
+
+    // A non-idempotent unit without a cache function is never fresh
+    cache->update(other, {}, {}, false);
+    CHECK(!cache->is_fresh(other));
+  }
+
+  auto cache = open(dir);
+  CHECK(cache->is_fresh(source));
+  CHECK(!cache->is_fresh(other));
+
+  auto requirements = cache->requirements(source);
+  REQUIRE(requirements.size() == 1);
+  CHECK(requirements[0].path == dir.path / "lib.nx");
+  CHECK(requirements[0].is_import);
+
+  filesystem::remove(source);
+  CHECK(!open(dir)->is_fresh(source));
+}
+
+// Return stored entry files of the target.
+static vector<filesystem::path> entries(const TempDir &dir) {
+  vector<filesystem::path> entries;
+
+  for (auto &file :
+       filesystem::directory_iterator(dir.path / "cache" / "target"))
+    if (file.path().extension() == ".nxbc")
+      entries.push_back(file.path());
+
+  return entries;
+}
+
+// Run a *statement* on the cache index, binding *key* to it.
+static void
+exec(const TempDir &dir, const string &statement, string key = "") {
+  SQLite::Database db(
+      (dir.path / "cache" / "index.db").string(),
+      SQLite::OPEN_READWRITE);
+
+  SQLite::Statement query(db, statement);
+
+  if (!key.empty())
+    query.bind(1, key);
+
+  query.exec();
+}
+
+TEST_CASE("testing `Cache` eviction") {
+  TempDir dir;
+  vector<filesystem::path> sources;
+
+  {
+    auto cache = open(dir);
+
+    for (auto name : {"a.nx", "b.nx", "c.nx"}) {
+      auto source = dir.path / name;
+      write(source, name);
+
+      cache->update(source, {}, {});
+      cache->store(source, string(1000, name[0]));
+      sources.push_back(source);
+    }
+  }
+
+  REQUIRE(entries(dir).size() == 3);
+
+  // Make `b` the least recently used, and `a` leased
+  exec(dir, "UPDATE entries SET accessed_at = 1");
+
+  for (auto &entry : entries(dir)) {
+    auto key = entry.stem().string();
+
+    // The data follows a header
+    ifstream file(entry, ios::binary);
+    file.seekg(-1, ios::end);
+
+    switch (file.get()) {
+    case 'b':
+      exec(
+          dir,
+          "UPDATE entries SET accessed_at = 0 WHERE key = ?",
+          key);
+      break;
+    case 'a':
+      exec(
+          dir,
+          "INSERT INTO leases (target, key, expires_at) "
+          "VALUES ('target', ?, 9999999999)",
+          key);
+    }
+  }
+
+  auto cache = open(dir);
+
+  // Already fits
+  CHECK(cache->gc(1000000) == 0);
+  CHECK(entries(dir).size() == 3);
+
+  // `b`, then `c`, as `a` is leased
+  CHECK(cache->gc(2500) > 0);
+  CHECK(entries(dir).size() == 2);
+  CHECK(cache->load(sources[0]) == string(1000, 'a'));
+  CHECK(!cache->load(sources[1]));
+  CHECK(cache->load(sources[2]) == string(1000, 'c'));
+
+  cache->gc(0);
+  CHECK(entries(dir).size() == 1);
+  CHECK(cache->load(sources[0]) == string(1000, 'a'));
+}
+
+TEST_CASE("testing `Cache` collection without a target") {
+  TempDir dir;
+  auto source = dir.path / "main.nx";
+  write(source, "foo");
+
+  {
+    auto cache = open(dir);
+    cache->update(source, {}, {});
+    cache->store(source, string(1000, 'a'));
+  }
+
+  auto root = dir.path / "cache";
+  CHECK(Cache::collect(root, 1000000) == 0);
+  CHECK(Cache::collect(root, 0) > 0);
+  CHECK(entries(dir).empty());
+
+  // No other target directory is created
+  size_t count = 0;
+
+  for (auto &file : filesystem::directory_iterator(root))
+    count += file.is_directory();
+
+  CHECK(count == 1);
+
+  // An index of another version is left as is
+  {
+    auto cache = open(dir);
+    cache->store(source, string(1000, 'a'));
+  }
+
+  exec(dir, "PRAGMA user_version = 1000");
+  CHECK_THROWS_AS(Cache::collect(root, 0), SQLite::Exception);
+  CHECK(entries(dir).size() == 1);
+
+  SQLite::Database db((root / "index.db").string());
+  CHECK(db.execAndGet("PRAGMA user_version").getInt() == 1000);
+  CHECK(
+      db.execAndGet("SELECT COUNT(*) FROM entries").getInt() == 1);
+}
+
+TEST_CASE("testing `Cache` removal of orphaned entries") {
+  TempDir dir;
+  auto source = dir.path / "main.nx";
+  write(source, "foo");
+
+  {
+    auto cache = open(dir);
+    cache->update(source, {}, {});
+    cache->store(source, "bar");
+  }
+
+  auto target = dir.path / "cache" / "target";
+  auto old = filesystem::file_time_type::clock::now() -
+             chrono::hours(2);
+
+  // An unindexed entry left e.g. by a crash before flushing
+  write(target / "0123456789abcdef.nxbc", "baz");
+  filesystem::last_write_time(target / "0123456789abcdef.nxbc", old);
+
+  // A recent one may be being stored right now
+  write(target / "fedcba9876543210.nxbc", "baz");
+
+  open(dir)->gc(1000000);
+  CHECK(!filesystem::exists(target / "0123456789abcdef.nxbc"));
+  CHECK(filesystem::exists(target / "fedcba9876543210.nxbc"));
+  CHECK(entries(dir).size() == 2);
+
+  // Migrating the index drops all of the entries
+  exec(dir, "PRAGMA user_version = 0");
+  CHECK(!open(dir)->load(source));
+  CHECK(entries(dir).empty());
+}
+
+TEST_CASE("testing `Cache` entry keys") {
+  TempDir dir;
+  auto lib = dir.path / "lib.nx", main = dir.path / "main.nx";
+  write(lib, "def foo");
+  write(main, "foo");
+
+  Compiler::Usage exporting, consuming;
+  exporting.exports["foo"] = 1;
+  consuming.consumptions.insert("foo");
+
+  {
+    auto cache = open(dir);
+    cache->update(lib, {}, exporting);
+    cache->update(main, {{lib, false}}, consuming);
+    cache->store(main, "bar");
+    CHECK(cache->load(main) == "bar");
+
+    // A changed consumed signature changes the key
+    exporting.exports["foo"] = 2;
+    cache->update(lib, {}, exporting);
+    cache->update(main, {{lib, false}}, consuming);
+    CHECK(!cache->load(main));
+
+    cache->store(main, "baz");
+    CHECK(cache->load(main) == "baz");
+  }
+
+  CHECK(open(dir)->load(main) == "baz");
+
+  // Another target does not share entries
+  Cache other(dir.path / "cache", "other", 2);
+  other.update(main, {{lib, false}}, consuming);
+  CHECK(!other.load(main));
+
+  // Nor does another cache function value
+  auto cache = open(dir);
+  cache->update(
+      main,
+      {{lib, false}},
+      consuming,
+      false,
+      Compiler::Macro::CacheFunction{"", "1"});
+
+  CHECK(!cache->load(main));
+}
+
+TEST_CASE("testing `Cache` remote") {
+  TempDir dir;
+  auto source = dir.path / "main.nx";
+  write(source, "foo");
+
+  auto remote = [&]() {
+    return make_unique<App::Shared::FilesystemRemote>(
+        dir.path / "remote");
+  };
+
+  // Uploaded in the background, but before the cache is destroyed
+  {
+    Cache cache(dir.path / "a", "target", 2, {}, remote());
+    cache.update(source, {}, {});
+    cache.store(source, "bar");
+  }
+
+  // Another machine has the same source indexed
+  Cache(dir.path / "b", "target", 2).update(source, {}, {});
+
+  Cache cache(dir.path / "b", "target", 2, {}, remote());
+  cache.validate();
+  cache.prefetch();
+
+  auto entries = 0;
+
+  for (auto &file :
+       filesystem::directory_iterator(dir.path / "b" / "target"))
+    entries += file.path().extension() == ".nxbc";
+
+  CHECK(entries == 1);
+  CHECK(cache.load(source) == "bar");
+}
+
+TEST_CASE("testing `Cache` dictionary training") {
+  TempDir dir;
+  vector<filesystem::path> sources;
+
+  auto open = [&]() {
+    return make_unique<Cache>(
+        dir.path / "cache",
+        "target",
+        2,
+        App::Shared::Compression::Zstd);
+  };
+
+  auto cache = open();
+
+  // Stored entries are the samples
+  for (int i = 0; i < 64; i++) {
+    auto source = dir.path / (to_string(i) + ".nx");
+    write(source, to_string(i));
+
+    string data;
+    for (int j = 0; j < 64; j++)
+      data += "def foo" + to_string(i * j % 97) + "; end\n";
+
+    cache->update(source, {}, {});
+    cache->store(source, data);
+    sources.push_back(source);
+  }
+
+  cache->train();
+
+  auto dictionaries = 0;
+
+  for (auto &file :
+       filesystem::directory_iterator(dir.path / "cache" / "target"))
+    dictionaries += file.path().extension() == ".zdict";
+
+  CHECK(dictionaries == 1);
+
+  // Compressed with the dictionary, which is reloaded
+  cache->update(sources[0], {}, {});
+  cache->store(sources[0], "def bar; end\n");
+  cache.reset();
+
+  cache = open();
+
+  CHECK(cache->load(sources[0]) == "def bar; end\n");
+}
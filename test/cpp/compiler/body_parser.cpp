@@ -0,0 +1,192 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include "../../../src/cpp/header/compiler/body_parser.hpp"
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Return the index of the *n*-th (from zero) *id* token of a *unit*.
+static size_t index_of(Unit &unit, const string &id, int n = 0) {
+  for (size_t i = 0; i < unit.tokens.size(); i++) {
+    auto value = dynamic_cast<Token::Value *>(unit.tokens[i].get());
+
+    if (value && value->value == id && n-- == 0)
+      return i;
+  }
+
+  throw "BUG! No such token in a test source";
+}
+
+// Return the error reason of a block from a *source*, if any.
+static string end_error(const string &source) {
+  auto unit = lex(source);
+
+  try {
+    BodyParser(*unit).end_of(0);
+  } catch (BodyParser::Error &error) {
+    return error.reason;
+  }
+
+  return "";
+}
+
+TEST_CASE("testing `BodyParser` nested blocks") {
+  auto unit = lex("  if x\n"
+                  "    f do\n"
+                  "      y = z\n"
+                  "    end\n"
+                  "    while y\n"
+                  "      z\n"
+                  "    end\n"
+                  "  end\n"
+                  "end\n"
+                  "end\n");
+
+  CHECK(BodyParser(*unit).end_of(0) == index_of(*unit, "end", 3));
+
+  // From within the `if` block
+  auto begin = index_of(*unit, "x") + 1;
+  CHECK(BodyParser(*unit).end_of(begin) == index_of(*unit, "end", 2));
+}
+
+TEST_CASE("testing `BodyParser` modifiers") {
+  // A suffix `if` does not open a block
+  auto unit = lex("  a if b\n"
+                  "  c unless d\n"
+                  "end\n");
+
+  CHECK(BodyParser(*unit).end_of(0) == index_of(*unit, "end"));
+
+  // While it does after a leading keyword or an operator
+  unit = lex("  return if a\n"
+             "    b\n"
+             "  end\n"
+             "  x = if c\n"
+             "    d\n"
+             "  end\n"
+             "end\n");
+
+  CHECK(BodyParser(*unit).end_of(0) == index_of(*unit, "end", 2));
+
+  // After a closing parenthesis, it is a suffix
+  unit = lex("  f(a) if b\n"
+             "end\n");
+
+  CHECK(BodyParser(*unit).end_of(0) == index_of(*unit, "end"));
+}
+
+TEST_CASE("testing `BodyParser` calls named as keywords") {
+  // `x.end` and `x.do` are calls
+  auto unit = lex("  x.end\n"
+                  "  y.do\n"
+                  "  z.if\n"
+                  "end\n");
+
+  CHECK(BodyParser(*unit).end_of(0) == index_of(*unit, "end", 1));
+}
+
+TEST_CASE("testing `BodyParser` missing `end`") {
+  const string missing = "Expected `end` of the block";
+
+  CHECK(end_error("  a\n") == missing);
+  CHECK(end_error("  if a\n    b\n  end\n") == missing);
+  CHECK(end_error("  f do\n    x.end\n  end\n") == missing);
+  CHECK(end_error("") == missing);
+
+  // A suffix `if` needs no `end`, nor a commented one
+  CHECK(end_error("  a if b\nend\n") == "");
+  CHECK(end_error("  a # if b\nend\n") == "");
+}
+
+TEST_CASE("testing `BodyParser` statement end") {
+  auto unit = lex("f(a,\n"
+                  "  b) if c\n"
+                  "if d\n"
+                  "  e\n"
+                  "end; g");
+
+  auto bodies = BodyParser(*unit);
+
+  // Out of brackets
+  auto end = bodies.statement_end(0);
+  CHECK(end == index_of(*unit, "c") + 1);
+
+  // Out of nested blocks
+  end = bodies.statement_end(end + 1);
+  CHECK(end == index_of(*unit, "end") + 1);
+
+  // Up to the end of the tokens
+  CHECK(bodies.statement_end(end + 1) == unit->tokens.size());
+}
+
+TEST_CASE("testing `BodyParser` lazy bodies") {
+  auto unit = parse(
+      "def foo(a)\n"
+      "  a + 1\n"
+      "\n"
+      "  f(a); g(a) # Comment\n"
+      "end\n"
+      "\n"
+      "namespace Bar\n"
+      "  def baz\n"
+      "    x.end\n"
+      "  end\n"
+      "end\n",
+      false);
+
+  auto foo = unit->sast->functions[0];
+  auto baz = unit->sast->namespaces[0]->functions[0];
+  CHECK(foo->is_lazy());
+  CHECK(baz->is_lazy());
+
+  auto bodies = BodyParser(*unit);
+  auto body = bodies.parse(foo);
+
+  CHECK(!foo->is_lazy());
+  CHECK(body->expressions.size() == 3);
+  CHECK(body->expressions[0]->kind == AST::Kind::Binop);
+
+  // Parsed once
+  CHECK(bodies.parse(foo) == body);
+
+  bodies.parse_all(unit->sast);
+  CHECK(!baz->is_lazy());
+  CHECK(baz->body->expressions.size() == 1);
+  CHECK(baz->body->expressions[0]->kind == AST::Kind::Call);
+}
+
+TEST_CASE("testing `BodyParser` syntax errors") {
+  auto unit = parse("def foo\n  a b\nend\n", false);
+
+  auto foo = unit->sast->functions[0];
+  string reason;
+
+  try {
+    BodyParser(*unit).parse(foo);
+  } catch (BodyParser::Error &error) {
+    reason = error.reason;
+    CHECK(error.token == unit->tokens[index_of(*unit, "b")]);
+  }
+
+  CHECK(reason == "Unexpected token");
+  CHECK(foo->is_lazy());
+
+  // Errors of expressions are reported as body errors
+  unit->tokens = tokenize("def foo\n"
+                          "  f(a\n"
+                          "end\n");
+
+  foo->body_end = index_of(*unit, "end");
+  reason = "";
+
+  try {
+    BodyParser(*unit).parse(foo);
+  } catch (BodyParser::Error &error) {
+    reason = error.reason;
+  }
+
+  CHECK(reason == "Expected closing parenthesis");
+}
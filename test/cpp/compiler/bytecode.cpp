@@ -0,0 +1,231 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <sstream>
+
+#include "../../../src/cpp/header/compiler/bytecode.hpp"
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/reload.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+static string dump(AST::Node *node) {
+  stringstream ss;
+  node->dump(&ss);
+  return ss.str();
+}
+
+static const char *SOURCE = "namespace Foo\n"
+                            "  def bar(a, b: Int = 1)\n"
+                            "    f(a + b * 2, x: a ? b : a)\n"
+                            "    a |> g\n"
+                            "  end\n"
+                            "end\n"
+                            "\n"
+                            "def baz(c)\n"
+                            "  -a ?: b.c(..d)\n"
+                            "end\n";
+
+TEST_CASE("testing `Bytecode` round-trip") {
+  auto unit = parse(SOURCE);
+  auto data = Bytecode::encode(*unit);
+
+  auto fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  fresh->sast = Bytecode::decode(data, fresh);
+  auto root = fresh->sast;
+  REQUIRE(root);
+
+  CHECK(dump(root) == dump(unit->sast));
+  CHECK(root->hash == unit->sast->hash);
+  CHECK(root->namespaces[0]->parent_namespace == root);
+
+  // Tokens are located in the decoding unit
+  auto name = root->functions[0]->prototype->name;
+  CHECK(name->value == "baz");
+  CHECK(name->location.unit == fresh);
+  CHECK(
+      name->location.begin.row ==
+      unit->sast->functions[0]->prototype->name->location.begin.row);
+
+  // Decoded hashes are comparable with parsed ones
+  CHECK(Reload::classify(unit->sast, root).kind == Reload::None);
+
+  // Encoding is deterministic
+  CHECK(Bytecode::encode(*fresh) == data);
+}
+
+TEST_CASE("testing `Bytecode` lazy bodies") {
+  auto unit = parse(SOURCE, false);
+  auto data = Bytecode::encode(*unit);
+
+  auto fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  fresh->sast = Bytecode::decode(data, fresh);
+  auto root = fresh->sast;
+  REQUIRE(root);
+
+  // Bodies are parsed from the decoded tokens on demand
+  auto bar = root->namespaces[0]->functions[0];
+  auto baz = root->functions[0];
+  REQUIRE(bar->is_lazy());
+  REQUIRE(baz->is_lazy());
+  CHECK(Bytecode::encode(*fresh) == data);
+
+  auto &tokens = fresh->tokens;
+  CHECK(tokens[bar->body_end]->source() == "end");
+  CHECK(tokens[baz->body_begin]->location.unit == fresh);
+
+  BodyParser(*fresh).parse_all(root);
+  BodyParser(*unit).parse_all(unit->sast);
+  CHECK(dump(root) == dump(unit->sast));
+
+  // Tokens of other types
+  unit = parse("def foo\n  f(1)\nend\n", false);
+  auto foo = unit->sast->functions[0];
+  auto at = unit->tokens.begin() + foo->body_begin;
+  Location location(nullptr, Position(1, 2), Position(1, 9));
+
+  vector<shared_ptr<Token::Base>> others = {
+      make_shared<Token::NumericLiteral>(
+          location,
+          Token::NumericLiteral::Hexa,
+          vector<char>{'2', 'A'},
+          vector<char>{'5'},
+          -3,
+          Token::NumericLiteral::Float,
+          64),
+      make_shared<Token::CharLiteral>(
+          location,
+          Token::Codepoint(
+              location, Token::Codepoint::Hexadecimal, 97, "\\x61")),
+      make_shared<Token::StringLiteral>(
+          location,
+          vector<variant<Token::Linebreak, Token::Codepoint>>{
+              Token::Codepoint(
+                  location, Token::Codepoint::Exact, 97, "a"),
+              Token::Linebreak(location)}),
+  };
+
+  unit->tokens.insert(at, others.begin(), others.end());
+  foo->body_end += others.size();
+
+  fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  fresh->sast = Bytecode::decode(Bytecode::encode(*unit), fresh);
+  REQUIRE(fresh->sast);
+  auto size = foo->body_end - foo->body_begin + 1;
+  REQUIRE(fresh->tokens.size() == size);
+
+  for (size_t i = 0; i < size; i++) {
+    auto &original = unit->tokens[foo->body_begin + i];
+    auto &decoded = fresh->tokens[i];
+
+    CHECK(decoded->type_id() == original->type_id());
+    CHECK(decoded->source() == original->source());
+    CHECK(decoded->location.end.col == original->location.end.col);
+  }
+}
+
+TEST_CASE("testing `Bytecode` body syntax errors") {
+  // The unit is stored, and the error is deferred
+  auto unit = parse("def foo\n  a b\nend\n", false);
+  auto data = Bytecode::encode(*unit);
+
+  auto fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  fresh->sast = Bytecode::decode(data, fresh);
+  auto root = fresh->sast;
+  REQUIRE(root);
+
+  auto foo = root->functions[0];
+  string reason;
+
+  try {
+    BodyParser(*fresh).parse(foo);
+  } catch (BodyParser::Error &error) {
+    reason = error.reason;
+    CHECK(error.token->location.unit == fresh);
+  }
+
+  CHECK(reason == "Unexpected token");
+  CHECK(foo->is_lazy());
+
+  // Tokens read before a malformation are dropped
+  fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  CHECK_FALSE(Bytecode::decode(data + '\0', fresh));
+  CHECK(fresh->tokens.empty());
+}
+
+TEST_CASE("testing `Bytecode` named arguments order") {
+  // Interned in reverse, e.g. by another unit parsed first
+  Interner::global().intern("order_z");
+  Interner::global().intern("order_a");
+
+  auto unit = parse("def foo\n"
+                    "  f(order_z: b, order_a: a)\n"
+                    "end\n");
+
+  // By name, regardless of the interning order
+  auto data = Bytecode::encode(*unit);
+  CHECK(data.find("order_a") < data.find("order_z"));
+
+  auto text = dump(unit->sast);
+  CHECK(text.find("order_a") < text.find("order_z"));
+}
+
+TEST_CASE("testing `Bytecode` deep trees") {
+  const size_t terms = 100000;
+  string source = "def foo\n  a";
+
+  for (size_t i = 1; i < terms; i++)
+    source += " + f(a)";
+
+  auto unit = parse(source + "\nend\n");
+  auto data = Bytecode::encode(*unit);
+
+  auto fresh = make_shared<Unit>(false, "test.nx", nullptr);
+  fresh->sast = Bytecode::decode(data, fresh);
+  auto root = fresh->sast;
+  REQUIRE(root);
+
+  // Walk down the left operands
+  auto node = root->functions[0]->body->expressions[0];
+  size_t depth = 1;
+
+  for (; node->kind == AST::Kind::Binop; depth++) {
+    auto binop = static_cast<AST::Binop *>(node);
+    CHECK(binop->rhx->kind == AST::Kind::Call);
+    node = binop->lhx;
+  }
+
+  CHECK(node->kind == AST::Kind::ID);
+  CHECK(depth == terms);
+  CHECK(Bytecode::encode(*fresh) == data);
+}
+
+TEST_CASE("testing `Bytecode` malformed data") {
+  auto data = Bytecode::encode(*parse(SOURCE));
+  auto unit = make_shared<Unit>(false, "test.nx", nullptr);
+
+  CHECK_FALSE(Bytecode::decode("", unit));
+  CHECK_FALSE(Bytecode::decode(data.substr(1), unit));
+  CHECK_FALSE(Bytecode::decode(data + '\0', unit));
+
+  // Truncated anywhere, with lazy bodies as well
+  auto lazy = Bytecode::encode(*parse(SOURCE, false));
+
+  for (auto &whole : {data, lazy})
+    for (size_t size = 0; size < whole.size(); size++)
+      CHECK_FALSE(Bytecode::decode(whole.substr(0, size), unit));
+
+  CHECK(unit->tokens.empty());
+
+  // Another version
+  auto other = data;
+  other[0]++;
+  CHECK_FALSE(Bytecode::decode(other, unit));
+
+  // Not a root at the top
+  other = data;
+  other[1] = char(AST::Kind::Namespace);
+  CHECK_FALSE(Bytecode::decode(other, unit));
+}
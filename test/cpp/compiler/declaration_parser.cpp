@@ -0,0 +1,230 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Return the values of a token *range*, but of comments.
+static string source(Unit &unit, DeclarationParser::Range range) {
+  string source;
+
+  for (auto i = range.begin; i < range.end; i++) {
+    auto value = dynamic_cast<Token::Value *>(unit.tokens[i].get());
+
+    if (value && value->kind != Token::Value::Text)
+      source += (source.empty() ? "" : " ") + value->value;
+  }
+
+  return source;
+}
+
+// Parse a *source* range by range, returning the first error.
+static string parse_error(const string &source) {
+  auto unit = lex(source);
+
+  try {
+    auto parser = DeclarationParser(*unit, unit->arena);
+
+    for (auto range : DeclarationParser::split(*unit))
+      parser.parse(range, unit->sast);
+  } catch (DeclarationParser::Error &error) {
+    return error.reason;
+  }
+
+  return "";
+}
+
+// Threads running tasks of a queue until stopped.
+struct Workers {
+  TaskQueue &queue;
+  atomic<bool> is_stopped = false;
+  vector<thread> threads;
+
+  Workers(TaskQueue &queue, int count) : queue(queue) {
+    for (int i = 0; i < count; i++)
+      threads.emplace_back([this]() {
+        while (!is_stopped)
+          if (auto task = this->queue.pop())
+            this->queue.run(task);
+          else
+            this_thread::yield();
+      });
+  }
+
+  ~Workers() {
+    is_stopped = true;
+
+    for (auto &thread : threads)
+      thread.join();
+  }
+};
+
+TEST_CASE("testing `DeclarationParser` split") {
+  auto unit = lex("# A comment\n"
+                  "def foo(a)\n"
+                  "  if a\n"
+                  "    b\n"
+                  "  end\n"
+                  "end\n"
+                  "\n"
+                  "namespace Bar; def baz;\n"
+                  "namespace Qux\n"
+                  "  def quux # end\n"
+                  "  end\n"
+                  "end\n");
+
+  auto ranges = DeclarationParser::split(*unit);
+  REQUIRE(ranges.size() == 4);
+
+  CHECK(source(*unit, ranges[0]) == "def foo a if a b end end");
+  CHECK(source(*unit, ranges[1]) == "namespace Bar");
+  CHECK(source(*unit, ranges[2]) == "def baz");
+  CHECK(
+      source(*unit, ranges[3]) == "namespace Qux def quux end end");
+}
+
+TEST_CASE("testing `DeclarationParser` blockless namespaces") {
+  auto unit = lex("namespace Foo;\n"
+                  "def bar\n"
+                  "end\n"
+                  "namespace Baz::Qux; def quux;\n");
+
+  auto parser = DeclarationParser(*unit, unit->arena);
+
+  for (auto range : DeclarationParser::split(*unit))
+    parser.parse(range, unit->sast);
+
+  // The declarations after are not nested
+  auto root = unit->sast;
+  REQUIRE(root->namespaces.size() == 2);
+  REQUIRE(root->functions.size() == 2);
+
+  CHECK(root->namespaces[0]->name == "Foo");
+  CHECK(root->namespaces[0]->functions.empty());
+  CHECK(root->namespaces[1]->name == "Baz::Qux");
+  CHECK(root->functions[0]->prototype->name->value == "bar");
+  CHECK(root->functions[1]->prototype->name->value == "quux");
+
+  // While a namespace with a block is
+  unit = lex("namespace Foo\n"
+             "  def bar\n"
+             "  end\n"
+             "end\n");
+
+  auto other = DeclarationParser(*unit, unit->arena);
+
+  for (auto range : DeclarationParser::split(*unit))
+    other.parse(range, unit->sast);
+
+  REQUIRE(unit->sast->namespaces.size() == 1);
+  CHECK(unit->sast->namespaces[0]->functions.size() == 1);
+  CHECK(unit->sast->functions.empty());
+}
+
+TEST_CASE("testing `DeclarationParser` errors") {
+  CHECK(parse_error("end\n") == "Unexpected `end`");
+  CHECK(parse_error("namespace Foo\n  def bar\n  end\n") ==
+        "Expected `end` of the block");
+  CHECK(parse_error("def (a)\nend\n") == "Expected function name");
+  CHECK(
+      parse_error("class Foo\nend\n") == "Unsupported declaration");
+  CHECK(parse_error("namespace;\n") == "Expected namespace name");
+  CHECK(parse_error("def foo\nend\n# def bar\n") == "");
+}
+
+// A source of *count* functions, every tenth of which is within
+// a namespace, with *invalid* declarations at some indices.
+static string
+functions(int count, const map<int, string> &invalid = {}) {
+  string source;
+
+  for (int i = 0; i < count; i++) {
+    auto name = "f" + to_string(i);
+
+    if (invalid.contains(i))
+      source += invalid.at(i);
+    else if (i % 10 == 0)
+      source += "namespace N" + to_string(i) + "\n"
+                "  def " + name + "(a, b) # Comment\n"
+                "    a + b\n"
+                "  end\n"
+                "end\n";
+    else
+      source += "def " + name + "(a)\n"
+                "  a * 2\n"
+                "end\n";
+  }
+
+  return source;
+}
+
+TEST_CASE("testing `DeclarationParser` parallel parsing order") {
+  const auto source = functions(200);
+
+  // Parsed sequentially
+  auto expected = lex(source);
+  TaskQueue queue;
+  DeclarationParser::parse_unit(*expected, queue);
+
+  Workers workers(queue, 4);
+
+  for (size_t part_tokens : {1, 16, 256}) {
+    auto unit = lex(source);
+    DeclarationParser::parse_unit(*unit, queue, part_tokens);
+
+    auto root = unit->sast;
+    REQUIRE(root->functions.size() == 180);
+    REQUIRE(root->namespaces.size() == 20);
+
+    for (size_t i = 0; i < root->functions.size(); i++) {
+      auto function = root->functions[i];
+      CHECK(function->parent_namespace == root);
+
+      // `f1` to `f9`, `f11` to `f19`, and so on
+      const auto name = "f" + to_string(i + i / 9 + 1);
+      CHECK(function->prototype->name->value == name);
+    }
+
+    for (size_t i = 0; i < root->namespaces.size(); i++) {
+      auto ns = root->namespaces[i];
+      CHECK(ns->parent_namespace == root);
+      CHECK(ns->name == "N" + to_string(i * 10));
+    }
+
+    // Merged as if parsed sequentially
+    CHECK(root->hash == expected->sast->hash);
+  }
+}
+
+TEST_CASE("testing `DeclarationParser` parallel parsing errors") {
+  // The former is reported, whichever part fails first
+  const auto source = functions(
+      200,
+      {{42, "def 1(a)\nend\n"}, {150, "class C\nend\n"}});
+
+  TaskQueue queue;
+  Workers workers(queue, 4);
+
+  for (int i = 0; i < 16; i++) {
+    auto unit = lex(source);
+    string reason;
+
+    try {
+      DeclarationParser::parse_unit(*unit, queue, 16);
+    } catch (DeclarationParser::Error &error) {
+      reason = error.reason;
+    }
+
+    CHECK(reason == "Expected function name");
+
+    // The failed unit is not merged
+    CHECK(unit->sast->functions.empty());
+  }
+}
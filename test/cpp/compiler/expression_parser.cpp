@@ -0,0 +1,273 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <algorithm>
+
+#include "../../../src/cpp/header/compiler/expression_parser.hpp"
+#include "./tokenize.hpp"
+
+// Return an S-expression of a node, e.g. `(+ a (* b c))`. Calls
+// are `f(a, x: b)`, with named arguments sorted by name, and
+// literals are `#`.
+static string show(AST::Expression *node) {
+  switch (node->kind) {
+  case AST::Kind::ID:
+    return static_cast<AST::ID *>(node)->value->value;
+
+  case AST::Kind::Literal:
+    return "#";
+
+  case AST::Kind::Splat: {
+    auto splat = static_cast<AST::Splat *>(node);
+    return (splat->is_named ? "**" : "..") + splat->id->value;
+  }
+
+  case AST::Kind::Unop: {
+    auto unop = static_cast<AST::Unop *>(node);
+    return "(" + unop->op->value + " " + show(unop->expr) + ")";
+  }
+
+  case AST::Kind::Binop: {
+    auto binop = static_cast<AST::Binop *>(node);
+    return "(" + binop->op->value + " " + show(binop->lhx) + " " +
+           show(binop->rhx) + ")";
+  }
+
+  case AST::Kind::Ternary: {
+    auto ternary = static_cast<AST::Ternary *>(node);
+
+    if (!ternary->then)
+      return "(?: " + show(ternary->cond) + " " +
+             show(ternary->else_) + ")";
+
+    return "(? " + show(ternary->cond) + " " + show(ternary->then) +
+           " " + show(ternary->else_) + ")";
+  }
+
+  case AST::Kind::Call: {
+    auto call = static_cast<AST::Call *>(node);
+    vector<string> args;
+
+    for (auto arg : call->args.ordered_arguments)
+      args.push_back(show(arg));
+
+    vector<string> named;
+
+    for (auto &arg : call->args.named_arguments)
+      named.push_back(
+          string(Interner::global().lookup(arg.name)) + ": " +
+          show(arg.value));
+
+    sort(named.begin(), named.end());
+    args.insert(args.end(), named.begin(), named.end());
+
+    string shown = call->caller ? show(call->caller) + "." : "";
+    shown += call->callee->value + "(";
+
+    for (size_t i = 0; i < args.size(); i++)
+      shown += (i ? ", " : "") + args[i];
+
+    return shown + ")";
+  }
+
+  default:
+    return "?";
+  }
+}
+
+// Parse an expression from a *source*, which shall be wholly parsed,
+// and return it as an S-expression (see `show`).
+static string sexp(
+    const string &source,
+    size_t max_depth = ExpressionParser::MAX_DEPTH) {
+  Arena arena;
+  auto tokens = tokenize(source);
+  size_t cursor = 0;
+
+  auto expression =
+      ExpressionParser(arena, tokens, cursor, max_depth).parse();
+
+  REQUIRE(cursor == tokens.size());
+  return show(expression);
+}
+
+// Return the reason an expression from a *source* fails to parse.
+static string error(
+    const string &source,
+    size_t max_depth = ExpressionParser::MAX_DEPTH) {
+  try {
+    sexp(source, max_depth);
+  } catch (ExpressionParser::Error &error) {
+    return error.reason;
+  }
+
+  return "";
+}
+
+TEST_CASE("testing `ExpressionParser` precedence") {
+  CHECK(sexp("a + b * c") == "(+ a (* b c))");
+  CHECK(sexp("a * b + c") == "(+ (* a b) c)");
+  CHECK(sexp("(a + b) * c") == "(* (+ a b) c)");
+  CHECK(sexp("-a * b") == "(* (- a) b)");
+  CHECK(sexp("!a == b") == "(== (! a) b)");
+  CHECK(sexp("a || b && c == d") == "(|| a (&& b (== c d)))");
+  CHECK(sexp("a < b + 1") == "(< a (+ b #))");
+
+  // Operators missing in the table bind as `|`
+  CHECK(sexp("a <> b + c") == "(<> a (+ b c))");
+  CHECK(sexp("a <> b && c") == "(&& (<> a b) c)");
+}
+
+TEST_CASE("testing `ExpressionParser` associativity") {
+  CHECK(sexp("a - b - c") == "(- (- a b) c)");
+  CHECK(sexp("a / b * c") == "(* (/ a b) c)");
+  CHECK(sexp("a ** b ** c") == "(** a (** b c))");
+  CHECK(sexp("- - a") == "(- (- a))");
+  CHECK(sexp("-a ** b") == "(- (** a b))");
+}
+
+TEST_CASE("testing `ExpressionParser` ternary and Elvis") {
+  CHECK(sexp("a ? b : c") == "(? a b c)");
+  CHECK(sexp("a ? b : c ? d : e") == "(? a b (? c d e))");
+  CHECK(sexp("a ? b ? c : d : e") == "(? a (? b c d) e)");
+  CHECK(sexp("a || b ? c + d : e") == "(? (|| a b) (+ c d) e)");
+
+  CHECK(sexp("a ?: b") == "(?: a b)");
+  CHECK(sexp("a ?: b ?: c") == "(?: a (?: b c))");
+  CHECK(sexp("a ?: b + c") == "(?: a (+ b c))");
+  CHECK(sexp("a || b ?: c") == "(?: (|| a b) c)");
+  CHECK(sexp("a ?: b ? c : d") == "(? (?: a b) c d)");
+
+  CHECK(error("a ? b") == "Expected colon of the ternary operator");
+}
+
+TEST_CASE("testing `ExpressionParser` pipe") {
+  CHECK(sexp("a |> f") == "f(a)");
+  CHECK(sexp("a |> f(b)") == "f(a, b)");
+  CHECK(sexp("a |> f(b) |> g") == "g(f(a, b))");
+  CHECK(sexp("a + b |> f") == "f((+ a b))");
+  CHECK(sexp("a |> x.f(b)") == "x.f(a, b)");
+  CHECK(sexp("a ? b : c |> f") == "(? a b f(c))");
+
+  CHECK(error("a |> b + c") == "Expected a call after the pipe");
+}
+
+TEST_CASE("testing `ExpressionParser` calls") {
+  CHECK(sexp("f()") == "f()");
+  CHECK(sexp("f(a, b + c)") == "f(a, (+ b c))");
+  CHECK(sexp("f(g(a), (b))") == "f(g(a), b)");
+  CHECK(sexp("x.f(a).g") == "x.f(a).g()");
+  CHECK(sexp("f(..a, **b)") == "f(..a, **b)");
+
+  // `f (a)` is not a call
+  Arena arena;
+  auto tokens = tokenize("f (a)");
+  size_t cursor = 0;
+  auto expression = ExpressionParser(arena, tokens, cursor).parse();
+  CHECK(show(expression) == "f");
+  CHECK(cursor == 2); // At the parenthesis
+
+  // Newlines are spaces within brackets
+  CHECK(sexp("f(a,\n  b)") == "f(a, b)");
+  CHECK(error("f(a") == "Expected closing parenthesis");
+}
+
+TEST_CASE("testing `ExpressionParser` named arguments") {
+  CHECK(sexp("f(a, y: b, x: c + d)") == "f(a, x: (+ c d), y: b)");
+  CHECK(sexp("x.f(y: b)") == "x.f(y: b)");
+
+  Arena arena;
+  auto tokens = tokenize("f(x: a, y: b)");
+  size_t cursor = 0;
+  auto call = static_cast<AST::Call *>(
+      ExpressionParser(arena, tokens, cursor).parse());
+
+  auto x = Interner::global().intern("x");
+  auto y = Interner::global().intern("y");
+  auto z = Interner::global().intern("z");
+  CHECK(show(call->args.named(x)) == "a");
+  CHECK(show(call->args.named(y)) == "b");
+  CHECK(!call->args.named(z));
+
+  CHECK(error("f(x: a, x: b)") == "Duplicate named argument");
+  CHECK(
+      error("f(x: a, b)") == "Positional argument after named ones");
+  CHECK(error("x: a") == "Unexpected named argument");
+}
+
+TEST_CASE("testing `ExpressionParser` end of an expression") {
+  Arena arena;
+  auto tokens = tokenize("a + b\nc");
+  size_t cursor = 0;
+
+  CHECK(show(ExpressionParser(arena, tokens, cursor).parse()) ==
+        "(+ a b)");
+
+  // Stops at the newline
+  CHECK(cursor == 5);
+
+  CHECK(error("") == "Expected expression");
+  CHECK(error("a +") == "Expected expression");
+}
+
+// Return a chain of *terms* `a` joined by an *op*, e.g. `a + a`.
+static string chain(const string &op, size_t terms) {
+  string source = "a";
+
+  for (size_t i = 1; i < terms; i++)
+    source += op + "a";
+
+  return source;
+}
+
+TEST_CASE("testing `ExpressionParser` depth limit") {
+  const string deep = "Expression is nested too deeply";
+
+  // A left associative chain is deep, but not on the stack
+  CHECK(error(chain(" + ", 1000), 10) == "");
+  CHECK(error(chain(" |> ", 1000), 10) == "");
+  CHECK(error(chain(".", 1000), 10) == "");
+  CHECK(error("f(a, " + chain(" + ", 1000) + ")", 10) == "");
+
+  // Right associative operators are pending on the stack
+  CHECK(error(chain(" ** ", 11), 10) == "");
+  CHECK(error(chain(" ** ", 12), 10) == deep);
+
+  // So are brackets
+  CHECK(error(string(10, '(') + "a" + string(10, ')'), 10) == "");
+  CHECK(error(string(11, '(') + "a" + string(11, ')'), 10) == deep);
+}
+
+TEST_CASE("testing `ExpressionParser` long chains") {
+  const size_t terms = 100000;
+
+  for (auto op : {" + ", " ** ", " |> ", "."}) {
+    CAPTURE(op);
+
+    Arena arena;
+    auto tokens = tokenize(chain(op, terms));
+    size_t cursor = 0;
+
+    auto expression =
+        ExpressionParser(arena, tokens, cursor).parse();
+    CHECK(cursor == tokens.size());
+
+    // Walk down the chain, which is as deep as it is long
+    size_t depth = 1;
+
+    for (auto node = expression; node->kind != AST::Kind::ID;
+         depth++) {
+      if (node->kind == AST::Kind::Binop) {
+        auto binop = static_cast<AST::Binop *>(node);
+        node = string(op) == " ** " ? binop->rhx : binop->lhx;
+      } else {
+        auto call = static_cast<AST::Call *>(node);
+
+        node = call->caller ? call->caller
+                            : call->args.ordered_arguments[0];
+      }
+    }
+
+    CHECK(depth == terms);
+  }
+}
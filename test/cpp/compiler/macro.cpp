@@ -0,0 +1,537 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include "../../../src/cpp/header/compiler/macro.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+
+#include <sstream>
+
+using namespace Onyx::Compiler;
+
+Verbosity verbosity = Warn;
+
+// Evaluate a *code* chunk, returning its output.
+static string eval(Macro &macro, const string &code) {
+  const auto offset = macro.output.size();
+
+  macro.input = code;
+  macro.eval();
+
+  return macro.output.substr(offset);
+}
+
+TEST_CASE("testing `Macro` idempotency of `require`") {
+  {
+    // Standard libraries are loaded already
+    Macro macro;
+    eval(macro, "local s = require('string') emit(s.upper('a'))");
+
+    CHECK(!macro.error);
+    CHECK(macro.output == "A");
+    CHECK(macro.is_idempotent());
+  }
+
+  {
+    // A new module may depend on anything
+    Macro macro;
+    eval(macro, "package.preload.foo = function() return 42 end");
+    CHECK(macro.is_idempotent());
+
+    CHECK(eval(macro, "emit(tostring(require('foo')))") == "42");
+    CHECK(!macro.error);
+    CHECK(!macro.is_idempotent());
+  }
+
+  {
+    // The module is unloaded with the state reset
+    Macro macro;
+    eval(macro, "emit(tostring(package.loaded.foo))");
+
+    CHECK(macro.output == "nil");
+    CHECK(macro.is_idempotent());
+  }
+
+  {
+    Macro macro;
+    eval(macro, "os.time()");
+    CHECK(!macro.is_idempotent());
+  }
+}
+
+TEST_CASE("testing `Macro` state reset of nested tables") {
+  // LuaJIT calls them loaders
+  const string searchers = "(package.searchers or package.loaders)";
+  const auto length = "emit(tostring(#" + searchers + "))";
+  string count;
+
+  {
+    Macro macro;
+    count = eval(macro, length);
+
+    eval(
+        macro,
+        "package.preload.foo = function() return 42 end "
+        "table.insert(" +
+            searchers +
+            ", 1, function() end) "
+            "getmetatable('').__call = function() return 'x' end "
+            "getmetatable(io.stdout).__index.answer = 42");
+
+    CHECK(!macro.error);
+  }
+
+  {
+    // Nested entries do not leak into the next unit
+    Macro macro;
+    eval(macro, "emit(tostring(package.preload.foo))");
+    CHECK(eval(macro, length) == count);
+    eval(macro, "emit(tostring(getmetatable('').__call))");
+    eval(macro, "emit(tostring(io.stdout.answer))");
+
+    CHECK(!macro.error);
+    CHECK(macro.output == "nil" + count + "nilnil");
+  }
+}
+
+TEST_CASE("testing `Macro` non-idempotent functions") {
+  for (auto code : {
+           "io.write('')",
+           "io.stdout:write('')",
+           "io.stdout:flush()",
+           "io.output()",
+           "collectgarbage('count')",
+           "emit(tostring({}))",
+           "emit(tostring(print))",
+           "emit(string.format('%s', {}))",
+           "emit(('%s'):format(function() end))",
+       }) {
+    Macro macro;
+    eval(macro, code);
+
+    INFO(code);
+    CHECK(!macro.error);
+    CHECK(!macro.is_idempotent());
+  }
+
+  for (auto code : {
+           "collectgarbage()",
+           "emit(tostring(42), tostring(nil))",
+           "emit(string.format('%d %s', 1, 'a'))",
+           "emit(tostring(setmetatable({}, "
+           "{__tostring = function() return 'x' end})))",
+       }) {
+    Macro macro;
+    eval(macro, code);
+
+    INFO(code);
+    CHECK(!macro.error);
+    CHECK(macro.is_idempotent());
+  }
+}
+
+TEST_CASE("testing `Macro` memoization in a changed state") {
+  {
+    // Memoized, as it only depends on its source
+    Macro macro;
+    CHECK(eval(macro, "emit(tostring(x))") == "nil");
+  }
+
+  {
+    Macro macro;
+    CHECK(eval(macro, "emit(tostring(x))") == "nil");
+    CHECK(macro.stats.evaluations == 0);
+  }
+
+  {
+    // A global set by an earlier chunk is respected
+    Macro macro;
+    eval(macro, "x = 5");
+    CHECK(eval(macro, "emit(tostring(x))") == "5");
+    CHECK(macro.stats.evaluations == 2);
+  }
+
+  {
+    Macro macro;
+    CHECK(eval(macro, "emit(tostring(string.answer))") == "nil");
+    eval(macro, "string.answer = 42");
+  }
+
+  {
+    // A library change is not memoized, as it is a side effect,
+    // and the change is respected by later chunks
+    Macro macro;
+    eval(macro, "string.answer = 42");
+    CHECK(eval(macro, "emit(tostring(string.answer))") == "42");
+    CHECK(macro.stats.evaluations == 2);
+  }
+
+  {
+    // The state is pristine again once reset
+    Macro macro;
+    CHECK(eval(macro, "emit(tostring(string.answer))") == "nil");
+    CHECK(macro.stats.evaluations == 0);
+  }
+}
+
+// Return a handle of a single identifier token.
+static shared_ptr<Macro::Handle> handle(const string &id) {
+  auto handle = make_shared<Macro::Handle>();
+  handle->tokens.push_back(make_shared<Token::Value>(
+      Location(nullptr), Token::Value::ID, id));
+
+  return handle;
+}
+
+TEST_CASE("testing `Macro` memoization with handles") {
+  const auto code = "emit(tostring(nx.ctx.arg), #nx.ctx.arg)";
+
+  {
+    Macro macro;
+    macro.set_context("arg", handle("foo"));
+    CHECK(eval(macro, code) == "foo1");
+    CHECK(macro.stats.evaluations == 1);
+  }
+
+  {
+    // A handle is keyed by its tokens
+    Macro macro;
+    macro.set_context("arg", handle("foo"));
+    CHECK(eval(macro, code) == "foo1");
+    CHECK(macro.stats.evaluations == 0);
+  }
+
+  {
+    Macro macro;
+    macro.set_context("arg", handle("bar"));
+    CHECK(eval(macro, code) == "bar1");
+    CHECK(macro.stats.evaluations == 1);
+  }
+}
+
+TEST_CASE("testing `Macro` context iteration") {
+  Macro macro;
+  macro.set_context("b", handle("bar"));
+  macro.set_context("a", handle("foo"));
+
+  // Also in LuaJIT, which ignores `__pairs` by itself
+  eval(
+      macro,
+      "local keys = {} "
+      "for k, v in pairs(nx.ctx) do keys[#keys + 1] = k end "
+      "table.sort(keys) "
+      "emit(table.concat(keys, ','))");
+
+  CHECK(!macro.error);
+  CHECK(macro.output == "a,b");
+
+  // Non-finite and huge numbers are serialized into the key
+  eval(macro, "nx.ctx.x = {1 / 0, -1 / 0, 0 / 0, 2^70, -2^63, 0.5}");
+  CHECK(eval(macro, "emit(#nx.ctx.x)") == "6");
+  CHECK(!macro.error);
+}
+
+TEST_CASE("testing `Macro` handles") {
+  auto handle = make_shared<Macro::Handle>();
+
+  for (auto [kind, value] : {
+           pair(Token::Value::ID, "foo"),
+           pair(Token::Value::Op, "+"),
+           pair(Token::Value::Intrinsic, "bar"),
+       })
+    handle->tokens.push_back(make_shared<Token::Value>(
+        Location(nullptr), kind, value));
+
+  {
+    Macro macro;
+    macro.set_context("arg", handle);
+
+    eval(
+        macro,
+        "local h = nx.ctx.arg "
+        "emit(tostring(h), ' ', #h, ' ', h[1], h[2], h[3], ' ', "
+        "tostring(h[0]), tostring(h[4]))");
+
+    CHECK(!macro.error);
+    CHECK(macro.output == "foo+@bar 3 foo+@bar nilnil");
+    CHECK(macro.spliced.empty());
+  }
+
+  {
+    // Emitting a handle splices it by reference, so that the lexer
+    // yields its tokens as is; the expansion is not memoized
+    for (int i = 0; i < 2; i++) {
+      Macro macro;
+      macro.set_context("arg", handle);
+      eval(macro, "emit('(', nx.ctx.arg, ')')");
+
+      CHECK(!macro.error);
+      CHECK(
+          macro.output ==
+          string("(") + Macro::SPLICE + "0" + Macro::SPLICE + ")");
+      REQUIRE(macro.spliced.size() == 1);
+      CHECK(macro.spliced[0] == handle);
+      CHECK(macro.stats.evaluations == 1);
+    }
+  }
+}
+
+TEST_CASE("testing `Macro` in-place emission") {
+  Macro macro;
+  macro.output = "a";
+
+  // Appended to the existing output, chunk by chunk
+  eval(macro, "emit('b', 1, 'c')");
+  eval(macro, "emit(string.rep('d', 100000))");
+
+  CHECK(!macro.error);
+  REQUIRE(macro.output.size() == 4 + 100000);
+  CHECK(macro.output.substr(0, 4) == "ab1c");
+  CHECK(macro.output.back() == 'd');
+
+  // A non-string is an error, emitted arguments are kept
+  eval(macro, "emit('e', {})");
+  CHECK(macro.error);
+  CHECK(macro.output.back() == 'e');
+}
+
+TEST_CASE("testing `Macro` bytecode cache") {
+  // Setting a global is not memoized, thus evaluated every time
+  const auto code = "bytecode_cache_test = 42";
+
+  {
+    Macro macro;
+    eval(macro, code);
+    CHECK(macro.stats.evaluations == 1);
+    CHECK(macro.stats.compilations == 1);
+  }
+
+  {
+    // Loaded from the cache in another state
+    Macro macro;
+    eval(macro, code);
+    CHECK(!macro.error);
+    CHECK(macro.stats.evaluations == 1);
+    CHECK(macro.stats.compilations == 0);
+
+    // Another chunk of the same size is not confused with it
+    eval(macro, "bytecode_cache_test = 43");
+    CHECK(macro.stats.compilations == 1);
+    CHECK(eval(macro, "emit(bytecode_cache_test)") == "43");
+  }
+}
+
+TEST_CASE("testing `Macro` cache function") {
+  {
+    Macro macro;
+    eval(
+        macro,
+        "os.time() nx.file.cache = function() return 42 end");
+    CHECK(!macro.is_idempotent());
+
+    auto function = macro.cache_function();
+    REQUIRE(function);
+    CHECK(!macro.error);
+    CHECK(Macro::revalidate(function.value()));
+  }
+
+  {
+    // Called with the previous value, returning another one
+    Macro macro;
+    eval(
+        macro,
+        "nx.file.cache = function(old) "
+        "  return old and old + 1 or 1 "
+        "end");
+
+    auto function = macro.cache_function();
+    REQUIRE(function);
+    CHECK(!Macro::revalidate(function.value()));
+  }
+
+  {
+    // Upvalues are not preserved
+    Macro macro;
+    eval(
+        macro,
+        "local x = 1 "
+        "nx.file.cache = function() return x end");
+
+    auto function = macro.cache_function();
+    REQUIRE(function);
+    CHECK(!Macro::revalidate(function.value()));
+  }
+
+  for (auto code : {
+           "nx.file.cache = function() return {} end",
+           "nx.file.cache = 42",
+           "",
+       }) {
+    Macro macro;
+    eval(macro, code);
+
+    INFO(code);
+    CHECK(!macro.cache_function());
+  }
+}
+
+TEST_CASE("testing `Macro` incomplete chunks") {
+  Macro macro;
+
+  // The error is e.g. `'end' expected near <eof>`,
+  // or `near '<eof>'` in LuaJIT
+  eval(macro, "for i = 1, 2 do");
+  CHECK(macro.is_incomplete());
+  CHECK(!macro.error);
+
+  macro.input += " emit(tostring(i)) end";
+  macro.eval();
+  CHECK(!macro.is_incomplete());
+  CHECK(!macro.error);
+  CHECK(macro.output == "12");
+
+  // A syntax error elsewhere is not incomplete
+  eval(macro, "for for");
+  CHECK(!macro.is_incomplete());
+  CHECK(macro.error);
+}
+
+TEST_CASE("testing `Macro` limits of a hot loop") {
+  const auto limits = Macro::limits;
+
+  // A loop like that is compiled by LuaJIT, which
+  // does not call hooks in compiled code
+  const auto loop = "local i = 0 while true do i = i + 1 end";
+
+  {
+    Macro::limits.instructions = 1000000;
+    Macro macro;
+    eval(macro, loop);
+
+    REQUIRE(macro.error);
+    CHECK(macro.error->find("instruction limit") != string::npos);
+  }
+
+  {
+    Macro::limits.instructions = 0;
+    Macro::limits.duration = chrono::milliseconds(50);
+    Macro macro;
+    eval(macro, loop);
+
+    REQUIRE(macro.error);
+    CHECK(macro.error->find("time limit") != string::npos);
+  }
+
+  Macro::limits = limits;
+}
+
+TEST_CASE("testing `Macro` memory limit") {
+  const auto limits = Macro::limits;
+  // Setting a global is not memoized
+  const auto code = "memory_limit_test = string.rep('x', 4 * 2^20)";
+
+  {
+    // The peak includes allocations freed since
+    Macro macro;
+    eval(macro, code);
+
+    CHECK(!macro.error);
+    CHECK(macro.stats.peak_memory >= 4 * 1024 * 1024);
+  }
+
+  Macro::limits.memory = 1024 * 1024;
+
+  {
+    // The allocator refuses to exceed the limit
+    Macro macro;
+    eval(macro, code);
+
+    REQUIRE(macro.error);
+    CHECK(macro.error->find("memory limit") != string::npos);
+    CHECK(macro.stats.peak_memory < 4 * 1024 * 1024);
+
+    // The limit is per evaluation, in excess of the usage
+    CHECK(eval(macro, "emit(string.rep('x', 3))") == "xxx");
+    CHECK(!macro.error);
+  }
+
+  Macro::limits = limits;
+}
+
+TEST_CASE("testing `Macro` duration limit") {
+  const auto limits = Macro::limits;
+  Macro::limits.duration = chrono::milliseconds(50);
+
+  Macro macro;
+
+  // Neither a `pcall` swallows the limit
+  eval(macro, "while true do pcall(function() "
+              "  local i = 0 while true do i = i + 1 end "
+              "end) end");
+
+  REQUIRE(macro.error);
+  CHECK(macro.error->find("time limit") != string::npos);
+  CHECK(macro.stats.duration >= chrono::milliseconds(50));
+
+  Macro::limits = limits;
+}
+
+TEST_CASE("testing `Macro` hidden debug library") {
+  const auto limits = Macro::limits;
+  Macro::limits.instructions = 1000000;
+
+  {
+    // The count hook can not be removed
+    Macro macro;
+    eval(
+        macro,
+        "pcall(debug.sethook) "
+        "local i = 0 while true do i = i + 1 end");
+
+    REQUIRE(macro.error);
+    CHECK(macro.error->find("instruction limit") != string::npos);
+  }
+
+  Macro::limits = limits;
+
+  {
+    Macro macro;
+    eval(
+        macro,
+        "emit(type(debug.sethook), type(debug.getregistry), "
+        "type(debug.setmetatable), type(require('debug').sethook), "
+        "type(debug.traceback))");
+
+    CHECK(!macro.error);
+    CHECK(macro.output == "nilnilnilnilfunction");
+  }
+}
+
+// Enables the profiler for the rest of the process, thus the last
+TEST_CASE("testing `Macro` profiler") {
+  Macro::enable_profiler();
+
+  {
+    Macro macro;
+    macro.site = "test.nx:1:1";
+    eval(
+        macro,
+        "local function spin() "
+        "  local t = {} for i = 1, 1000000 do t[i % 100] = i end "
+        "end "
+        "spin()");
+
+    CHECK(!macro.error);
+  } // Samples are merged on destruction
+
+  stringstream report, folded;
+  Macro::write_profile(report, folded);
+
+  CHECK(report.str().find("Macro sites by total time:") == 0);
+  CHECK(report.str().find("Lua functions by self time:") !=
+        string::npos);
+  CHECK(report.str().find("test.nx:1:1") != string::npos);
+
+  // E.g. `test.nx:1:1;spin (macro:1) 1234`
+  CHECK(folded.str().find("test.nx:1:1;spin (macro:1) ") !=
+        string::npos);
+}
@@ -0,0 +1,172 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/reload.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Classify changes from a *previous* source to a *current* one.
+static Reload classify(
+    shared_ptr<Unit> previous, shared_ptr<Unit> current) {
+  return Reload::classify(previous->sast, current->sast);
+}
+
+static string name(AST::FunctionDefinition *function) {
+  return function->prototype->name->value;
+}
+
+static const char *SOURCE = "def foo(a)\n"
+                            "  a + 1\n"
+                            "end\n"
+                            "\n"
+                            "namespace Bar\n"
+                            "  def baz\n"
+                            "    f(x)\n"
+                            "  end\n"
+                            "end\n";
+
+TEST_CASE("testing `Reload` without changes") {
+  auto previous = parse(SOURCE);
+
+  auto reload = classify(previous, parse(SOURCE));
+  CHECK(reload.kind == Reload::None);
+  CHECK(reload.changed.empty());
+  CHECK(reload.added.empty());
+
+  // Blank edits
+  reload = classify(
+      previous,
+      parse("# A comment\n"
+            "def foo(a) # Another one\n"
+            "  a  +  1;\n"
+            "end\n"
+            "\n"
+            "namespace Bar\n"
+            "  def baz\n"
+            "\n"
+            "    f(x)\n"
+            "  end\n"
+            "end\n"));
+
+  CHECK(reload.kind == Reload::None);
+  CHECK(reload.changed.empty());
+  CHECK(reload.added.empty());
+}
+
+TEST_CASE("testing `Reload` body changes") {
+  auto previous = parse(SOURCE);
+  auto current = parse("def foo(a)\n"
+                       "  a + 2\n"
+                       "end\n"
+                       "\n"
+                       "namespace Bar\n"
+                       "  def baz\n"
+                       "    g(x)\n"
+                       "  end\n"
+                       "end\n");
+
+  auto reload = classify(previous, current);
+  CHECK(reload.kind == Reload::Bodies);
+  REQUIRE(reload.changed.size() == 2);
+  CHECK(reload.added.empty());
+
+  // Functions of the current tree
+  CHECK(reload.changed[0] == current->sast->functions[0]);
+  CHECK(name(reload.changed[1]) == "baz");
+  CHECK(
+      reload.changed[1]->parent_namespace ==
+      current->sast->namespaces[0]);
+}
+
+TEST_CASE("testing `Reload` added functions") {
+  auto previous = parse(SOURCE);
+  auto current = parse(string(SOURCE) +
+                       "def qux\n"
+                       "end\n"
+                       "namespace Quux\n"
+                       "  def corge;\n"
+                       "end\n");
+
+  auto reload = classify(previous, current);
+  CHECK(reload.kind == Reload::Bodies);
+  CHECK(reload.changed.empty());
+  REQUIRE(reload.added.size() == 2);
+  CHECK(name(reload.added[0]) == "qux");
+  CHECK(name(reload.added[1]) == "corge");
+}
+
+TEST_CASE("testing `Reload` full reloads") {
+  auto previous = parse(SOURCE);
+
+  for (auto source : {
+           // A prototype change
+           "def foo(b)\n"
+           "  a + 1\n"
+           "end\n"
+           "namespace Bar\n"
+           "  def baz\n"
+           "    f(x)\n"
+           "  end\n"
+           "end\n",
+
+           // A removed function
+           "namespace Bar\n"
+           "  def baz\n"
+           "    f(x)\n"
+           "  end\n"
+           "end\n",
+
+           // A removed namespace
+           "def foo(a)\n"
+           "  a + 1\n"
+           "end\n",
+
+           // A renamed namespace
+           "def foo(a)\n"
+           "  a + 1\n"
+           "end\n"
+           "namespace Qux\n"
+           "  def baz\n"
+           "    f(x)\n"
+           "  end\n"
+           "end\n",
+       })
+    CHECK(classify(previous, parse(source)).kind == Reload::Full);
+}
+
+TEST_CASE("testing `Reload` overloads") {
+  auto previous = parse("def foo(a)\n"
+                        "  a\n"
+                        "end\n"
+                        "def foo(a)\n"
+                        "  b\n"
+                        "end\n");
+
+  // The unchanged one is matched first, whichever the order
+  auto current = parse("def foo(a)\n"
+                       "  c\n"
+                       "end\n"
+                       "def foo(a)\n"
+                       "  a\n"
+                       "end\n");
+
+  auto reload = classify(previous, current);
+  CHECK(reload.kind == Reload::Bodies);
+  REQUIRE(reload.changed.size() == 1);
+  CHECK(reload.changed[0] == current->sast->functions[0]);
+
+  // Both changed
+  current = parse("def foo(a)\n"
+                  "  c\n"
+                  "end\n"
+                  "def foo(a)\n"
+                  "  d\n"
+                  "end\n");
+
+  reload = classify(previous, current);
+  CHECK(reload.kind == Reload::Bodies);
+  CHECK(reload.changed.size() == 2);
+}
@@ -0,0 +1,147 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/structural_hash.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Return the only function of a *unit*.
+static AST::FunctionDefinition *
+only_function(shared_ptr<Unit> unit) {
+  REQUIRE(unit->sast->functions.size() == 1);
+  return unit->sast->functions[0];
+}
+
+// Bodies are kept lazy, as some edited ones are not valid.
+static const char *SOURCE = "def foo(a, b)\n"
+                            "  a + b\n"
+                            "  f(a)\n"
+                            "end\n";
+
+TEST_CASE("testing `AST::rehash` blank edits") {
+  auto unit = parse(SOURCE, false);
+  auto foo = only_function(unit);
+
+  for (auto source : {
+           "def foo(a,  b) # Comment\n"
+           "  a + b\n"
+           "\n"
+           "  # Another comment\n"
+           "  f(a);\n"
+           "end\n",
+
+           "def foo(a, b)\n"
+           "  a + b; f(a)\n"
+           "end\n",
+
+           "\n"
+           "def foo(a, b)\n"
+           "\n"
+           "  a  +  b\n"
+           "  f(a) # Trailing\n"
+           "\n"
+           "end\n",
+       }) {
+    auto other = parse(source, false);
+    auto edited = only_function(other);
+
+    CHECK(edited->prototype_hash == foo->prototype_hash);
+    CHECK(edited->body_hash == foo->body_hash);
+    CHECK(edited->hash == foo->hash);
+    CHECK(other->sast->hash == unit->sast->hash);
+  }
+}
+
+TEST_CASE("testing `AST::rehash` body edits") {
+  auto unit = parse(SOURCE, false);
+  auto foo = only_function(unit);
+
+  for (auto source : {
+           "def foo(a, b)\n"
+           "  a - b\n"
+           "  f(a)\n"
+           "end\n",
+
+           // Statements are separated
+           "def foo(a, b)\n"
+           "  a + b f(a)\n"
+           "end\n",
+
+           "def foo(a, b)\n"
+           "  f(a)\n"
+           "  a + b\n"
+           "end\n",
+       }) {
+    auto other = parse(source, false);
+    auto edited = only_function(other);
+
+    CHECK(edited->prototype_hash == foo->prototype_hash);
+    CHECK(edited->body_hash != foo->body_hash);
+    CHECK(edited->hash != foo->hash);
+    CHECK(other->sast->hash != unit->sast->hash);
+  }
+}
+
+TEST_CASE("testing `AST::rehash` prototype edits") {
+  auto unit = parse(SOURCE, false);
+  auto foo = only_function(unit);
+
+  for (auto source : {
+           "def foo(a, c)\n"
+           "  a + b\n"
+           "  f(a)\n"
+           "end\n",
+
+           "def bar(a, b)\n"
+           "  a + b\n"
+           "  f(a)\n"
+           "end\n",
+
+           "static def foo(a, b)\n"
+           "  a + b\n"
+           "  f(a)\n"
+           "end\n",
+       }) {
+    auto edited = only_function(parse(source, false));
+
+    CHECK(edited->prototype_hash != foo->prototype_hash);
+    CHECK(edited->body_hash == foo->body_hash);
+    CHECK(edited->hash != foo->hash);
+  }
+}
+
+TEST_CASE("testing `AST::rehash` namespaces") {
+  auto unit = parse("namespace Foo\n"
+                    "  def bar\n"
+                    "    a\n"
+                    "  end\n"
+                    "end\n");
+
+  auto ns = unit->sast->namespaces[0];
+
+  // A nested body edit changes the namespace hash
+  auto other = parse("namespace Foo\n"
+                     "  def bar\n"
+                     "    b\n"
+                     "  end\n"
+                     "end\n");
+
+  CHECK(other->sast->namespaces[0]->hash != ns->hash);
+
+  // So does the name
+  other = parse("namespace Baz\n"
+                "  def bar\n"
+                "    a\n"
+                "  end\n"
+                "end\n");
+
+  CHECK(other->sast->namespaces[0]->hash != ns->hash);
+
+  // And the order of declarations
+  auto ab = parse("def a; def b;\n");
+  auto ba = parse("def b; def a;\n");
+  CHECK(ab->sast->hash != ba->sast->hash);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/token.hpp"
+
+using namespace Onyx::Compiler;
+
+// Split a *source* into tokens as the lexer would, for a subset of
+// the syntax sufficient for tests: IDs (including keywords), types,
+// kwargs, decimal integers, operators, comments and punctuation.
+static vector<shared_ptr<Token::Base>>
+tokenize(const string &source) {
+  using Control = Token::Control;
+  using Value = Token::Value;
+
+  vector<shared_ptr<Token::Base>> tokens;
+  size_t i = 0;
+
+  auto control = [&](Control::Kind kind, size_t size) {
+    tokens.push_back(make_shared<Control>(Location(nullptr), kind));
+    i += size;
+  };
+
+  auto value = [&](Value::Kind kind, size_t begin, size_t end) {
+    tokens.push_back(make_shared<Value>(
+        Location(nullptr), kind, source.substr(begin, end - begin)));
+  };
+
+  auto is = [&](const char *string) {
+    return source.compare(i, strlen(string), string) == 0;
+  };
+
+  while (i < source.size()) {
+    char c = source[i];
+    size_t begin = i;
+
+    if (c == ' ')
+      control(Control::Space, 1);
+    else if (c == '\n')
+      control(Control::Newline, 1);
+    else if (c == '#') {
+      control(Control::Comment, 1);
+
+      while (i < source.size() && source[i] != '\n')
+        i++;
+
+      value(Value::Text, begin + 1, i);
+    } else if (isalpha(c) || c == '_') {
+      while (i < source.size() &&
+             (isalnum(source[i]) || source[i] == '_'))
+        i++;
+
+      if (is(":") && !is("::")) {
+        value(Value::Kwarg, begin, i);
+        i++;
+      } else
+        value(isupper(c) ? Value::Type : Value::ID, begin, i);
+    } else if (isdigit(c)) {
+      while (i < source.size() && isdigit(source[i]))
+        i++;
+
+      tokens.push_back(make_shared<Token::NumericLiteral>(
+          Location(nullptr),
+          Token::NumericLiteral::Deci,
+          vector<char>(source.begin() + begin, source.begin() + i)));
+    } else if (is("|>"))
+      control(Control::PipeArrow, 2);
+    else if (is("?:"))
+      control(Control::Elvis, 2);
+    else if (is("::"))
+      control(Control::DoubleColon, 2);
+    else if (is(".."))
+      control(Control::Splat, 2);
+    else if (is("@["))
+      control(Control::Annotation, 2);
+    else if (c == '?')
+      control(Control::Ternary, 1);
+    else if (c == ':')
+      control(Control::Colon, 1);
+    else if (c == '.')
+      control(Control::Dot, 1);
+    else if (c == ',')
+      control(Control::Comma, 1);
+    else if (c == ';')
+      control(Control::Semicolon, 1);
+    else if (c == '(')
+      control(Control::OpenParen, 1);
+    else if (c == ')')
+      control(Control::CloseParen, 1);
+    else if (c == '[')
+      control(Control::OpenSquare, 1);
+    else if (c == ']')
+      control(Control::CloseSquare, 1);
+    else if (c == '{')
+      control(Control::OpenCurly, 1);
+    else if (c == '}')
+      control(Control::CloseCurly, 1);
+    else {
+      while (i < source.size() && strchr("+-*/%<>=!&|^~", source[i]))
+        i++;
+
+      if (i == begin)
+        throw "BUG! Unexpected character in a test source";
+      else if (i - begin == 1 && c == '=')
+        tokens.push_back(make_shared<Control>(
+            Location(nullptr), Control::Assignment));
+      else
+        value(Value::Op, begin, i);
+    }
+  }
+
+  return tokens;
+}
+
+// Return a unit of a *source* with its tokens and an empty SAST.
+inline shared_ptr<Unit> lex(const string &source) {
+  auto unit = make_shared<Unit>(false, "test.nx", nullptr);
+  unit->tokens = tokenize(source);
+  unit->sast = unit->arena.make<AST::Root>();
+  return unit;
+}
+
+// Parse a *source* with structural hashes, and its function
+// bodies as well if *bodies*; otherwise they are kept lazy.
+inline shared_ptr<Unit>
+parse(const string &source, bool bodies = true) {
+  auto unit = lex(source);
+
+  TaskQueue queue;
+  DeclarationParser::parse_unit(*unit, queue);
+
+  if (bodies)
+    BodyParser(*unit).parse_all(unit->sast);
+
+  return unit;
+}
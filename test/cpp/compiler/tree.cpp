@@ -0,0 +1,84 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <sstream>
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/tree.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Parse a *source* with bodies, and return the dump of its
+// node-based and flat trees.
+static pair<string, string> dump(const string &source) {
+  auto unit = parse(source);
+
+  stringstream nodes, flat;
+  unit->sast->dump(&nodes);
+  AST::Tree(unit->sast).root().dump(&flat);
+
+  return {nodes.str(), flat.str()};
+}
+
+TEST_CASE("testing `Tree` flattening round-trip") {
+  auto [nodes, flat] = dump("namespace Foo\n"
+                            "  def bar(a, b: Int = 1)\n"
+                            "    f(a + b * 2, x: a ? b : a)\n"
+                            "    a |> g\n"
+                            "  end\n"
+                            "end\n"
+                            "\n"
+                            "def baz(c)\n"
+                            "  -a ?: b.c(..d)\n"
+                            "end\n");
+
+  CHECK(nodes == flat);
+
+  // Both trees are complete, and names are printed
+  CHECK(flat.find("Namespace Foo\n") != string::npos);
+  CHECK(flat.find("NamedArgument x\n") != string::npos);
+  CHECK(flat.find("Ternary\n") != string::npos);
+  CHECK(flat.find("Empty\n") != string::npos);
+}
+
+TEST_CASE("testing `Tree` flattening of lazy bodies") {
+  auto unit = parse("def foo\n  bar\nend\n", false);
+
+  // A body which is not parsed yet is flattened as `Empty`
+  stringstream nodes, flat;
+  unit->sast->dump(&nodes);
+  AST::Tree(unit->sast).root().dump(&flat);
+
+  CHECK(nodes.str() == flat.str());
+  CHECK(flat.str() == "Root\n"
+                      "  FunctionDefinition\n"
+                      "    FunctionPrototype foo\n"
+                      "    Empty\n");
+}
+
+TEST_CASE("testing `Tree` flattening of deep trees") {
+  const size_t terms = 100000;
+  string source = "def foo\n  a";
+
+  for (size_t i = 1; i < terms; i++)
+    source += " + a";
+
+  auto unit = parse(source + "\nend\n");
+  auto tree = AST::Tree(unit->sast);
+
+  // The root, the definition, its prototype and body, then
+  // binops and IDs of the chain
+  CHECK(tree.size() == 4 + 2 * terms - 1);
+
+  // Walk down the left operands
+  auto node = tree.root()[0][1][0];
+  size_t depth = 1;
+
+  for (; node.kind() == AST::Kind::Binop; depth++)
+    node = node[0];
+
+  CHECK(node.kind() == AST::Kind::ID);
+  CHECK(depth == terms);
+}
@@ -0,0 +1,88 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/usage.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Parse a *source*, bodies included, and collect its usage.
+static Usage
+collect(const string &source, bool parse_bodies = true) {
+  return Usage::collect(*parse(source, parse_bodies));
+}
+
+TEST_CASE("testing `Usage` signature determinism") {
+  const auto source =
+      "static threadsafe def foo(a: Int, b: Int = 1)\n"
+      "  bar(a)\n"
+      "end\n";
+
+  // Every parse allocates tokens anew, at other addresses
+  const auto signature = collect(source).exports.at("foo");
+
+  for (int i = 0; i < 16; i++)
+    CHECK(collect(source).exports.at("foo") == signature);
+
+  // The order of modifiers does not matter, but modifiers do
+  CHECK(
+      collect("threadsafe static def foo(a: Int, b: Int = 1)\nend\n")
+          .exports.at("foo") == signature);
+
+  CHECK(collect("static def foo(a: Int, b: Int = 1)\nend\n")
+            .exports.at("foo") != signature);
+
+  // Bodies are not a part of signatures
+  CHECK(collect("static threadsafe def foo(a: Int, b: Int = 1)\n"
+                "  baz(a)\n"
+                "end\n")
+            .exports.at("foo") == signature);
+
+  // Restrictions are
+  CHECK(collect("static threadsafe def foo(a: Int, b: Float = 1)\n"
+                "end\n")
+            .exports.at("foo") != signature);
+}
+
+TEST_CASE("testing `Usage` consumptions") {
+  const auto source = "namespace Foo\n"
+                      "  def foo(a: Int, x: Float = pi)\n"
+                      "    bar(a, y: baz)\n"
+                      "  end\n"
+                      "end\n";
+
+  auto usage = collect(source);
+  CHECK(usage.exports.count("foo"));
+
+  for (auto name : {"Int", "Float", "pi", "bar", "a", "baz"})
+    CHECK(usage.consumptions.count(name));
+
+  // Every ID of a lazy body is deemed consumed
+  auto lazy = collect(source, false);
+  CHECK(lazy.exports.at("foo") == usage.exports.at("foo"));
+
+  for (auto name : {"bar", "a", "baz"})
+    CHECK(lazy.consumptions.count(name));
+}
+
+TEST_CASE("testing `Usage` of deep expressions") {
+  // A chain of `a + b.c + ...`, as deep as it is long
+  string chain = "a";
+
+  for (int i = 1; i < 100000; i++)
+    chain += " + b.c";
+
+  auto source = "def foo(x = " + chain + ")\n  " + chain + "\nend\n";
+  auto usage = collect(source);
+
+  for (auto name : {"a", "b", "c"})
+    CHECK(usage.consumptions.count(name));
+
+  // The signature covers the whole chain
+  auto longer = "def foo(x = " + chain + " + b)\nend\n";
+  auto signature = usage.exports.at("foo");
+  CHECK(collect(source).exports.at("foo") == signature);
+  CHECK(collect(longer).exports.at("foo") != signature);
+}
@@ -0,0 +1,145 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <functional>
+
+#include "../../../src/cpp/header/compiler/declaration_parser.hpp"
+#include "../../../src/cpp/header/compiler/tree.hpp"
+#include "../../../src/cpp/header/compiler/visitor.hpp"
+#include "../../../src/cpp/header/utils/log.hpp"
+#include "./tokenize.hpp"
+
+Verbosity verbosity = Warn;
+
+// Records kinds of visited nodes
+struct Recorder : AST::Visitor<Recorder> {
+  vector<AST::Kind> kinds;
+
+  bool enter(AST::Node *node) {
+    if (node)
+      kinds.push_back(node->kind);
+
+    return Visitor::enter(node);
+  }
+};
+
+// Counts calls, including nested ones
+struct Counter : AST::Visitor<Counter> {
+  size_t calls = 0;
+
+  bool visit_call(AST::Call *) {
+    calls++;
+    return true;
+  }
+};
+
+// Counts outermost calls only
+struct OuterCounter : AST::Visitor<OuterCounter> {
+  size_t calls = 0;
+
+  bool visit_call(AST::Call *) {
+    calls++;
+    return false;
+  }
+};
+
+// Tracks the depth of entered nodes
+struct Depth : AST::Visitor<Depth> {
+  size_t current = 0;
+  size_t deepest = 0;
+
+  bool enter(AST::Node *node) {
+    if (!Visitor::enter(node))
+      return false;
+
+    deepest = max(deepest, ++current);
+    return true;
+  }
+
+  void leave(AST::Node *) { current--; }
+};
+
+static const char *SOURCE = "namespace Foo\n"
+                            "  def bar(a, b: Int = 1)\n"
+                            "    f(g(a) + b, x: h(a) ? b : a)\n"
+                            "  end\n"
+                            "end\n"
+                            "\n"
+                            "def baz\n"
+                            "  -a ?: b.c(..d)\n"
+                            "end\n";
+
+TEST_CASE("testing `Visitor` order") {
+  auto unit = parse(SOURCE);
+
+  Recorder recorder;
+  recorder.visit(unit->sast);
+
+  // Nodes are visited depth-first in source order,
+  // i.e. in the order of a flattened tree
+  vector<AST::Kind> expected;
+  auto tree = AST::Tree(unit->sast);
+
+  function<void(AST::Tree::Handle)> walk = [&](auto node) {
+    if (node.kind() != AST::Kind::Empty &&
+        node.kind() != AST::Kind::NamedArgument)
+      expected.push_back(node.kind());
+
+    for (auto child : node)
+      walk(child);
+  };
+
+  walk(tree.root());
+
+  CHECK(recorder.kinds == expected);
+  CHECK(recorder.kinds.front() == AST::Kind::Root);
+
+  // Functions of a namespace come before its namespaces
+  CHECK(recorder.kinds[1] == AST::Kind::FunctionDefinition);
+  CHECK(recorder.kinds.back() == AST::Kind::ID);
+}
+
+TEST_CASE("testing `Visitor` overrides") {
+  auto unit = parse(SOURCE);
+
+  Counter counter;
+  counter.visit(unit->sast);
+  CHECK(counter.calls == 4);
+
+  // Only a subtree is visited
+  counter.calls = 0;
+  counter.visit(unit->sast->functions[0]);
+  CHECK(counter.calls == 1);
+
+  // Nothing is visited from a missing node
+  counter.calls = 0;
+  counter.visit(nullptr);
+  CHECK(counter.calls == 0);
+
+  // Children of a node are skipped if its handler returns `false`
+  OuterCounter outer;
+  outer.visit(unit->sast);
+  CHECK(outer.calls == 2);
+
+  // Every entered node is left
+  Depth depth;
+  depth.visit(unit->sast);
+  CHECK(depth.current == 0);
+  CHECK(depth.deepest == 8);
+}
+
+TEST_CASE("testing `Visitor` deep trees") {
+  const size_t terms = 100000;
+  string source = "def foo\n  a";
+
+  for (size_t i = 1; i < terms; i++)
+    source += " + a";
+
+  auto unit = parse(source + "\nend\n");
+
+  // Root, the definition, the body, binops and the innermost ID
+  Depth depth;
+  depth.visit(unit->sast);
+  CHECK(depth.current == 0);
+  CHECK(depth.deepest == terms + 3);
+}
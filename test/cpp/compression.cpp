@@ -0,0 +1,138 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <cstring>
+
+#include "../../src/cpp/header/app/shared/compression.hpp"
+
+using namespace Onyx::App::Shared;
+
+// Return a compressible sample, similar to other *i*-th ones.
+static string sample(int i) {
+  string sample;
+
+  for (int j = 0; j < 64; j++)
+    sample += "def foo" + to_string(i * j % 97) + "(bar : Int" +
+              to_string(j % 8) + ") : Bool; end\n";
+
+  return sample;
+}
+
+// Decode a whole *entry*, if it is valid.
+static optional<string> decode(
+    const string &entry,
+    const Compression::Dictionary *dictionary = nullptr) {
+  auto header = Compression::read_header(entry.data(), entry.size());
+
+  if (!header || entry.size() != sizeof(Compression::Header) +
+                                     header->stored_size)
+    return nullopt;
+
+  string data(header->raw_size, '\0');
+
+  if (!Compression::decode(
+          header.value(),
+          entry.data() + sizeof(Compression::Header),
+          data.data(),
+          dictionary))
+    return nullopt;
+
+  return data;
+}
+
+TEST_CASE("testing `Compression` round-trip") {
+  auto data = sample(1);
+
+  for (auto codec :
+       {Compression::None, Compression::LZ4, Compression::Zstd}) {
+    auto entry = Compression::encode(data, codec);
+    auto header =
+        Compression::read_header(entry.data(), entry.size());
+
+    REQUIRE(header);
+    CHECK(header->codec == codec);
+    CHECK(header->raw_size == data.size());
+    CHECK(decode(entry) == data);
+
+    if (codec != Compression::None)
+      CHECK(header->stored_size < data.size());
+
+    // An empty input
+    CHECK(decode(Compression::encode("", codec)) == "");
+  }
+}
+
+TEST_CASE("testing `Compression` with a dictionary") {
+  vector<string> samples;
+
+  for (int i = 0; i < 128; i++)
+    samples.push_back(sample(i));
+
+  auto dictionary = Compression::Dictionary::train(samples, 4096);
+  REQUIRE(dictionary);
+  CHECK(dictionary->id);
+
+  auto data = sample(128);
+  auto entry =
+      Compression::encode(data, Compression::Zstd, dictionary.get());
+
+  auto header = Compression::read_header(entry.data(), entry.size());
+  REQUIRE(header);
+  CHECK(header->dictionary == dictionary->id);
+  CHECK(decode(entry, dictionary.get()) == data);
+
+  // The dictionary is required to decode
+  CHECK(!decode(entry));
+
+  // It is smaller than without the dictionary
+  auto plain = Compression::encode(data, Compression::Zstd);
+  CHECK(entry.size() < plain.size());
+
+  // Not enough samples to train from
+  CHECK(!Compression::Dictionary::train({"foo"}, 4096));
+}
+
+TEST_CASE("testing `Compression` corrupt entries") {
+  auto entry = Compression::encode(sample(1), Compression::LZ4);
+
+  // Too short for a header
+  CHECK(!Compression::read_header(entry.data(), 16));
+
+  auto corrupt = entry;
+  corrupt[0] = 'X'; // Magic
+  CHECK(!decode(corrupt));
+
+  corrupt = entry;
+  corrupt[4]++; // Version
+  CHECK(!decode(corrupt));
+
+  corrupt = entry;
+  corrupt[5] = 3; // Codec
+  CHECK(!decode(corrupt));
+
+  // A raw size not matching the payload
+  Compression::Header header;
+  memcpy(&header, entry.data(), sizeof(header));
+  header.raw_size--;
+
+  corrupt = entry;
+  memcpy(corrupt.data(), &header, sizeof(header));
+  CHECK(!decode(corrupt));
+
+  // A garbled payload, i.e. the Zstd frame magic
+  corrupt = Compression::encode(sample(1), Compression::Zstd);
+  corrupt[sizeof(Compression::Header)] ^= 0xff;
+  CHECK(!decode(corrupt));
+
+  // An uncompressed payload is checked as well
+  corrupt = Compression::encode(sample(1), Compression::None);
+  corrupt[sizeof(Compression::Header) + 100] ^= 0x01;
+  CHECK(!decode(corrupt));
+
+  // Sizes are checked before allocating a buffer
+  for (auto size : {Compression::MAX_SIZE + 1, ~uint64_t(0)}) {
+    header.raw_size = size;
+    memcpy(corrupt.data(), &header, sizeof(header));
+    CHECK(!Compression::read_header(corrupt.data(), corrupt.size()));
+  }
+}
@@ -0,0 +1,129 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "../../../src/cpp/source/utils/arena.cpp"
+
+TEST_CASE("testing `Arena` small blocks") {
+  Arena arena;
+
+  auto a = arena.allocate(24);
+  auto b = arena.allocate(24);
+  CHECK(a != b);
+  CHECK(uintptr_t(a) % Arena::ALIGNMENT == 0);
+  CHECK(uintptr_t(b) % Arena::ALIGNMENT == 0);
+  CHECK(arena.reserved() == Arena::CHUNK_SIZE);
+
+  // A freed block is reused by the same size class
+  arena.free(a, 24);
+  CHECK(arena.allocate(20) == a);
+
+  // Growing within the size class keeps the block
+  CHECK(arena.reallocate(b, 24, 32) == b);
+}
+
+TEST_CASE("testing `Arena` reallocation") {
+  Arena arena;
+
+  auto a = (char *)arena.allocate(8);
+  memcpy(a, "1234567", 8);
+
+  auto b = (char *)arena.reallocate(a, 8, 100);
+  CHECK(!strcmp(b, "1234567"));
+
+  auto c = (char *)arena.reallocate(b, 100, 10000);
+  CHECK(!strcmp(c, "1234567"));
+  CHECK(arena.reserved() == Arena::CHUNK_SIZE + 10000);
+
+  auto d = (char *)arena.reallocate(c, 10000, 4);
+  CHECK(!memcmp(d, "1234", 4));
+  CHECK(arena.reserved() == Arena::CHUNK_SIZE);
+}
+
+TEST_CASE("testing `Arena::reset`") {
+  Arena arena;
+
+  auto first = arena.allocate(Arena::MAX_SMALL_SIZE);
+
+  for (size_t i = 0; i < 3 * Arena::CHUNK_SIZE / 512; i++)
+    arena.allocate(Arena::MAX_SMALL_SIZE);
+
+  arena.allocate(1024 * 1024);
+  CHECK(arena.reserved() == 4 * Arena::CHUNK_SIZE + 1024 * 1024);
+
+  // Chunks are retained, large blocks are freed
+  arena.reset();
+  CHECK(arena.reserved() == 4 * Arena::CHUNK_SIZE);
+  CHECK(arena.allocate(16) == first);
+}
+
+TEST_CASE("testing `Arena` objects") {
+  struct Counted {
+    int *destroyed;
+    Counted(int *destroyed) : destroyed(destroyed) {}
+    ~Counted() { (*destroyed)++; }
+  };
+
+  int destroyed = 0;
+
+  {
+    Arena arena;
+
+    auto a = arena.make<Counted>(&destroyed);
+    arena.make<Counted>(&destroyed);
+    CHECK(uintptr_t(a) % Arena::ALIGNMENT == 0);
+
+    // Trivially destructible objects are not tracked
+    CHECK(*arena.make<int>(42) == 42);
+
+    arena.reset();
+    CHECK(destroyed == 2);
+
+    arena.make<Counted>(&destroyed);
+  }
+
+  CHECK(destroyed == 3);
+}
+
+TEST_CASE("testing `Arena::adopt`") {
+  struct Counted {
+    int *destroyed;
+    Counted(int *destroyed) : destroyed(destroyed) {}
+    ~Counted() { (*destroyed)++; }
+  };
+
+  int destroyed = 0;
+
+  {
+    Arena arena;
+    auto a = (char *)arena.allocate(16);
+
+    {
+      Arena other;
+      other.make<Counted>(&destroyed);
+      other.allocate(1024 * 1024);
+
+      auto b = (char *)other.allocate(16);
+      memcpy(b, "adopted", 8);
+
+      arena.adopt(other);
+      CHECK(other.reserved() == 0);
+      CHECK(arena.reserved() == 2 * Arena::CHUNK_SIZE + 1024 * 1024);
+
+      // Adopted blocks are not carved again
+      for (size_t i = 0; i < 2 * Arena::CHUNK_SIZE / 16; i++) {
+        auto c = (char *)arena.allocate(16);
+        CHECK(c != a);
+        CHECK(c != b);
+      }
+
+      CHECK(!strcmp(b, "adopted"));
+    }
+
+    CHECK(destroyed == 0);
+  }
+
+  CHECK(destroyed == 1);
+}
@@ -7,3 +7,22 @@ TEST_CASE("testing FNV1a implementations") {
   CHECK(FNV1a::hash32("hello", 6) == 43209009);
   CHECK(FNV1a::hash64("hello", 6) == 12230803299529341361uL);
 }
+
+TEST_CASE("testing chunked FNV1a hashing") {
+  auto hash = FNV1a::hash64("hel", 3);
+  hash = FNV1a::hash64("lo", 3, hash);
+  CHECK(hash == FNV1a::hash64("hello", 6));
+}
+
+TEST_CASE("testing 128-bit FNV1a hashing") {
+  const FNV1a::Hash128 basis = {0x6c62272e07bb0142, 0x62b821756295c58d};
+  CHECK(FNV1a::hash128("", 0) == basis);
+
+  const FNV1a::Hash128 a = {0xd228cb696f1a8caf, 0x78912b704e4a8964};
+  CHECK(FNV1a::hash128("a", 1) == a);
+
+  auto hash = FNV1a::hash128("hel", 3);
+  hash = FNV1a::hash128("lo", 2, hash);
+  CHECK(hash == FNV1a::hash128("hello", 5));
+  CHECK(!(hash == FNV1a::hash128("hellO", 5)));
+}
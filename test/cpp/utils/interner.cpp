@@ -0,0 +1,40 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <thread>
+#include <vector>
+
+#include "../../../src/cpp/source/utils/interner.cpp"
+
+TEST_CASE("testing `Interner`") {
+  Interner interner;
+
+  auto foo = interner.intern("foo");
+  auto bar = interner.intern("bar");
+
+  CHECK(foo != bar);
+  CHECK(interner.intern(std::string("foo")) == foo);
+  CHECK(interner.lookup(foo) == "foo");
+  CHECK(interner.lookup(bar) == "bar");
+  CHECK(interner.size() == 2);
+}
+
+TEST_CASE("testing `Interner` concurrently") {
+  Interner interner;
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < 4; t++)
+    threads.push_back(std::thread([&interner]() {
+      for (int i = 0; i < 1000; i++)
+        interner.intern(std::to_string(i));
+    }));
+
+  for (auto &thread : threads)
+    thread.join();
+
+  CHECK(interner.size() == 1000);
+
+  for (int i = 0; i < 1000; i++)
+    CHECK(interner.lookup(interner.intern(std::to_string(i))) ==
+          std::to_string(i));
+}
@@ -0,0 +1,72 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <utility>
+
+#include "../../../src/cpp/header/utils/small_vector.hpp"
+
+TEST_CASE("testing `SmallVector` inline storage") {
+  SmallVector<int, 4> vector;
+  CHECK(vector.empty());
+  CHECK(vector.is_inline());
+
+  for (int i = 0; i < 4; i++)
+    vector.push_back(i);
+
+  CHECK(vector.size() == 4);
+  CHECK(vector.is_inline());
+
+  // Outgrowing moves the elements to the heap, in order
+  vector.push_back(4);
+  CHECK(!vector.is_inline());
+  CHECK(vector.capacity() == 8);
+
+  int expected = 0;
+
+  for (auto value : vector)
+    CHECK(value == expected++);
+
+  CHECK(expected == 5);
+}
+
+TEST_CASE("testing `SmallVector` insertion") {
+  SmallVector<int, 2> vector = {1, 3};
+
+  vector.insert(vector.begin() + 1, 2);
+  vector.insert(vector.begin(), 0);
+  vector.insert(vector.end(), 4);
+
+  CHECK(vector.size() == 5);
+
+  for (int i = 0; i < 5; i++)
+    CHECK(vector[i] == i);
+
+  // An element of the vector itself may be pushed
+  vector.push_back(vector[0]);
+  CHECK(vector.back() == 0);
+}
+
+TEST_CASE("testing `SmallVector` copying and moving") {
+  SmallVector<int, 2> small = {1};
+  SmallVector<int, 2> large = {1, 2, 3};
+
+  auto copy = large;
+  CHECK(copy.size() == 3);
+  CHECK(copy.data() != large.data());
+  CHECK(copy[2] == 3);
+
+  // A heap buffer is taken over
+  auto data = large.data();
+  auto moved = std::move(large);
+  CHECK(moved.data() == data);
+  CHECK(large.empty());
+  CHECK(large.is_inline());
+
+  auto moved_small = std::move(small);
+  CHECK(moved_small.is_inline());
+  CHECK(moved_small[0] == 1);
+
+  moved = moved_small;
+  CHECK(moved.size() == 1);
+  CHECK(moved[0] == 1);
+}
@@ -0,0 +1,146 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest/doctest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "../../../src/cpp/source/utils/task_queue.cpp"
+
+using namespace std;
+
+// Threads running tasks of a queue until stopped.
+struct Workers {
+  TaskQueue &queue;
+  atomic<bool> is_stopped = false;
+  vector<thread> threads;
+
+  Workers(TaskQueue &queue, int count) : queue(queue) {
+    for (int i = 0; i < count; i++)
+      threads.emplace_back([this]() {
+        while (!is_stopped)
+          if (auto task = this->queue.pop())
+            this->queue.run(task);
+          else
+            this_thread::yield();
+      });
+  }
+
+  ~Workers() {
+    is_stopped = true;
+
+    for (auto &thread : threads)
+      thread.join();
+  }
+};
+
+TEST_CASE("testing `TaskQueue` result order") {
+  TaskQueue queue;
+  Workers workers(queue, 4);
+
+  vector<int> results(1000);
+  vector<shared_ptr<TaskQueue::Task>> tasks;
+
+  for (int i = 0; i < 1000; i++)
+    tasks.push_back(queue.push([&results, i]() {
+      // Later tasks are done earlier
+      this_thread::sleep_for(chrono::microseconds(1000 - i));
+      results[i] = i * i;
+    }));
+
+  queue.join(tasks);
+
+  for (int i = 0; i < 1000; i++) {
+    CHECK(tasks[i]->is_done);
+    CHECK(results[i] == i * i);
+  }
+
+  CHECK(!queue.pop());
+}
+
+TEST_CASE("testing `TaskQueue` without workers") {
+  TaskQueue queue;
+  int done = 0;
+
+  // The joining thread runs the tasks itself
+  auto a = queue.push([&]() { CHECK(done++ == 0); });
+  auto b = queue.push([&]() { CHECK(done++ == 1); });
+
+  queue.join({b, a});
+  CHECK(done == 2);
+}
+
+TEST_CASE("testing `TaskQueue` exceptions") {
+  TaskQueue queue;
+  Workers workers(queue, 4);
+
+  vector<shared_ptr<TaskQueue::Task>> tasks;
+  atomic<int> done = 0;
+
+  for (int i = 0; i < 16; i++)
+    tasks.push_back(queue.push([&done, i]() {
+      if (i == 3 || i == 7) {
+        // The latter throws first
+        const auto delay = chrono::milliseconds(i == 3 ? 20 : 0);
+        this_thread::sleep_for(delay);
+        throw runtime_error(to_string(i));
+      }
+
+      done++;
+    }));
+
+  string thrown;
+
+  try {
+    queue.join(tasks);
+  } catch (runtime_error &e) {
+    thrown = e.what();
+  }
+
+  CHECK(thrown == "3");
+
+  // Failed tasks do not cancel others
+  CHECK(done == 14);
+
+  for (auto &task : tasks)
+    CHECK(task->is_done);
+}
+
+TEST_CASE("testing `TaskQueue` nested tasks") {
+  TaskQueue queue;
+  Workers workers(queue, 2);
+
+  atomic<int> sum = 0;
+  vector<shared_ptr<TaskQueue::Task>> tasks;
+
+  // Each task joins its own subtasks; the joining
+  // threads run the queued tasks rather than block
+  for (int i = 0; i < 8; i++)
+    tasks.push_back(queue.push([&]() {
+      vector<shared_ptr<TaskQueue::Task>> subtasks;
+
+      for (int j = 0; j < 8; j++)
+        subtasks.push_back(queue.push([&]() { sum++; }));
+
+      queue.join(subtasks);
+    }));
+
+  queue.join(tasks);
+  CHECK(sum == 64);
+}
+
+TEST_CASE("testing `TaskQueue` notification") {
+  int notified = 0;
+  TaskQueue queue([&]() { notified++; });
+
+  auto task = queue.push([]() {});
+  CHECK(notified == 1);
+
+  CHECK(queue.pop() == task);
+  CHECK(!queue.pop());
+
+  queue.run(task);
+  CHECK(task->is_done);
+  CHECK(notified == 1);
+}